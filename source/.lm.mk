@@ -6,13 +6,26 @@
 COMPILER = gcc
 CONFIG_DEBUG = y
 CONFIG_LOG_LEVEL = 0
-CONFIG_MEM_POOL_SIZE = 20
 CONFIG_MACRO_CACHE_SIZE = 100
 
 # Variables provided for Makefile
-C_SOURCE := lm_macro.c lm_mem.c lm_parser.c lm_string.c lm_array.c lm_log.c lm_gen.c lm_cmd.c main.c heap_tlsf.c
+LM_CONFIG_HASH := f28bd5ebded8b38fd1fd031ec1aed674
+C_SOURCE := lm_macro.c lm_mem.c lm_parser.c lm_string.c lm_array.c lm_log.c lm_gen.c lm_cmd.c lm_build.c lm_hash.c lm_cache.c lm_variant.c lm_unity.c lm_batch.c lm_dep.c \
+            lm_sat.c lm_watch.c lm_server.c lm_time.c lm_trace.c lm_timeline.c lm_install.c heap_tlsf.c main.c bench/lm_bench.c bench/lm_microbench.c
 
 C_PATH := -I.
 
 C_FLAG :=  -O2 -Wl,-Bstatic -ffunction-sections -fdata-sections -nostdlib -ffreestanding -Wunused-function -Wall -Wextra -Werror -std=c99
 
+LD_FLAG :=  -lpthread
+
+TARGETS := lm lm_bench lm_microbench
+
+TARGET_lm_SRC := main.c
+
+TARGET_lm_bench_SRC := bench/lm_bench.c
+
+TARGET_lm_microbench_SRC := bench/lm_microbench.c
+
+TARGET_lm_microbench_LDFLAG :=  -lm
+
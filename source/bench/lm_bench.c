@@ -0,0 +1,842 @@
+/* source/bench/lm_bench.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * End-to-end benchmark: generate a synthetic project of a given size, then
+ * time the lm configure (--projcfg) and Makefile generation (--gen) runs on
+ * it and write median, p95 and peak RSS as JSON to compare across commits.
+ *
+ * With --null-build it builds the project through the generated Makefile
+ * instead, with a stub toolchain that only writes the outputs, and times
+ * the make runs a developer waits for: nothing changed, one source touched,
+ * one config macro toggled.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+#include "lm_error.h"
+#include "lm_log.h"
+
+
+#if ( __linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+#define    BENCH_MAX_PATH           4096
+#define    BENCH_MAX_REPS           1000
+#define    BENCH_LINE_LIMIT         3000    // continuation lines are joined into one 4096 byte parser line
+#define    BENCH_PARAMS             "bench.params"
+#define    BENCH_STUB_DIR           "stub"
+#define    BENCH_TOGGLE             "CONFIG_M00001"
+
+
+typedef struct bench_params {
+    int macros;         // CONFIG_Mnnnnn entries in the root lm.cfg
+    int depth;          // length of the depends chains
+    int includes;       // lm.cfg files, nested as a binary tree below the root
+    int srcs;           // source files, spread over the included directories
+    int long_lines;     // CFLAG statements with continuation lines
+    int reps;
+}bench_params_t;
+
+
+typedef struct bench_result {
+    const char *name;
+    double ms[BENCH_MAX_REPS];
+    long rss[BENCH_MAX_REPS];   // KB
+    int count;
+}bench_result_t;
+
+
+/* the toolchain the generated Makefile calls, all of them links to this binary */
+static const char *stub_tools[] = { "gcc", "ar", "objcopy", "objdump", "size" };
+
+#define    BENCH_STUB_TOOLS         (int)(sizeof(stub_tools) / sizeof(stub_tools[0]))
+
+
+static bench_params_t params = {
+    .macros = 10000,
+    .depth = 50,
+    .includes = 1000,
+    .srcs = 100000,
+    .long_lines = 20,
+    .reps = 10,
+};
+
+
+static void bench_usage(const char *name)
+{
+    printf("usage: %s --lm <lm.exe> [options]\n", name);
+    printf("    --lm          lm binary to measure\n");
+    printf("    --dir         project directory, regenerated when the size changes, default: bench\n");
+    printf("    --out         JSON result file, default: bench.json\n");
+    printf("    --label       name of this run in the JSON, e.g. the commit\n");
+    printf("    --macros      macros, default: %d\n", params.macros);
+    printf("    --depth       depends chain length, default: %d\n", params.depth);
+    printf("    --includes    nested lm.cfg files, default: %d\n", params.includes);
+    printf("    --srcs        source files, default: %d\n", params.srcs);
+    printf("    --long-lines  CFLAG statements with continuation lines, default: %d\n", params.long_lines);
+    printf("    --reps        timed runs per command after one warm-up, default: %d\n", params.reps);
+    printf("    --null-build  time no-op, touch and config toggle make runs instead of lm itself\n");
+    printf("    --jobs        make -j for --null-build, default: one per cpu\n");
+    printf("    --variant     generate the Makefile with --variant for --null-build\n");
+}
+
+
+static FILE *bench_open(const char *dir, const char *name)
+{
+    char path[BENCH_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    FILE *file = fopen(path, "w");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not create %s: %s", path, strerror(errno));
+    }
+
+    return file;
+}
+
+
+static int bench_mkdir(const char *path)
+{
+    if(mkdir(path, 0755) != 0 && errno != EEXIST) {
+        LM_LOG_ERROR("can not create %s: %s", path, strerror(errno));
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+// every tenth macro is a number, the rest are bools; each chain starts at a multiple of depth
+static void bench_gen_macros(FILE *cfg, FILE *config)
+{
+    for(int i = 0; i < params.macros; i++) {
+        bool number = i % 10 == 9;
+
+        fprintf(cfg, "CONFIG_M%05d\n", i);
+        fprintf(cfg, number ? "    choices = [0, 1000]\n" : "    choices = n, y\n");
+        fprintf(cfg, number ? "    default = %d\n" : "    default = y\n", i % 1000);
+        if(i % params.depth) {
+            fprintf(cfg, "    depends = CONFIG_M%05d\n", i - 1);
+        }
+        fprintf(cfg, "\n");
+
+        // switch off one chain in seven, its tail then falls back through depends
+        if(number) {
+            fprintf(config, "CONFIG_M%05d=%d\n", i, (i * 7) % 1000);
+        }
+        else {
+            fprintf(config, "CONFIG_M%05d=%s\n", i, (i / params.depth) % 7 == 3 && i % params.depth == 0 ? "n" : "y");
+        }
+    }
+}
+
+
+static void bench_gen_long_lines(FILE *cfg)
+{
+    for(int i = 0; i < params.long_lines; i++) {
+        int len = fprintf(cfg, "CFLAG += -DBENCH_LONG_%02d_000=1 \\\n", i);
+
+        for(int j = 1; len < BENCH_LINE_LIMIT; j++) {
+            len += fprintf(cfg, "         -DBENCH_LONG_%02d_%03d=%d \\\n", i, j, j);
+        }
+        fprintf(cfg, "         -DBENCH_LONG_%02d_END=1\n\n", i);
+    }
+}
+
+
+/*
+ * include node k lives in <parent>/n<k> and includes nodes 2k+1 and 2k+2.
+ * Even nodes pick up their sources with a wildcard, odd nodes list them,
+ * every fourth one behind a macro.
+ */
+static int bench_gen_node(const char *dir, int node)
+{
+    char path[BENCH_MAX_PATH];
+    int per_node = params.srcs / params.includes;
+    int first = node * per_node;
+    int count = node == params.includes - 1 ? params.srcs - first : per_node;
+
+    if(bench_mkdir(dir) != LM_OK) {
+        return LM_ERR;
+    }
+
+    FILE *cfg = bench_open(dir, "lm.cfg");
+    if(cfg == NULL) {
+        return LM_ERR;
+    }
+
+    for(int i = first; i < first + count; i++) {
+        snprintf(path, sizeof(path), "f%06d.c", i);
+
+        FILE *src = bench_open(dir, path);
+        if(src == NULL) {
+            fclose(cfg);
+            return LM_ERR;
+        }
+        fprintf(src, "#include \"config.h\"\nint f%06d(void) { return %d; }\n", i, i);
+        fclose(src);
+
+        if(node % 2) {
+            if(i % 4 == 0 && params.macros) {
+                fprintf(cfg, "SRC-$(CONFIG_M%05d) += %s\n", i % params.macros, path);
+            }
+            else {
+                fprintf(cfg, "SRC += %s\n", path);
+            }
+        }
+    }
+
+    if(node % 2 == 0) {
+        fprintf(cfg, "SRC += *.c\n");
+    }
+
+    fprintf(cfg, "PATH += .\n");
+
+    for(int child = node * 2 + 1; child <= node * 2 + 2 && child < params.includes; child++) {
+        fprintf(cfg, "include \"n%d/lm.cfg\"\n", child);
+    }
+    fclose(cfg);
+
+    for(int child = node * 2 + 1; child <= node * 2 + 2 && child < params.includes; child++) {
+        snprintf(path, sizeof(path), "%s/n%d", dir, child);
+        if(bench_gen_node(path, child) != LM_OK) {
+            return LM_ERR;
+        }
+    }
+
+    return LM_OK;
+}
+
+
+static void bench_params_line(char *buf, size_t size)
+{
+    snprintf(buf, size, "macros=%d depth=%d includes=%d srcs=%d long_lines=%d\n",
+             params.macros, params.depth, params.includes, params.srcs, params.long_lines);
+}
+
+
+// generating 100k files takes a while, keep the project while the size is unchanged
+static int bench_generate(const char *dir)
+{
+    char want[256];
+    char have[256] = {0};
+    char path[BENCH_MAX_PATH];
+
+    bench_params_line(want, sizeof(want));
+    snprintf(path, sizeof(path), "%s/%s", dir, BENCH_PARAMS);
+
+    FILE *file = fopen(path, "r");
+    if(file) {
+        if(fgets(have, sizeof(have), file) == NULL) {
+            have[0] = '\0';
+        }
+        fclose(file);
+
+        if(strcmp(want, have) == 0) {
+            return LM_OK;
+        }
+
+        LM_LOG_ERROR("%s holds a project of another size, remove it first", dir);
+        return LM_ERR;
+    }
+
+    if(bench_mkdir(dir) != LM_OK) {
+        return LM_ERR;
+    }
+
+    printf("generating %s: %s", dir, want);
+    fflush(stdout);
+
+    FILE *cfg = bench_open(dir, "lm.cfg");
+    FILE *config = bench_open(dir, ".config");
+    if(cfg == NULL || config == NULL) {
+        return LM_ERR;
+    }
+
+    bench_gen_macros(cfg, config);
+    bench_gen_long_lines(cfg);
+    fprintf(cfg, "PATH += .\n");
+    if(params.includes > 0) {
+        fprintf(cfg, "include \"n0/lm.cfg\"\n");
+    }
+    fclose(cfg);
+    fclose(config);
+
+    if(params.includes > 0) {
+        snprintf(path, sizeof(path), "%s/n0", dir);
+        if(bench_gen_node(path, 0) != LM_OK) {
+            return LM_ERR;
+        }
+    }
+
+    // written last, an interrupted generation is not mistaken for a complete one
+    file = bench_open(dir, BENCH_PARAMS);
+    if(file == NULL) {
+        return LM_ERR;
+    }
+    fputs(want, file);
+    fclose(file);
+
+    return LM_OK;
+}
+
+
+static double bench_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+}
+
+
+// run argv in dir with its output discarded, wall time in ms and peak RSS in KB
+static int bench_run(const char *dir, char *argv[], double *ms, long *rss)
+{
+    posix_spawn_file_actions_t actions;
+    struct rusage usage;
+    int status;
+    pid_t pid;
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    char cwd[BENCH_MAX_PATH];
+    if(getcwd(cwd, sizeof(cwd)) == NULL || chdir(dir) != 0) {
+        LM_LOG_ERROR("can not enter %s", dir);
+        return LM_ERR;
+    }
+
+    double start = bench_now_ms();
+    int ret = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+
+    if(chdir(cwd) != 0 || ret != 0) {
+        posix_spawn_file_actions_destroy(&actions);
+        LM_LOG_ERROR("can not run %s: %s", argv[0], strerror(ret));
+        return LM_ERR;
+    }
+
+    while(wait4(pid, &status, 0, &usage) < 0) {
+        if(errno != EINTR) {
+            return LM_ERR;
+        }
+    }
+
+    *ms = bench_now_ms() - start;
+    *rss = usage.ru_maxrss;
+    posix_spawn_file_actions_destroy(&actions);
+
+    if(!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        LM_LOG_ERROR("%s failed in %s, run it there by hand to see why", argv[0], dir);
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+typedef int (*bench_prepare_fn)(const char *dir, int run);
+
+
+// one sample runs prepare untimed, then every command in cmds; their times add up
+static int bench_sample(const char *dir, char **cmds[], bench_prepare_fn prepare, int run, double *ms, long *rss)
+{
+    *ms = 0;
+    *rss = 0;
+
+    if(prepare && prepare(dir, run) != LM_OK) {
+        return LM_ERR;
+    }
+
+    for(int i = 0; cmds[i]; i++) {
+        double cmd_ms;
+        long cmd_rss;
+
+        if(bench_run(dir, cmds[i], &cmd_ms, &cmd_rss) != LM_OK) {
+            return LM_ERR;
+        }
+
+        *ms += cmd_ms;
+        *rss = cmd_rss > *rss ? cmd_rss : *rss;
+    }
+
+    return LM_OK;
+}
+
+
+static int bench_measure(bench_result_t *result, const char *dir, char **cmds[], bench_prepare_fn prepare)
+{
+    double ms;
+    long rss;
+
+    // the warm-up run fills the page cache and writes the outputs the timed runs then keep
+    if(bench_sample(dir, cmds, prepare, 0, &ms, &rss) != LM_OK) {
+        return LM_ERR;
+    }
+
+    for(result->count = 0; result->count < params.reps; result->count++) {
+        if(bench_sample(dir, cmds, prepare, result->count + 1,
+                        &result->ms[result->count], &result->rss[result->count]) != LM_OK) {
+            return LM_ERR;
+        }
+    }
+
+    return LM_OK;
+}
+
+
+static int bench_cmp_ms(const void *a, const void *b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+
+// nearest rank, so p95 of ten runs is the slowest one
+static double bench_percentile(const double *sorted, int count, int pct)
+{
+    int rank = (count * pct + 99) / 100;
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+
+static void bench_report(bench_result_t *results, int count, const char *mode, const char *label, const char *out)
+{
+    FILE *file = fopen(out, "w");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not write %s", out);
+    }
+
+    char line[256];
+    bench_params_line(line, sizeof(line));
+    printf("\n%s: %s", mode, line);
+    printf("%-10s %6s %10s %10s %10s %12s\n", "command", "reps", "min ms", "median ms", "p95 ms", "peak RSS KB");
+
+    if(file) {
+        fprintf(file, "{\n  \"label\": \"%s\",\n  \"mode\": \"%s\",\n", label, mode);
+        fprintf(file, "  \"params\": {\"macros\": %d, \"depth\": %d, \"includes\": %d, \"srcs\": %d, \"long_lines\": %d, \"reps\": %d},\n",
+                params.macros, params.depth, params.includes, params.srcs, params.long_lines, params.reps);
+        fprintf(file, "  \"results\": [\n");
+    }
+
+    for(int i = 0; i < count; i++) {
+        bench_result_t *result = &results[i];
+        long rss = 0;
+
+        qsort(result->ms, result->count, sizeof(double), bench_cmp_ms);
+        for(int j = 0; j < result->count; j++) {
+            rss = result->rss[j] > rss ? result->rss[j] : rss;
+        }
+
+        double median = result->count % 2 ? result->ms[result->count / 2] :
+                        (result->ms[result->count / 2 - 1] + result->ms[result->count / 2]) / 2;
+        double p95 = bench_percentile(result->ms, result->count, 95);
+
+        printf("%-10s %6d %10.2f %10.2f %10.2f %12ld\n", result->name, result->count, result->ms[0], median, p95, rss);
+
+        if(file) {
+            fprintf(file, "    {\"name\": \"%s\", \"reps\": %d, \"min_ms\": %.3f, \"median_ms\": %.3f, \"p95_ms\": %.3f, "
+                          "\"max_ms\": %.3f, \"peak_rss_kb\": %ld}%s\n",
+                    result->name, result->count, result->ms[0], median, p95, result->ms[result->count - 1], rss,
+                    i + 1 < count ? "," : "");
+        }
+    }
+
+    if(file) {
+        fprintf(file, "  ]\n}\n");
+        fclose(file);
+        printf("results written to %s\n", out);
+    }
+}
+
+
+/*
+ * Stand-in for the toolchain of the generated Makefile: gcc writes the -o
+ * file and a .d naming the source and config.h, which every generated source
+ * includes; ar and objcopy write their output, objdump and size do nothing.
+ */
+static int bench_stub(const char *tool, int argc, char *argv[])
+{
+    const char *out = NULL;
+    const char *dep = NULL;
+    const char *src = NULL;
+
+    if(strcmp(tool, "ar") == 0 && argc > 2) {
+        out = argv[2];
+    }
+    else if(strcmp(tool, "objcopy") == 0 && argc > 1) {
+        out = argv[argc - 1];
+    }
+    else if(strcmp(tool, "gcc") == 0) {
+        for(int i = 1; i < argc; i++) {
+            const char *dot = strrchr(argv[i], '.');
+
+            if(strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+                out = argv[++i];
+            }
+            else if(strcmp(argv[i], "-MF") == 0 && i + 1 < argc) {
+                dep = argv[++i];
+            }
+            else if(argv[i][0] != '-' && dot && (strcmp(dot, ".c") == 0 || strcmp(dot, ".cpp") == 0 || strcmp(dot, ".S") == 0)) {
+                src = argv[i];
+            }
+        }
+    }
+
+    if(out) {
+        FILE *file = fopen(out, "w");
+        if(file == NULL) {
+            return 1;
+        }
+        fclose(file);
+    }
+
+    if(out && dep && src) {
+        FILE *file = fopen(dep, "w");
+        if(file == NULL) {
+            return 1;
+        }
+        fprintf(file, "%s: %s config.h\n\nconfig.h:\n", out, src);
+        fclose(file);
+    }
+
+    return 0;
+}
+
+
+static int bench_link(const char *target, const char *dir, const char *name)
+{
+    char path[BENCH_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    remove(path);
+    if(symlink(target, path) != 0) {
+        LM_LOG_ERROR("can not create %s: %s", path, strerror(errno));
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+// the Makefile calls ./lm.exe for make config, and $(CC_PREFIX)gcc and friends
+static int bench_null_setup(const char *dir, const char *lm_path, char *prefix, size_t size)
+{
+    char self[PATH_MAX];
+    char stub[BENCH_MAX_PATH];
+
+    if(realpath("/proc/self/exe", self) == NULL || bench_link(lm_path, dir, "lm.exe") != LM_OK) {
+        return LM_ERR;
+    }
+
+    snprintf(stub, sizeof(stub), "%s/%s", dir, BENCH_STUB_DIR);
+    if(bench_mkdir(stub) != LM_OK) {
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < BENCH_STUB_TOOLS; i++) {
+        if(bench_link(self, stub, stub_tools[i]) != LM_OK) {
+            return LM_ERR;
+        }
+    }
+
+    snprintf(prefix, size, "CC_PREFIX=%s/", stub);
+    return LM_OK;
+}
+
+
+// touch a different source of the root include directory for every run
+static int bench_touch(const char *dir, int run)
+{
+    char path[BENCH_MAX_PATH];
+    int per_node = params.srcs / params.includes;
+
+    snprintf(path, sizeof(path), "%s/n0/f%06d.c", dir, per_node > 0 ? run % per_node : 0);
+    if(utimensat(AT_FDCWD, path, NULL, 0) != 0) {
+        LM_LOG_ERROR("can not touch %s", path);
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+// gen.config is the generated .config with BENCH_TOGGLE switched off on even runs, on for odd ones
+static int bench_toggle(const char *dir, int run)
+{
+    char path[BENCH_MAX_PATH];
+    char line[BENCH_MAX_PATH];
+    size_t toggle_len = strlen(BENCH_TOGGLE);
+
+    snprintf(path, sizeof(path), "%s/.config", dir);
+    FILE *in = fopen(path, "r");
+    FILE *out = bench_open(dir, "gen.config");
+    if(in == NULL || out == NULL) {
+        if(in) {
+            fclose(in);
+        }
+        if(out) {
+            fclose(out);
+        }
+        LM_LOG_ERROR("can not write %s/gen.config", dir);
+        return LM_ERR;
+    }
+
+    while(fgets(line, sizeof(line), in)) {
+        if(strncmp(line, BENCH_TOGGLE, toggle_len) == 0 && line[toggle_len] == '=') {
+            fprintf(out, "%s=%s\n", BENCH_TOGGLE, run % 2 ? "y" : "n");
+        }
+        else {
+            fputs(line, out);
+        }
+    }
+
+    fclose(in);
+    fclose(out);
+    return LM_OK;
+}
+
+
+/*
+ * Full build once, then no-op, one-source-touched and config-toggled make
+ * runs. The Makefile config target wipes the build directory unless the
+ * Makefile was generated with --variant, the toggle numbers show what that costs.
+ */
+static int bench_null_build(const char *dir, const char *lm_path, int jobs, bool variant, bench_result_t *results)
+{
+    char prefix[BENCH_MAX_PATH];
+    char jobs_arg[32];
+    double ms;
+    long rss;
+
+    if(bench_null_setup(dir, lm_path, prefix, sizeof(prefix)) != LM_OK) {
+        return LM_ERR;
+    }
+
+    // the make we run must not join a jobserver or inherit flags from a make that runs us
+    unsetenv("MAKEFLAGS");
+    unsetenv("MFLAGS");
+    unsetenv("MAKELEVEL");
+
+    snprintf(jobs_arg, sizeof(jobs_arg), "-j%d", jobs);
+
+    char *gen_argv[] = { (char*)lm_path, "--gen", "Makefile", "--projcfg", "gen.config", "--lmcfg", "lm.cfg",
+                         "--project", "bench", variant ? "--variant" : NULL, NULL };
+    char *config_argv[] = { "make", "config", prefix, NULL };
+    char *make_argv[] = { "make", jobs_arg, prefix, NULL };
+
+    char **gen_cmds[] = { gen_argv, NULL };
+    char **config_cmds[] = { config_argv, NULL };
+    char **make_cmds[] = { make_argv, NULL };
+    char **toggle_cmds[] = { config_argv, make_argv, NULL };
+
+    // --gen writes gen.config from the lm.cfg defaults, the generated .config replaces it
+    if(bench_sample(dir, gen_cmds, NULL, 0, &ms, &rss) != LM_OK ||
+       bench_toggle(dir, 1) != LM_OK ||
+       bench_sample(dir, config_cmds, NULL, 0, &ms, &rss) != LM_OK) {
+        return LM_ERR;
+    }
+
+    results[0].name = "full";
+    results[0].count = 1;
+    if(bench_sample(dir, make_cmds, NULL, 0, &results[0].ms[0], &results[0].rss[0]) != LM_OK) {
+        return LM_ERR;
+    }
+
+    results[1].name = "noop";
+    results[2].name = "touch";
+    results[3].name = "config";
+
+    if(bench_measure(&results[1], dir, make_cmds, NULL) != LM_OK ||
+       bench_measure(&results[2], dir, make_cmds, bench_touch) != LM_OK ||
+       bench_measure(&results[3], dir, toggle_cmds, bench_toggle) != LM_OK) {
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+static struct option bench_long_options[] =
+{
+    {"lm",         required_argument,      NULL, 'a'},
+    {"dir",        required_argument,      NULL, 'b'},
+    {"out",        required_argument,      NULL, 'c'},
+    {"label",      required_argument,      NULL, 'd'},
+    {"macros",     required_argument,      NULL, 'e'},
+    {"depth",      required_argument,      NULL, 'f'},
+    {"includes",   required_argument,      NULL, 'g'},
+    {"srcs",       required_argument,      NULL, 'h'},
+    {"long-lines", required_argument,      NULL, 'i'},
+    {"reps",       required_argument,      NULL, 'j'},
+    {"null-build", no_argument,            NULL, 'k'},
+    {"jobs",       required_argument,      NULL, 'l'},
+    {"variant",    no_argument,            NULL, 'm'},
+    {NULL,         0,                      NULL,  0},
+};
+
+
+int main(int argc, char *argv[])
+{
+    const char *lm = NULL;
+    const char *dir = "bench";
+    const char *out = "bench.json";
+    const char *label = "";
+    char lm_path[PATH_MAX];
+    char dir_path[PATH_MAX];
+    bool null_build = false;
+    bool variant = false;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int opt;
+
+    // started through one of the stub/ links by the generated Makefile
+    const char *tool = strrchr(argv[0], '/');
+    tool = tool ? tool + 1 : argv[0];
+    for(int i = 0; i < BENCH_STUB_TOOLS; i++) {
+        if(strcmp(tool, stub_tools[i]) == 0) {
+            return bench_stub(tool, argc, argv);
+        }
+    }
+
+    while((opt = getopt_long(argc, argv, "", bench_long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'a':
+                lm = optarg;
+                break;
+            case 'b':
+                dir = optarg;
+                break;
+            case 'c':
+                out = optarg;
+                break;
+            case 'd':
+                label = optarg;
+                break;
+            case 'e':
+                params.macros = strtol(optarg, NULL, 10);
+                break;
+            case 'f':
+                params.depth = strtol(optarg, NULL, 10);
+                break;
+            case 'g':
+                params.includes = strtol(optarg, NULL, 10);
+                break;
+            case 'h':
+                params.srcs = strtol(optarg, NULL, 10);
+                break;
+            case 'i':
+                params.long_lines = strtol(optarg, NULL, 10);
+                break;
+            case 'j':
+                params.reps = strtol(optarg, NULL, 10);
+                break;
+            case 'k':
+                null_build = true;
+                break;
+            case 'l':
+                jobs = strtol(optarg, NULL, 10);
+                break;
+            case 'm':
+                variant = true;
+                break;
+            default:
+                bench_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(lm == NULL || params.macros < 0 || params.depth < 1 || params.includes < 0 || params.srcs < 0 ||
+       (params.srcs > 0 && params.includes == 0) || params.long_lines < 0 || params.reps < 1 || params.reps > BENCH_MAX_REPS ||
+       jobs < 1 || (null_build && params.includes == 0)) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+
+    // lm runs inside the project directory
+    if(realpath(lm, lm_path) == NULL) {
+        LM_LOG_ERROR("can not find %s", lm);
+        return 1;
+    }
+
+    if(bench_generate(dir) != LM_OK || realpath(dir, dir_path) == NULL) {
+        return 1;
+    }
+
+    if(null_build) {
+        static bench_result_t null_results[4];
+
+        if(bench_null_build(dir_path, lm_path, jobs, variant, null_results) != LM_OK) {
+            return 1;
+        }
+
+        bench_report(null_results, 4, variant ? "null-build --variant" : "null-build", label, out);
+        return 0;
+    }
+
+    // --gen rewrites the .config it is given, keep it away from the one --projcfg reads
+    char *projcfg_argv[] = { lm_path, "--projcfg", ".config", "--lmcfg", "lm.cfg", "--out", "config.h", "--mk", ".lm.mk", NULL };
+    char *gen_argv[] = { lm_path, "--gen", "Makefile", "--projcfg", "gen.config", "--lmcfg", "lm.cfg", "--project", "bench", NULL };
+
+    static bench_result_t results[2];
+    results[0].name = "projcfg";
+    results[1].name = "gen";
+
+    char **projcfg_cmds[] = { projcfg_argv, NULL };
+    char **gen_cmds[] = { gen_argv, NULL };
+
+    if(bench_measure(&results[0], dir, projcfg_cmds, NULL) != LM_OK || bench_measure(&results[1], dir, gen_cmds, NULL) != LM_OK) {
+        return 1;
+    }
+
+    bench_report(results, 2, "config", label, out);
+    return 0;
+}
+
+
+#else
+
+int main(void)
+{
+    LM_LOG_ERROR("lm_bench is only supported on linux");
+    return 1;
+}
+
+#endif
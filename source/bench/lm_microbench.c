@@ -0,0 +1,647 @@
+/* source/bench/lm_microbench.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+/*
+ * Microbenchmarks for the parser primitives: the lm_str_* helpers on the line
+ * shapes lm.cfg and .config are made of, macro lookup by name, lm_array, and
+ * the TLSF heap against glibc malloc. Links the helper objects only, not lm.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <getopt.h>
+#include <time.h>
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_mem.h"
+#include "lm_string.h"
+#include "lm_array.h"
+#include "lm_macro.h"
+#include "heap_tlsf.h"
+
+
+#define    MICRO_MAX_SAMPLES        100
+#define    MICRO_LOOKUP_NAMES       4096
+#define    MICRO_ARRAY_LEN          1000
+#define    MICRO_TLSF_POOL          (512 * 1024 * 1024)
+#define    MICRO_PARSER_LINE        4096    // lm_parser_alloc hands out one line buffer per read
+
+
+typedef struct micro_case {
+    const char *name;
+    void (*setup)(void *arg);
+    void (*run)(long iters, void *arg);
+    void (*teardown)(void *arg);
+    void *arg;
+}micro_case_t;
+
+
+static int samples = 10;
+static double min_ms = 20;
+
+// keeps results alive so the compiler can not drop the calls
+static volatile long sink;
+
+
+/* line shapes, all shorter than the 256 bytes lm_str_pick_str copies into */
+static char *shapes[][2] = {
+    { "prompt",  "    depends = CONFIG_NET_TCP && CONFIG_NET_IPV4" },
+    { "choices", "    choices = n, y, m" },
+    { "src",     "SRC-$(CONFIG_NET_TCP)   += net/ipv4/tcp_input.c" },
+    { "include", "include-$(CONFIG_USB)   \"drivers/usb/lm.cfg\"" },
+    { "config",  "CONFIG_LOG_LEVEL=3" },
+    { "cflag",   "CFLAG += -O2 -g -Wall -Wextra -ffunction-sections -fdata-sections -DUSE_HAL_DRIVER "
+                 "-DSTM32F103xE -mcpu=cortex-m3 -mthumb -Wno-unused-parameter -fno-common" },
+};
+
+#define    MICRO_SHAPES             (int)(sizeof(shapes) / sizeof(shapes[0]))
+
+
+static double micro_now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e9 + now.tv_nsec;
+}
+
+
+/* lm_str_* */
+
+static void micro_find_char(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_find_char(arg, '=');
+    }
+}
+
+
+static void micro_is_all_space(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_is_all_space(arg);
+    }
+}
+
+
+static void micro_find_str(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_find_str(arg, "+=");
+    }
+}
+
+
+static void micro_find_str_space(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_find_str_space(arg, "depends");
+    }
+}
+
+
+static void micro_num_str_space(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_num_str_space(arg);
+    }
+}
+
+
+static void micro_num_of_substr_split(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_num_of_substr_split(arg);
+    }
+}
+
+
+static void micro_get_quote(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        char *str = lm_str_get_quote(arg);
+        if(str) {
+            lm_free(str);
+        }
+    }
+}
+
+
+static void micro_pick_str(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        char *str = lm_str_pick_str(arg, 0);
+        if(str) {
+            lm_free(str);
+        }
+    }
+}
+
+
+static void micro_delete_space(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        lm_free(lm_str_delete_space(arg));
+    }
+}
+
+
+static void micro_delete_head_tail_space(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        lm_free(lm_str_delete_head_tail_space(arg));
+    }
+}
+
+
+static void micro_head_is_four_space(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_head_is_four_space(arg);
+    }
+}
+
+
+static void micro_dupli_string(long iters, void *arg)
+{
+    char *str;
+
+    for(long i = 0; i < iters; i++) {
+        lm_str_dupli_string(&str, arg);
+        lm_free(str);
+    }
+}
+
+
+static void micro_to_int(long iters, void *arg)
+{
+    (void)arg;
+
+    for(long i = 0; i < iters; i++) {
+        sink += lm_str_to_int("1000");
+    }
+}
+
+
+typedef struct micro_str_fn {
+    const char *name;
+    void (*run)(long iters, void *arg);
+}micro_str_fn_t;
+
+
+static micro_str_fn_t str_fns[] = {
+    { "find_char",             micro_find_char },
+    { "is_all_space",          micro_is_all_space },
+    { "find_str",              micro_find_str },
+    { "find_str_space",        micro_find_str_space },
+    { "num_str_space",         micro_num_str_space },
+    { "num_of_substr_split",   micro_num_of_substr_split },
+    { "get_quote",             micro_get_quote },
+    { "pick_str",              micro_pick_str },
+    { "delete_space",          micro_delete_space },
+    { "delete_head_tail_space", micro_delete_head_tail_space },
+    { "head_is_four_space",    micro_head_is_four_space },
+    { "dupli_string",          micro_dupli_string },
+};
+
+
+/* lm_macro_search_by_name */
+
+typedef struct micro_lookup {
+    int count;
+    int hit_pct;
+    lm_macro_head_t head;
+    char *names[MICRO_LOOKUP_NAMES];
+}micro_lookup_t;
+
+
+// built once and kept, a fixed seed gives every run the same names and so the same cache behaviour
+static void micro_lookup_setup(void *arg)
+{
+    micro_lookup_t *lookup = arg;
+    char name[64];
+    unsigned int seed = 1;
+
+    if(lookup->head.count == lookup->count) {
+        return;
+    }
+
+    lm_list_init(&lookup->head.node);
+    lookup->head.count = 0;
+    lm_macro_list_cache_init(&lookup->head);
+
+    for(int i = 0; i < lookup->count; i++) {
+        snprintf(name, sizeof(name), "CONFIG_MACRO_%05d", i);
+        lm_macro_new_and_add(&lookup->head, name);
+    }
+
+    for(int i = 0; i < MICRO_LOOKUP_NAMES; i++) {
+        bool hit = (int)(rand_r(&seed) % 100) < lookup->hit_pct;
+        int index = rand_r(&seed) % lookup->count;
+
+        snprintf(name, sizeof(name), hit ? "CONFIG_MACRO_%05d" : "CONFIG_MISSING_%05d", index);
+        lookup->names[i] = strdup(name);
+    }
+}
+
+
+static void micro_lookup_run(long iters, void *arg)
+{
+    micro_lookup_t *lookup = arg;
+
+    for(long i = 0; i < iters; i++) {
+        sink += lm_macro_search_by_name(&lookup->head, lookup->names[i % MICRO_LOOKUP_NAMES]) != NULL;
+    }
+}
+
+
+/* lm_array */
+
+static lm_array_t micro_array;
+
+
+static void micro_array_setup(void *arg)
+{
+    (void)arg;
+
+    lm_list_init(&micro_array.head);
+    micro_array.count = 0;
+}
+
+
+static void micro_array_add(long iters, void *arg)
+{
+    for(long i = 0; i < iters; i++) {
+        lm_array_add(&micro_array, arg);
+    }
+}
+
+
+static void micro_array_teardown(void *arg)
+{
+    (void)arg;
+
+    lm_array_delete(&micro_array);
+    micro_array_setup(NULL);
+}
+
+
+static void micro_array_fill(void *arg)
+{
+    micro_array_setup(arg);
+    for(int i = 0; i < MICRO_ARRAY_LEN; i++) {
+        lm_array_add(&micro_array, arg);
+    }
+}
+
+
+// one op is a walk over MICRO_ARRAY_LEN entries, the way the generators read a list
+static void micro_array_iterate(long iters, void *arg)
+{
+    lm_list_node_t *node;
+    (void)arg;
+
+    for(long i = 0; i < iters; i++) {
+        lm_list_for_each(node, &micro_array.head) {
+            sink += container_of(node, lm_array_node_t, node)->string[0];
+        }
+    }
+}
+
+
+/* allocators */
+
+typedef struct micro_heap {
+    void *(*alloc)(size_t size);
+    void (*free)(void *p);
+    void **kept;
+    long kept_count;
+    long kept_size;
+}micro_heap_t;
+
+
+static tlsf_t micro_tlsf;
+static void *micro_tlsf_mem;
+
+
+static void *micro_tlsf_alloc(size_t size)
+{
+    return tlsf_malloc(micro_tlsf, size);
+}
+
+
+static void micro_tlsf_free(void *p)
+{
+    tlsf_free(micro_tlsf, p);
+}
+
+
+static void *micro_lm_alloc(size_t size)
+{
+    return lm_malloc(size);
+}
+
+
+static void micro_heap_setup(void *arg)
+{
+    micro_heap_t *heap = arg;
+
+    if(heap->alloc == micro_tlsf_alloc) {
+        micro_tlsf_mem = malloc(MICRO_TLSF_POOL);
+        micro_tlsf = tlsf_create_with_pool(micro_tlsf_mem, MICRO_TLSF_POOL);
+    }
+
+    heap->kept_count = 0;
+}
+
+
+static void micro_heap_teardown(void *arg)
+{
+    micro_heap_t *heap = arg;
+
+    for(long i = 0; i < heap->kept_count; i++) {
+        heap->free(heap->kept[i]);
+    }
+    heap->kept_count = 0;
+
+    if(heap->alloc == micro_tlsf_alloc) {
+        tlsf_destroy(micro_tlsf);
+        free(micro_tlsf_mem);
+    }
+}
+
+
+static void micro_heap_keep(micro_heap_t *heap, void *p)
+{
+    if(heap->kept_count == heap->kept_size) {
+        heap->kept_size = heap->kept_size ? heap->kept_size * 2 : 4096;
+        heap->kept = realloc(heap->kept, heap->kept_size * sizeof(void*));
+        if(heap->kept == NULL) {
+            LM_LOG_ERROR("out of memory");
+            exit(1);
+        }
+    }
+
+    heap->kept[heap->kept_count++] = p;
+}
+
+
+static void micro_heap_pair(long iters, void *arg)
+{
+    micro_heap_t *heap = arg;
+
+    for(long i = 0; i < iters; i++) {
+        void *p = heap->alloc(32);
+        sink += (long)p & 1;
+        heap->free(p);
+    }
+}
+
+
+/*
+ * One op is one parsed line: a line buffer, a temporary copy for a helper
+ * like lm_str_find_str_space, and a short string kept in a list until the
+ * end, as lm_array_add does for SRC and flag entries.
+ */
+static void micro_heap_parser(long iters, void *arg)
+{
+    micro_heap_t *heap = arg;
+
+    for(long i = 0; i < iters; i++) {
+        char *line = heap->alloc(MICRO_PARSER_LINE);
+        char *tmp = heap->alloc(48 + i % 32);
+        char *kept = heap->alloc(16 + i % 48);
+
+        line[0] = tmp[0] = kept[0] = 0;
+        micro_heap_keep(heap, kept);
+
+        heap->free(tmp);
+        heap->free(line);
+    }
+}
+
+
+static micro_heap_t heap_tlsf = { micro_tlsf_alloc, micro_tlsf_free, NULL, 0, 0 };
+static micro_heap_t heap_lm = { micro_lm_alloc, lm_free, NULL, 0, 0 };
+static micro_heap_t heap_glibc = { malloc, free, NULL, 0, 0 };
+
+
+/* harness */
+
+static int micro_cmp(const void *a, const void *b)
+{
+    double da = *(const double*)a;
+    double db = *(const double*)b;
+    return (da > db) - (da < db);
+}
+
+
+static double micro_time(micro_case_t *c, long iters)
+{
+    if(c->setup) {
+        c->setup(c->arg);
+    }
+
+    double start = micro_now_ns();
+    c->run(iters, c->arg);
+    double ns = micro_now_ns() - start;
+
+    if(c->teardown) {
+        c->teardown(c->arg);
+    }
+
+    return ns;
+}
+
+
+// grow the op count until one sample takes min_ms, then time the samples
+static void micro_run(micro_case_t *c, FILE *json, bool *first)
+{
+    double ns[MICRO_MAX_SAMPLES];
+    long iters = 1;
+
+    while(micro_time(c, iters) < min_ms * 1e6 && iters < (1L << 40)) {
+        iters *= 2;
+    }
+
+    double sum = 0;
+    for(int i = 0; i < samples; i++) {
+        ns[i] = micro_time(c, iters) / iters;
+        sum += ns[i];
+    }
+
+    double mean = sum / samples;
+    double var = 0;
+    for(int i = 0; i < samples; i++) {
+        var += (ns[i] - mean) * (ns[i] - mean);
+    }
+    double stddev = samples > 1 ? sqrt(var / (samples - 1)) : 0;
+
+    qsort(ns, samples, sizeof(double), micro_cmp);
+    double median = samples % 2 ? ns[samples / 2] : (ns[samples / 2 - 1] + ns[samples / 2]) / 2;
+
+    printf("%-44s %12.2f %12.2f %10.2f %7.1f%% %12ld\n", c->name, median, ns[0], stddev,
+           mean > 0 ? stddev * 100 / mean : 0, iters);
+    fflush(stdout);
+
+    if(json) {
+        fprintf(json, "%s    {\"name\": \"%s\", \"median_ns\": %.3f, \"min_ns\": %.3f, \"mean_ns\": %.3f, "
+                      "\"stddev_ns\": %.3f, \"ops\": %ld, \"samples\": %d}",
+                *first ? "" : ",\n", c->name, median, ns[0], mean, stddev, iters, samples);
+        *first = false;
+    }
+}
+
+
+static void micro_usage(const char *name)
+{
+    printf("usage: %s [options]\n", name);
+    printf("    --filter      only run benchmarks whose name contains this string\n");
+    printf("    --samples     timed samples per benchmark, default: %d\n", samples);
+    printf("    --min-ms      minimum length of one sample, default: %.0f\n", min_ms);
+    printf("    --json        also write the results to this file\n");
+}
+
+
+static struct option micro_long_options[] =
+{
+    {"filter",     required_argument,      NULL, 'a'},
+    {"samples",    required_argument,      NULL, 'b'},
+    {"min-ms",     required_argument,      NULL, 'c'},
+    {"json",       required_argument,      NULL, 'd'},
+    {NULL,         0,                      NULL,  0},
+};
+
+
+int main(int argc, char *argv[])
+{
+    const char *filter = NULL;
+    const char *json_path = NULL;
+    char name[128];
+    int opt;
+
+    while((opt = getopt_long(argc, argv, "", micro_long_options, NULL)) != -1) {
+        switch(opt) {
+            case 'a':
+                filter = optarg;
+                break;
+            case 'b':
+                samples = strtol(optarg, NULL, 10);
+                break;
+            case 'c':
+                min_ms = strtod(optarg, NULL);
+                break;
+            case 'd':
+                json_path = optarg;
+                break;
+            default:
+                micro_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    if(samples < 1 || samples > MICRO_MAX_SAMPLES || min_ms <= 0) {
+        micro_usage(argv[0]);
+        return 1;
+    }
+
+    FILE *json = NULL;
+    if(json_path) {
+        json = fopen(json_path, "w");
+        if(json == NULL) {
+            LM_LOG_ERROR("can not write %s", json_path);
+            return 1;
+        }
+        fprintf(json, "{\n  \"results\": [\n");
+    }
+
+    lm_mem_init(0);
+
+    static micro_lookup_t lookups[3][3];
+    static const int lookup_counts[] = { 100, 1000, 10000 };
+    static const int lookup_hits[] = { 100, 90, 0 };
+    bool first = true;
+
+    printf("%-44s %12s %12s %10s %8s %12s\n", "benchmark", "median ns/op", "min ns/op", "stddev", "", "ops/sample");
+
+    for(int f = 0; f < (int)(sizeof(str_fns) / sizeof(str_fns[0])); f++) {
+        for(int s = 0; s < MICRO_SHAPES; s++) {
+            snprintf(name, sizeof(name), "str_%s/%s", str_fns[f].name, shapes[s][0]);
+            micro_case_t c = { name, NULL, str_fns[f].run, NULL, shapes[s][1] };
+
+            if(filter == NULL || strstr(name, filter)) {
+                micro_run(&c, json, &first);
+            }
+        }
+    }
+
+    snprintf(name, sizeof(name), "str_to_int");
+    micro_case_t to_int = { name, NULL, micro_to_int, NULL, NULL };
+    if(filter == NULL || strstr(name, filter)) {
+        micro_run(&to_int, json, &first);
+    }
+
+    for(int n = 0; n < 3; n++) {
+        for(int h = 0; h < 3; h++) {
+            micro_lookup_t *lookup = &lookups[n][h];
+            lookup->count = lookup_counts[n];
+            lookup->hit_pct = lookup_hits[h];
+
+            snprintf(name, sizeof(name), "macro_search_by_name/n=%d/hit=%d%%", lookup->count, lookup->hit_pct);
+            micro_case_t c = { name, micro_lookup_setup, micro_lookup_run, NULL, lookup };
+
+            if(filter == NULL || strstr(name, filter)) {
+                micro_run(&c, json, &first);
+            }
+        }
+    }
+
+    micro_case_t others[] = {
+        { "array_add/src",                 micro_array_setup, micro_array_add, micro_array_teardown, shapes[2][1] },
+        { "array_iterate/1000",            micro_array_fill, micro_array_iterate, micro_array_teardown, shapes[2][1] },
+        { "heap_malloc_free_32/tlsf",      micro_heap_setup, micro_heap_pair, micro_heap_teardown, &heap_tlsf },
+        { "heap_malloc_free_32/lm_mem",    micro_heap_setup, micro_heap_pair, micro_heap_teardown, &heap_lm },
+        { "heap_malloc_free_32/glibc",     micro_heap_setup, micro_heap_pair, micro_heap_teardown, &heap_glibc },
+        { "heap_parser_line/tlsf",         micro_heap_setup, micro_heap_parser, micro_heap_teardown, &heap_tlsf },
+        { "heap_parser_line/lm_mem",       micro_heap_setup, micro_heap_parser, micro_heap_teardown, &heap_lm },
+        { "heap_parser_line/glibc",        micro_heap_setup, micro_heap_parser, micro_heap_teardown, &heap_glibc },
+    };
+
+    for(int i = 0; i < (int)(sizeof(others) / sizeof(others[0])); i++) {
+        if(filter == NULL || strstr(others[i].name, filter)) {
+            micro_run(&others[i], json, &first);
+        }
+    }
+
+    if(json) {
+        fprintf(json, "\n  ]\n}\n");
+        fclose(json);
+    }
+
+    lm_mem_destroy();
+    return 0;
+}
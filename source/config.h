@@ -10,7 +10,6 @@
 #define    COMPILER                           gcc
 #define    CONFIG_DEBUG                       1
 #define    CONFIG_LOG_LEVEL                   0
-#define    CONFIG_MEM_POOL_SIZE               20
 #define    CONFIG_MACRO_CACHE_SIZE            100
 
 
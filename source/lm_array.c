@@ -25,13 +25,18 @@
 #include "lm_error.h"
 #include "lm_string.h"
 #include "lm_mem.h"
+#include "lm_log.h"
+#include <stdlib.h>
 
 
 int lm_array_add(lm_array_t *array, char *str)
 {
     lm_array_node_t *node = lm_malloc(sizeof(lm_array_node_t));
     if(node == NULL) {
-        return LM_ERR;
+        // callers do not check, a dropped entry would silently shorten the list
+        LM_LOG_ERROR("out of memory");
+        lm_mem_destroy();
+        exit(1);
     }
 
     node->string = NULL;
@@ -0,0 +1,383 @@
+/* source/lm_batch.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lm_batch.h"
+#include "lm_parser.h"
+#include "lm_gen.h"
+#include "lm_mem.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+#include "lm_dep.h"
+
+
+static int lm_batch_parse(const char *lmcfg, const char *config, int mem_size)
+{
+    if(lm_mem_init(mem_size) != 0) {
+        LM_LOG_ERROR("out of memory");
+        return LM_ERR;
+    }
+
+    lm_parser_init();
+
+    int ret = lm_parser_config_file(config);
+    if(ret == LM_OK) {
+        ret = lm_parser_lm_file(NULL, lmcfg);
+    }
+
+    return ret;
+}
+
+
+int lm_batch_quick(const char *lmcfg, char **configs, int count, int mem_size)
+{
+    int ret = lm_batch_parse(lmcfg, NULL, mem_size);
+
+    if(ret != LM_OK) {
+        LM_LOG_ERROR("%s can not be parsed, no config checked", lmcfg);
+    }
+    else {
+        ret = lm_dep_load();
+    }
+
+    if(ret == LM_OK) {
+        ret = lm_dep_check_configs(configs, count);
+    }
+
+    lm_dep_free();
+    lm_mem_destroy();
+    return ret;
+}
+
+
+#if ( __linux__)
+
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define    LM_BATCH_MAX_PATH        1024
+#define    LM_BATCH_ERROR_LINES     3
+
+
+typedef struct lm_batch_job {
+    const char *config;
+    char dir[LM_BATCH_MAX_PATH];
+    pid_t pid;
+    int status;
+}lm_batch_job_t;
+
+
+static void lm_batch_name(const char *config, bool full, char *name, int size)
+{
+    const char *base = strrchr(config, '/');
+    base = base ? base + 1 : config;
+
+    int len = 0;
+    if(full) {
+        // c1/board.config becomes c1_board, leading ./ ../ and / are dropped
+        const char *p = config;
+        while(p < base && (*p == '/' || (p[0] == '.' && p[1] == '/') || (p[0] == '.' && p[1] == '.' && p[2] == '/'))) {
+            p += *p == '/' ? 1 : (p[1] == '/' ? 2 : 3);
+        }
+
+        for(; p < base && len < size - 1; p++) {
+            if(*p != '/') {
+                name[len++] = *p;
+            }
+            else if(len > 0 && name[len - 1] != '_') {
+                name[len++] = '_';
+            }
+        }
+    }
+
+    const char *dot = strrchr(base, '.');
+    int stem = (dot && dot != base) ? (int)(dot - base) : (int)strlen(base);
+    snprintf(name + len, size - len, "%.*s", stem, base);
+}
+
+
+/*
+ * Configs are named after their file, two configs with the same file name
+ * in different directories are named after their whole path instead.
+ */
+static int lm_batch_names(lm_batch_job_t *job, char **configs, int count, const char *outdir)
+{
+    char (*name)[LM_BATCH_MAX_PATH] = calloc(count, LM_BATCH_MAX_PATH);
+    bool *full = calloc(count, sizeof(bool));
+    if(name == NULL || full == NULL) {
+        LM_LOG_ERROR("out of memory");
+        free(name);
+        free(full);
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < count; i++) {
+        lm_batch_name(configs[i], false, name[i], LM_BATCH_MAX_PATH);
+    }
+
+    for(int i = 0; i < count; i++) {
+        for(int j = i + 1; j < count; j++) {
+            if(strcmp(name[i], name[j]) == 0) {
+                full[i] = full[j] = true;
+            }
+        }
+    }
+
+    for(int i = 0; i < count; i++) {
+        if(full[i]) {
+            lm_batch_name(configs[i], true, name[i], LM_BATCH_MAX_PATH);
+        }
+    }
+
+    int ret = LM_OK;
+    for(int i = 0; i < count; i++) {
+        for(int j = 0; j < i; j++) {
+            if(strcmp(name[i], name[j]) == 0) {
+                LM_LOG_ERROR("%s and %s would both write %s/%s", configs[j], configs[i], outdir, name[i]);
+                ret = LM_ERR;
+            }
+        }
+
+        job[i].config = configs[i];
+        snprintf(job[i].dir, sizeof(job[i].dir), "%s/%s", outdir, name[i]);
+    }
+
+    free(name);
+    free(full);
+    return ret;
+}
+
+
+// the log keeps the terminal colours, the summary is plain text
+static void lm_batch_strip_colour(char *line)
+{
+    char *out = line;
+
+    for(char *p = line; *p; p++) {
+        if(p[0] == '\x1b' && p[1] == '[') {
+            p += 2;
+            while(*p && (*p < '@' || *p > '~')) {
+                p++;
+            }
+            if(*p == '\0') {
+                break;
+            }
+            continue;
+        }
+        *out++ = *p;
+    }
+    *out = '\0';
+}
+
+
+/*
+ * Runs in the forked worker: the memory pool and the parser state are
+ * process globals, so every config gets a fresh copy of both this way.
+ * The lm.cfg files and wildcard listings come from the shared parse the
+ * parent did before forking, only the config dependent part is redone.
+ */
+static void lm_batch_worker(const char *lmcfg, lm_batch_job_t *job, int mem_size)
+{
+    char path[LM_BATCH_MAX_PATH + 16];
+
+    snprintf(path, sizeof(path), "%s/%s", job->dir, LM_BATCH_LOG);
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd >= 0) {
+        dup2(fd, STDOUT_FILENO);
+        dup2(fd, STDERR_FILENO);
+        close(fd);
+    }
+
+    int ret = lm_batch_parse(lmcfg, job->config, mem_size);
+
+    if(ret == LM_OK) {
+        snprintf(path, sizeof(path), "%s/.lm.mk", job->dir);
+        ret = lm_gen_lmmk_file(path);
+    }
+
+    if(ret == LM_OK) {
+        snprintf(path, sizeof(path), "%s/config.h", job->dir);
+        ret = lm_gen_header_file(path);
+    }
+
+    fflush(stdout);
+    _exit(ret == LM_OK ? 0 : 1);
+}
+
+
+static void lm_batch_report(lm_batch_job_t *job)
+{
+    char path[LM_BATCH_MAX_PATH + 16];
+    char line[1024];
+    int lines = 0;
+
+    printf("  %s\n", job->config);
+
+    snprintf(path, sizeof(path), "%s/%s", job->dir, LM_BATCH_LOG);
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return;
+    }
+
+    while(fgets(line, sizeof(line), file) && lines < LM_BATCH_ERROR_LINES) {
+        if(strstr(line, "ERROR") != NULL) {
+            lm_batch_strip_colour(line);
+            printf("      %s", line);
+            lines++;
+        }
+    }
+    fclose(file);
+
+    if(lines == 0) {
+        printf("      worker exited with status %d\n", job->status);
+    }
+}
+
+
+int lm_batch_configs(const char *lmcfg, char **configs, int count, const char *outdir, int mem_size, int jobs)
+{
+    if(jobs <= 0) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(jobs < 1) {
+        jobs = 1;
+    }
+
+    lm_batch_job_t *job = calloc(count, sizeof(lm_batch_job_t));
+    if(job == NULL) {
+        LM_LOG_ERROR("out of memory");
+        return LM_ERR;
+    }
+
+    if(lm_batch_names(job, configs, count, outdir) != LM_OK) {
+        free(job);
+        return LM_ERR;
+    }
+
+    /*
+     * The shared parse: every lm.cfg file and wildcard listing is read once
+     * here and kept, the workers forked below inherit them copy-on-write.
+     * A broken lm.cfg tree fails every config the same way, report it once.
+     */
+    lm_parser_keep_sources(true);
+    int ret = lm_batch_parse(lmcfg, NULL, mem_size);
+    lm_mem_destroy();
+    if(ret != LM_OK) {
+        LM_LOG_ERROR("%s can not be parsed, no config checked", lmcfg);
+        lm_parser_keep_sources(false);
+        free(job);
+        return LM_ERR;
+    }
+
+    lm_mkdir(outdir);
+
+    int next = 0;
+    int running = 0;
+    int failed = 0;
+
+    fflush(stdout);
+
+    while(next < count || running > 0) {
+        if(next < count && running < jobs) {
+            lm_mkdir(job[next].dir);
+
+            pid_t pid = fork();
+            if(pid == 0) {
+                lm_batch_worker(lmcfg, &job[next], mem_size);
+            }
+            else if(pid < 0) {
+                LM_LOG_ERROR("can not start a worker for %s", configs[next]);
+                job[next].status = -1;
+                failed++;
+            }
+            else {
+                job[next].pid = pid;
+                running++;
+            }
+
+            next++;
+            continue;
+        }
+
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if(pid < 0) {
+            break;
+        }
+
+        for(int i = 0; i < next; i++) {
+            if(job[i].pid == pid) {
+                job[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+                job[i].pid = 0;
+                failed += job[i].status != 0;
+                running--;
+
+                if(job[i].status == 0) {
+                    char path[LM_BATCH_MAX_PATH + 16];
+                    snprintf(path, sizeof(path), "%s/%s", job[i].dir, LM_BATCH_LOG);
+                    remove(path);
+                }
+                break;
+            }
+        }
+    }
+
+    printf("%d configs checked, %d passed, %d failed\n", count, count - failed, failed);
+
+    for(int i = 0; i < count; i++) {
+        if(job[i].status != 0) {
+            lm_batch_report(&job[i]);
+        }
+    }
+
+    lm_parser_keep_sources(false);
+    free(job);
+    return failed == 0 ? LM_OK : LM_ERR;
+}
+
+
+#else
+
+int lm_batch_configs(const char *lmcfg, char **configs, int count, const char *outdir, int mem_size, int jobs)
+{
+    (void)lmcfg;
+    (void)configs;
+    (void)count;
+    (void)outdir;
+    (void)mem_size;
+    (void)jobs;
+
+    LM_LOG_ERROR("--batch-configs is only supported on linux");
+    return LM_ERR;
+}
+
+#endif
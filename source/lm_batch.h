@@ -0,0 +1,60 @@
+/* source/lm_batch.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_BATCH_H__
+#define __LM_BATCH_H__
+
+
+#define    LM_BATCH_LOG             "lm.log"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Resolve every .config in configs against lmcfg and write
+ * <outdir>/<name>/config.h and .lm.mk, where name is the config file name
+ * without its extension, or its whole path (c1/board.config: c1_board) when
+ * another config has the same file name. lm.cfg is read once before the
+ * workers fork. Up to jobs configs (one per cpu when jobs <= 0) are resolved
+ * at the same time, then a summary of the failures is printed.
+ */
+int lm_batch_configs(const char *lmcfg, char **configs, int count, const char *outdir, int mem_size, int jobs);
+
+
+/**
+ * Only resolve which macros each config enables and validate the values,
+ * without writing outputs: lm.cfg is parsed once and the configs are
+ * evaluated together, see lm_dep_check_configs.
+ */
+int lm_batch_quick(const char *lmcfg, char **configs, int count, int mem_size);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_BATCH_H__
@@ -0,0 +1,2146 @@
+/* source/lm_build.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lm_build.h"
+#include "lm_parser.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+#include "lm_cache.h"
+#include "lm_trace.h"
+#include "lm_gen.h"
+#include "lm_unity.h"
+#include "lm_variant.h"
+
+
+#if ( __linux__)
+
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define    LM_BUILD_MAX_PATH        4096
+#define    LM_BUILD_CFLAGS_STAMP    ".lm_cflags"
+#define    LM_BUILD_ASFLAGS_STAMP   ".lm_asflags"
+#define    LM_BUILD_LDFLAGS_STAMP   ".lm_ldflags"
+#define    LM_BUILD_HEADER_STAMP    ".lm_config_h"
+#define    LM_BUILD_EXPLAIN_SHOW    3
+#define    LM_BUILD_MAKEFILE        "Makefile"
+
+
+typedef struct lm_build_args {
+    char **argv;
+    int count;
+    int size;
+}lm_build_args_t;
+
+
+typedef struct lm_build_task {
+    const char *src;
+    const char *library;
+    lm_build_args_t targets;    // TARGET blocks linking the object, none: every target
+    char *obj;
+    char *dep;
+    char *lst;
+    bool is_asm;
+    bool is_cxx;
+    int batch;                  // 1 + unity batch index, 0 when compiled alone
+    char *batch_src;            // the unity_NNNN.c of that batch
+    lm_build_args_t members;    // explain: sources of the batch this task stands for
+}lm_build_task_t;
+
+
+/* every worker owns a deque: it pops its own tail and steals from the others' head */
+struct lm_build_deque {
+    pthread_mutex_t lock;
+    int *items;
+    int head;
+    int tail;
+};
+
+
+static struct lm_build_ctx {
+    lm_build_task_t *tasks;
+    int task_count;
+
+    struct lm_build_deque *deques;
+    int worker_count;
+
+    lm_build_args_t cc_args;
+    lm_build_args_t cxx_args;
+    lm_build_args_t as_args;
+    char cache_exe[LM_BUILD_MAX_PATH];
+    bool force;
+
+    pthread_mutex_t state_lock;
+    bool failed;
+    int compiled;
+    int linked;
+
+    pthread_mutex_t js_lock;
+    int js_read;
+    int js_write;
+    bool js_fifo;
+    bool js_implicit_free;
+}ctx;
+
+
+static void lm_build_args_push(lm_build_args_t *args, const char *str)
+{
+    if(args->count + 1 >= args->size) {
+        args->size = args->size ? args->size * 2 : 32;
+        args->argv = realloc(args->argv, args->size * sizeof(char*));
+        if(args->argv == NULL) {
+            LM_LOG_ERROR("out of memory");
+            exit(1);
+        }
+    }
+
+    args->argv[args->count++] = strdup(str);
+    args->argv[args->count] = NULL;
+}
+
+
+// split a flag line like the shell does for the make recipe: blanks, quotes and '\'
+static void lm_build_args_split(lm_build_args_t *args, const char *str)
+{
+    char word[LM_BUILD_MAX_PATH];
+    int len = 0;
+    char quote = 0;
+    bool in_word = false;
+
+    for(const char *p = str; ; p++) {
+        if(*p == '\0' || (!quote && (*p == ' ' || *p == '\t'))) {
+            if(in_word) {
+                word[len] = '\0';
+                lm_build_args_push(args, word);
+                len = 0;
+                in_word = false;
+            }
+
+            if(*p == '\0') {
+                return;
+            }
+            continue;
+        }
+
+        in_word = true;
+
+        if(quote) {
+            if(*p == quote) {
+                quote = 0;
+                continue;
+            }
+        }
+        else if(*p == '\'' || *p == '\"') {
+            quote = *p;
+            continue;
+        }
+        else if(*p == '\\' && p[1] != '\0') {
+            p++;
+        }
+
+        if(len < LM_BUILD_MAX_PATH - 1) {
+            word[len++] = *p;
+        }
+    }
+}
+
+
+static void lm_build_args_add_list(lm_build_args_t *args, const char *name)
+{
+    lm_array_t *list = lm_parser_get_list(name);
+    lm_list_node_t *node;
+
+    if(list == NULL) {
+        return;
+    }
+
+    lm_list_for_each(node, &list->head) {
+        lm_array_node_t *array_node = container_of(node, lm_array_node_t, node);
+        lm_build_args_split(args, array_node->string);
+    }
+}
+
+
+static bool lm_build_args_has(lm_build_args_t *args, const char *str)
+{
+    for(int i = 0; i < args->count; i++) {
+        if(strcmp(args->argv[i], str) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void lm_build_args_free(lm_build_args_t *args)
+{
+    for(int i = 0; i < args->count; i++) {
+        free(args->argv[i]);
+    }
+
+    free(args->argv);
+    args->argv = NULL;
+    args->count = 0;
+    args->size = 0;
+}
+
+
+static int64_t lm_build_mtime(const char *path)
+{
+    struct stat st;
+
+    if(stat(path, &st) != 0) {
+        return -1;
+    }
+
+    return (int64_t)st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+
+static bool lm_build_has_suffix(const char *str, const char *suffix)
+{
+    size_t len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+
+// "dir/name.c" -> "build_dir/name<ext>", the same naming the generated Makefile uses
+static char *lm_build_output_path(const char *build_dir, const char *src, const char *ext)
+{
+    char path[LM_BUILD_MAX_PATH];
+    const char *name = strrchr(src, '/');
+    name = name ? name + 1 : src;
+
+    const char *dot = strrchr(name, '.');
+    int name_len = dot ? (int)(dot - name) : (int)strlen(name);
+
+    snprintf(path, sizeof(path), "%s/%.*s%s", build_dir, name_len, name, ext);
+    return strdup(path);
+}
+
+
+typedef bool (*lm_build_dep_fn)(const char *dep, void *user);
+
+
+/*
+ * Call visit for each prerequisite of the first rule in the gcc -MMD -MP
+ * file until it returns true. False if the file or its rule is missing.
+ */
+static bool lm_build_dep_scan(const char *dep_path, lm_build_dep_fn visit, void *user)
+{
+    FILE *file = fopen(dep_path, "rb");
+    if(file == NULL) {
+        return false;
+    }
+
+    char word[LM_BUILD_MAX_PATH];
+    int len = 0;
+    bool in_rule = false;
+    bool stop = false;
+    int ch;
+
+    while(!stop && (ch = fgetc(file)) != EOF) {
+        if(!in_rule) {
+            // skip the target, a ':' followed by a blank starts the prerequisites
+            if(ch == ':') {
+                int next = fgetc(file);
+                if(next == ' ' || next == '\t' || next == '\n' || next == '\r' || next == EOF) {
+                    in_rule = true;
+                }
+                if(next == '\n' || next == EOF) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if(ch == '\\') {
+            int next = fgetc(file);
+            if(next == '\r') {
+                next = fgetc(file);
+                if(next != '\n' && next != EOF) {
+                    ungetc(next, file);
+                }
+                ch = ' ';
+            }
+            else if(next == '\n') {
+                ch = ' ';
+            }
+            else if(next == ' ' || next == '#') {
+                ch = next;
+                if(len < LM_BUILD_MAX_PATH - 1) {
+                    word[len++] = (char)ch;
+                }
+                continue;
+            }
+            else if(next != EOF) {
+                ungetc(next, file);
+            }
+        }
+
+        if(ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+            if(len) {
+                word[len] = '\0';
+                len = 0;
+
+                stop = visit(word, user);
+            }
+
+            if(ch == '\n') {
+                break;
+            }
+            continue;
+        }
+
+        if(len < LM_BUILD_MAX_PATH - 1) {
+            word[len++] = (char)ch;
+        }
+    }
+
+    if(!stop && len) {
+        word[len] = '\0';
+        visit(word, user);
+    }
+
+    fclose(file);
+    return in_rule;
+}
+
+
+typedef struct lm_build_newer {
+    int64_t obj_time;
+    bool newer;
+}lm_build_newer_t;
+
+
+static bool lm_build_dep_newer_fn(const char *dep, void *user)
+{
+    lm_build_newer_t *state = user;
+    int64_t dep_time = lm_build_mtime(dep);
+
+    state->newer = dep_time > state->obj_time || dep_time < 0;
+    return state->newer;
+}
+
+
+/* true if a prerequisite of the first rule in the gcc -MMD -MP file is newer than obj_time */
+static bool lm_build_dep_is_newer(const char *dep_path, int64_t obj_time)
+{
+    lm_build_newer_t state = { obj_time, false };
+
+    return !lm_build_dep_scan(dep_path, lm_build_dep_newer_fn, &state) || state.newer;
+}
+
+
+static bool lm_build_need_compile(lm_build_task_t *task)
+{
+    if(ctx.force) {
+        return true;
+    }
+
+    int64_t obj_time = lm_build_mtime(task->obj);
+    if(obj_time < 0) {
+        return true;
+    }
+
+    if(lm_build_mtime(task->src) > obj_time) {
+        return true;
+    }
+
+    return lm_build_dep_is_newer(task->dep, obj_time);
+}
+
+
+static int lm_build_spawn(char **argv)
+{
+    pid_t pid;
+    int status;
+
+    int ret = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if(ret != 0) {
+        LM_LOG_ERROR("failed to run %s: %s", argv[0], strerror(ret));
+        return LM_ERR;
+    }
+
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) {
+            return LM_ERR;
+        }
+    }
+
+    if(WIFEXITED(status) && WEXITSTATUS(status) == 0) {
+        return LM_OK;
+    }
+
+    return LM_ERR;
+}
+
+
+/*
+ * GNU make jobserver: every running job beyond the implicit one must hold a
+ * token byte read from the jobserver pipe (or fifo, make >= 4.4)
+ */
+static void lm_build_jobserver_init(int *jobs, bool jobs_set)
+{
+    ctx.js_read = -1;
+    ctx.js_write = -1;
+    ctx.js_implicit_free = true;
+
+    const char *flags = getenv("MAKEFLAGS");
+    if(flags == NULL) {
+        return;
+    }
+
+    const char *auth = strstr(flags, "--jobserver-auth=");
+    if(auth == NULL) {
+        auth = strstr(flags, "--jobserver-fds=");
+    }
+
+    if(auth == NULL) {
+        // make without -j: stay serial like the rest of the make run
+        if(!jobs_set) {
+            *jobs = 1;
+        }
+        return;
+    }
+
+    auth = strchr(auth, '=') + 1;
+
+    if(strncmp(auth, "fifo:", 5) == 0) {
+        char path[LM_BUILD_MAX_PATH];
+        int len = strcspn(auth + 5, " ");
+        snprintf(path, sizeof(path), "%.*s", len, auth + 5);
+
+        ctx.js_read = open(path, O_RDWR);
+        ctx.js_write = ctx.js_read;
+        ctx.js_fifo = ctx.js_read >= 0;
+    }
+    else if(sscanf(auth, "%d,%d", &ctx.js_read, &ctx.js_write) != 2) {
+        ctx.js_read = -1;
+    }
+
+    if(ctx.js_read < 0 || fcntl(ctx.js_read, F_GETFD) < 0 || fcntl(ctx.js_write, F_GETFD) < 0) {
+        LM_LOG_WARN("jobserver unavailable, mark the recipe with '+', running serially");
+        ctx.js_read = -1;
+        ctx.js_write = -1;
+        *jobs = 1;
+    }
+}
+
+
+// return 1 when a token byte was taken from make, 0 for the implicit slot, -1 on error
+static int lm_build_token_acquire(char *token)
+{
+    if(ctx.js_read < 0) {
+        return 0;
+    }
+
+    pthread_mutex_lock(&ctx.js_lock);
+    if(ctx.js_implicit_free) {
+        ctx.js_implicit_free = false;
+        pthread_mutex_unlock(&ctx.js_lock);
+        return 0;
+    }
+    pthread_mutex_unlock(&ctx.js_lock);
+
+    while(1) {
+        ssize_t ret = read(ctx.js_read, token, 1);
+        if(ret == 1) {
+            return 1;
+        }
+
+        if(ret < 0 && errno == EAGAIN) {
+            struct pollfd pfd = { .fd = ctx.js_read, .events = POLLIN };
+            poll(&pfd, 1, -1);
+        }
+        else if(ret == 0 || errno != EINTR) {
+            return -1;
+        }
+    }
+}
+
+
+static void lm_build_token_release(int kind, char token)
+{
+    if(kind == 1) {
+        while(write(ctx.js_write, &token, 1) < 0 && errno == EINTR) {
+        }
+    }
+    else if(kind == 0 && ctx.js_read >= 0) {
+        pthread_mutex_lock(&ctx.js_lock);
+        ctx.js_implicit_free = true;
+        pthread_mutex_unlock(&ctx.js_lock);
+    }
+}
+
+
+static int lm_build_compile(lm_build_task_t *task)
+{
+    LM_TRACE_SCOPE("lm_build_compile", task->src);
+    lm_build_args_t *base = task->is_asm ? &ctx.as_args : task->is_cxx ? &ctx.cxx_args : &ctx.cc_args;
+    char lst_flag[LM_BUILD_MAX_PATH];
+    char token = '+';
+    int i = 0;
+
+    char **argv = malloc((base->count + 14) * sizeof(char*));
+    if(argv == NULL) {
+        return LM_ERR;
+    }
+
+    if(ctx.cache_exe[0]) {
+        argv[i++] = ctx.cache_exe;
+        argv[i++] = "--cache-exec";
+    }
+
+    for(int j = 0; j < base->count; j++) {
+        argv[i++] = base->argv[j];
+    }
+
+    argv[i++] = "-MMD";
+    argv[i++] = "-MP";
+    argv[i++] = "-MF";
+    argv[i++] = task->dep;
+
+    if(task->lst) {
+        snprintf(lst_flag, sizeof(lst_flag), "-Wa,-a,-ad,-alms=%s", task->lst);
+        argv[i++] = lst_flag;
+    }
+
+    argv[i++] = (char*)task->src;
+    argv[i++] = "-o";
+    argv[i++] = task->obj;
+    argv[i] = NULL;
+
+    int kind = lm_build_token_acquire(&token);
+    if(kind < 0) {
+        free(argv);
+        LM_LOG_ERROR("lost the make jobserver");
+        return LM_ERR;
+    }
+
+    printf("%s   %s\n", task->is_asm ? "AS" : "CC", task->src);
+    fflush(stdout);
+
+    int ret = lm_build_spawn(argv);
+
+    lm_build_token_release(kind, token);
+    free(argv);
+    return ret;
+}
+
+
+static bool lm_build_next_task(int self, int *index)
+{
+    struct lm_build_deque *own = &ctx.deques[self];
+    bool found = false;
+
+    pthread_mutex_lock(&own->lock);
+    if(own->tail > own->head) {
+        *index = own->items[--own->tail];
+        found = true;
+    }
+    pthread_mutex_unlock(&own->lock);
+
+    for(int i = 1; !found && i < ctx.worker_count; i++) {
+        struct lm_build_deque *victim = &ctx.deques[(self + i) % ctx.worker_count];
+
+        pthread_mutex_lock(&victim->lock);
+        if(victim->tail > victim->head) {
+            *index = victim->items[victim->head++];
+            found = true;
+        }
+        pthread_mutex_unlock(&victim->lock);
+    }
+
+    return found;
+}
+
+
+static void *lm_build_worker(void *arg)
+{
+    int self = (int)(intptr_t)arg;
+    int index;
+
+    while(lm_build_next_task(self, &index)) {
+        pthread_mutex_lock(&ctx.state_lock);
+        bool failed = ctx.failed;
+        pthread_mutex_unlock(&ctx.state_lock);
+
+        if(failed) {
+            break;
+        }
+
+        lm_build_task_t *task = &ctx.tasks[index];
+        if(!lm_build_need_compile(task)) {
+            continue;
+        }
+
+        int ret = lm_build_compile(task);
+
+        pthread_mutex_lock(&ctx.state_lock);
+        if(ret == LM_OK) {
+            ctx.compiled ++;
+        }
+        else {
+            ctx.failed = true;
+        }
+        pthread_mutex_unlock(&ctx.state_lock);
+    }
+
+    return NULL;
+}
+
+
+/*
+ * LIBRARY_MEMBER entries are <library>:<source>, TARGET_MEMBER entries are
+ * <target>:<key>:<value>. Returns the owner's entry in the names list, so
+ * tasks can compare owners by pointer.
+ */
+static const char *lm_build_owner(const char *members_name, const char *names_name, const char *key, const char *src)
+{
+    lm_array_t *members = lm_parser_get_list(members_name);
+    lm_array_t *names = lm_parser_get_list(names_name);
+    char value[LM_BUILD_MAX_PATH];
+    lm_list_node_t *node;
+    lm_list_node_t *name_node;
+
+    if(key) {
+        snprintf(value, sizeof(value), "%s:%s", key, src);
+    }
+    else {
+        snprintf(value, sizeof(value), "%s", src);
+    }
+
+    lm_list_for_each(name_node, &names->head) {
+        const char *name = container_of(name_node, lm_array_node_t, node)->string;
+        size_t len = strlen(name);
+
+        lm_list_for_each(node, &members->head) {
+            const char *member = container_of(node, lm_array_node_t, node)->string;
+
+            if(strncmp(member, name, len) == 0 && member[len] == ':' && strcmp(member + len + 1, value) == 0) {
+                return name;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+
+// every TARGET block listing src, a source may be shared by several of them
+static void lm_build_task_targets(lm_build_task_t *task, const char *key)
+{
+    lm_array_t *members = lm_parser_get_list(VAR_TARGET_MEMBER);
+    char value[LM_BUILD_MAX_PATH];
+    char target[LM_BUILD_MAX_PATH];
+    lm_list_node_t *node;
+
+    snprintf(value, sizeof(value), "%s:%s", key, task->src);
+
+    lm_list_for_each(node, &members->head) {
+        const char *member = container_of(node, lm_array_node_t, node)->string;
+        const char *colon = strchr(member, ':');
+
+        if(colon == NULL || strcmp(colon + 1, value) != 0) {
+            continue;
+        }
+
+        snprintf(target, sizeof(target), "%.*s", (int)(colon - member), member);
+        if(!lm_build_args_has(&task->targets, target)) {
+            lm_build_args_push(&task->targets, target);
+        }
+    }
+}
+
+
+// target NULL is the single project target, which links everything
+static bool lm_build_task_links(lm_build_task_t *task, const char *target)
+{
+    return target == NULL || task->targets.count == 0 || lm_build_args_has(&task->targets, target);
+}
+
+
+static void lm_build_add_tasks(const char *build_dir, const char *name, bool is_asm)
+{
+    lm_array_t *list = lm_parser_get_list(name);
+    lm_list_node_t *node;
+
+    lm_list_for_each(node, &list->head) {
+        lm_array_node_t *array_node = container_of(node, lm_array_node_t, node);
+        lm_build_task_t *task = &ctx.tasks[ctx.task_count++];
+
+        task->src = array_node->string;
+        task->library = lm_build_owner(VAR_LIBRARY_MEMBER, VAR_LIBRARY, NULL, task->src);
+        lm_build_task_targets(task, is_asm ? "ASM" : "SRC");
+        task->obj = lm_build_output_path(build_dir, task->src, ".o");
+        task->dep = lm_build_output_path(build_dir, task->src, ".d");
+        task->lst = is_asm ? NULL : lm_build_output_path(build_dir, task->src, ".lst");
+        task->is_asm = is_asm;
+        task->is_cxx = !is_asm && lm_build_has_suffix(task->src, ".cpp");
+    }
+}
+
+
+static int lm_build_task_obj_cmp(const void *a, const void *b)
+{
+    lm_build_task_t *ta = *(lm_build_task_t * const *)a;
+    lm_build_task_t *tb = *(lm_build_task_t * const *)b;
+    int ret = strcmp(ta->obj, tb->obj);
+
+    return ret ? ret : (ta < tb ? -1 : ta > tb);
+}
+
+
+static void lm_build_task_free(lm_build_task_t *task)
+{
+    free(task->obj);
+    free(task->dep);
+    free(task->lst);
+    free(task->batch_src);
+    lm_build_args_free(&task->targets);
+    lm_build_args_free(&task->members);
+}
+
+
+/*
+ * A source listed in several TARGET blocks is in C_SOURCE once per block.
+ * Like make, compile its object once: the first task keeps it and takes
+ * the owning targets of the others.
+ */
+static void lm_build_merge_tasks(void)
+{
+    lm_build_task_t **sorted = malloc((ctx.task_count + 1) * sizeof(lm_build_task_t*));
+    bool *drop = calloc(ctx.task_count + 1, sizeof(bool));
+    int count = 0;
+
+    if(sorted == NULL || drop == NULL) {
+        free(sorted);
+        free(drop);
+        return;
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        sorted[i] = &ctx.tasks[i];
+    }
+    qsort(sorted, ctx.task_count, sizeof(lm_build_task_t*), lm_build_task_obj_cmp);
+
+    for(int i = 1, keep = 0; i < ctx.task_count; i++) {
+        if(strcmp(sorted[i]->obj, sorted[keep]->obj) != 0) {
+            keep = i;
+            continue;
+        }
+
+        lm_build_task_t *task = sorted[keep];
+        lm_build_task_t *dup = sorted[i];
+
+        for(int j = 0; j < dup->targets.count; j++) {
+            if(!lm_build_args_has(&task->targets, dup->targets.argv[j])) {
+                lm_build_args_push(&task->targets, dup->targets.argv[j]);
+            }
+        }
+        if(task->library == NULL) {
+            task->library = dup->library;
+        }
+
+        drop[dup - ctx.tasks] = true;
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        if(drop[i]) {
+            lm_build_task_free(&ctx.tasks[i]);
+        }
+        else {
+            ctx.tasks[count++] = ctx.tasks[i];
+        }
+    }
+
+    memset(&ctx.tasks[count], 0, (ctx.task_count - count) * sizeof(lm_build_task_t));
+    ctx.task_count = count;
+
+    free(sorted);
+    free(drop);
+}
+
+
+static int lm_build_task_src_cmp(const void *a, const void *b)
+{
+    return strcmp((*(lm_build_task_t * const *)a)->src, (*(lm_build_task_t * const *)b)->src);
+}
+
+
+/*
+ * Sources in a unity batch are compiled through <dir>/unity/unity_NNNN.c:
+ * give them the batch object and number the batches as in unity.lst.
+ * Returns the number of batches.
+ */
+static int lm_build_unity(const char *dir)
+{
+    char path[LM_BUILD_MAX_PATH];
+    char line[LM_BUILD_MAX_PATH + 64];
+    char batch[64];
+    char last[64] = {0};
+    int isolated;
+    int offset;
+    int batches = 0;
+
+    snprintf(path, sizeof(path), "%s/%s/%s", dir, LM_UNITY_DIR, LM_UNITY_LIST);
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return 0;
+    }
+
+    lm_build_task_t **sorted = malloc(ctx.task_count * sizeof(lm_build_task_t*));
+    if(sorted == NULL) {
+        fclose(file);
+        return 0;
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        sorted[i] = &ctx.tasks[i];
+    }
+    qsort(sorted, ctx.task_count, sizeof(lm_build_task_t*), lm_build_task_src_cmp);
+
+    while(fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if(sscanf(line, "%63s %d %n", batch, &isolated, &offset) != 2 || line[offset] == '\0' || isolated) {
+            continue;
+        }
+
+        lm_build_task_t key = { .src = line + offset };
+        lm_build_task_t *pkey = &key;
+        lm_build_task_t **found = bsearch(&pkey, sorted, ctx.task_count, sizeof(lm_build_task_t*), lm_build_task_src_cmp);
+        if(found == NULL) {
+            continue;
+        }
+
+        // members of one batch are adjacent in unity.lst
+        if(strcmp(batch, last) != 0) {
+            snprintf(last, sizeof(last), "%s", batch);
+            batches++;
+        }
+
+        lm_build_task_t *task = *found;
+        snprintf(path, sizeof(path), "%s/%s/%s", dir, LM_UNITY_DIR, batch);
+        free(task->obj);
+        free(task->dep);
+        task->obj = lm_build_output_path(dir, path, ".o");
+        task->dep = lm_build_output_path(dir, path, ".d");
+        task->batch_src = strdup(path);
+        task->batch = batches;
+    }
+
+    free(sorted);
+    fclose(file);
+    return batches;
+}
+
+
+/*
+ * lm build compiles a batch as one task: its first member becomes the
+ * unity_NNNN.c task, the others are dropped. The .d of the batch lists every
+ * member, so an edited member still rebuilds it.
+ */
+static void lm_build_unity_tasks(const char *dir, int batches)
+{
+    bool *seen = calloc(batches + 1, sizeof(bool));
+    int count = 0;
+
+    if(seen == NULL) {
+        return;
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        lm_build_task_t *task = &ctx.tasks[i];
+
+        if(task->batch && seen[task->batch]) {
+            lm_build_task_free(task);
+            continue;
+        }
+
+        if(task->batch) {
+            seen[task->batch] = true;
+            task->src = task->batch_src;
+            task->is_cxx = lm_build_has_suffix(task->src, ".cpp");
+            free(task->lst);
+            task->lst = lm_build_output_path(dir, task->src, ".lst");
+        }
+
+        ctx.tasks[count++] = *task;
+    }
+
+    memset(&ctx.tasks[count], 0, (ctx.task_count - count) * sizeof(lm_build_task_t));
+    ctx.task_count = count;
+    free(seen);
+}
+
+
+static bool lm_build_list_has_suffix(const char *name, const char *suffix)
+{
+    lm_array_t *list = lm_parser_get_list(name);
+    lm_list_node_t *node;
+
+    lm_list_for_each(node, &list->head) {
+        if(lm_build_has_suffix(container_of(node, lm_array_node_t, node)->string, suffix)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// the stub only names the header, rewrite it when the header moved
+static int lm_build_pch_stub(const char *stub, const char *header)
+{
+    char want[LM_BUILD_MAX_PATH + 16];
+    char have[LM_BUILD_MAX_PATH + 16] = {0};
+
+    snprintf(want, sizeof(want), "#include \"%s\"\n", header);
+
+    FILE *file = fopen(stub, "r");
+    if(file) {
+        size_t len = fread(have, 1, sizeof(have) - 1, file);
+        have[len] = '\0';
+        fclose(file);
+
+        if(strcmp(want, have) == 0) {
+            return LM_OK;
+        }
+    }
+
+    file = fopen(stub, "w");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    fputs(want, file);
+    return fclose(file) == 0 ? LM_OK : LM_ERR;
+}
+
+
+/*
+ * compile <build>/pch/<lang>/<stub>.gch from a stub including the header, with
+ * the same flags as the objects, then force-include the stub: gcc picks up the
+ * .gch beside it, or falls back to the header text (-Winvalid-pch says why)
+ */
+// "a/common.h" -> "a_common.h", the PCH_STUB name of the generated Makefile
+static void lm_build_pch_name(const char *dir, const char *src, char *stub, int size)
+{
+    int len = snprintf(stub, size, "%s/", dir);
+
+    for(const char *p = src; *p && len < size - 1; p++) {
+        stub[len++] = *p == '/' ? '_' : *p;
+    }
+    stub[len < size ? len : size - 1] = '\0';
+}
+
+
+static int lm_build_pch(const char *build_dir, const char *lang, const char *x_lang, lm_build_args_t *args)
+{
+    lm_array_t *list = lm_parser_get_list(VAR_PCH_SOURCE);
+    char dir[LM_BUILD_MAX_PATH];
+    char stub[LM_BUILD_MAX_PATH];
+    char gch[LM_BUILD_MAX_PATH];
+    char dep[LM_BUILD_MAX_PATH];
+    char header[LM_BUILD_MAX_PATH];
+    lm_list_node_t *node;
+    int base_count = args->count;
+
+    if(list->count == 0) {
+        return LM_OK;
+    }
+
+    snprintf(dir, sizeof(dir), "%s/pch", build_dir);
+    lm_mkdir(dir);
+    snprintf(dir, sizeof(dir), "%s/pch/%s", build_dir, lang);
+    lm_mkdir(dir);
+
+    lm_list_for_each(node, &list->head) {
+        const char *src = container_of(node, lm_array_node_t, node)->string;
+
+        lm_build_pch_name(dir, src, stub, sizeof(stub));
+        snprintf(gch, sizeof(gch), "%s.gch", stub);
+        snprintf(dep, sizeof(dep), "%s.d", gch);
+
+        if(realpath(src, header) == NULL || lm_build_pch_stub(stub, header) != LM_OK) {
+            LM_LOG_ERROR("can not prepare precompiled header %s", src);
+            return LM_ERR;
+        }
+
+        int64_t gch_time = lm_build_mtime(gch);
+        if(!ctx.force && gch_time >= 0 && lm_build_mtime(stub) <= gch_time && !lm_build_dep_is_newer(dep, gch_time)) {
+            continue;
+        }
+
+        lm_build_args_t pch = {0};
+        lm_build_args_push(&pch, args->argv[0]);
+        lm_build_args_push(&pch, "-x");
+        lm_build_args_push(&pch, x_lang);
+        for(int i = 1; i < base_count; i++) {
+            lm_build_args_push(&pch, args->argv[i]);
+        }
+        lm_build_args_push(&pch, "-MMD");
+        lm_build_args_push(&pch, "-MP");
+        lm_build_args_push(&pch, "-MF");
+        lm_build_args_push(&pch, dep);
+        lm_build_args_push(&pch, stub);
+        lm_build_args_push(&pch, "-o");
+        lm_build_args_push(&pch, gch);
+
+        printf("PCH  %s\n", src);
+        fflush(stdout);
+
+        int ret = lm_build_spawn(pch.argv);
+        lm_build_args_free(&pch);
+        if(ret != LM_OK) {
+            return LM_ERR;
+        }
+    }
+
+    lm_list_for_each(node, &list->head) {
+        const char *src = container_of(node, lm_array_node_t, node)->string;
+
+        lm_build_pch_name(dir, src, stub, sizeof(stub));
+        lm_build_args_push(args, "-include");
+        lm_build_args_push(args, stub);
+    }
+    lm_build_args_push(args, "-Winvalid-pch");
+
+    return LM_OK;
+}
+
+
+static int lm_build_compile_all(int jobs)
+{
+    if(ctx.task_count == 0) {
+        return LM_OK;
+    }
+
+    ctx.worker_count = jobs < ctx.task_count ? jobs : ctx.task_count;
+    ctx.deques = calloc(ctx.worker_count, sizeof(struct lm_build_deque));
+    pthread_t *threads = calloc(ctx.worker_count, sizeof(pthread_t));
+
+    for(int i = 0; i < ctx.worker_count; i++) {
+        pthread_mutex_init(&ctx.deques[i].lock, NULL);
+        ctx.deques[i].items = malloc(ctx.task_count * sizeof(int));
+    }
+
+    // deal the tasks round-robin, each worker starts on its own share
+    for(int i = 0; i < ctx.task_count; i++) {
+        struct lm_build_deque *deque = &ctx.deques[i % ctx.worker_count];
+        deque->items[deque->tail++] = ctx.task_count - 1 - i;
+    }
+
+    // workers that can not start leave their share to be stolen by the others
+    int started = 1;
+    while(started < ctx.worker_count &&
+          pthread_create(&threads[started], NULL, lm_build_worker, (void*)(intptr_t)started) == 0) {
+        started++;
+    }
+
+    if(started < ctx.worker_count) {
+        LM_LOG_WARN("only %d of %d build workers started", started, ctx.worker_count);
+    }
+
+    lm_build_worker((void*)(intptr_t)0);
+
+    for(int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for(int i = 0; i < ctx.worker_count; i++) {
+        pthread_mutex_destroy(&ctx.deques[i].lock);
+        free(ctx.deques[i].items);
+    }
+
+    free(ctx.deques);
+    free(threads);
+
+    return ctx.failed ? LM_ERR : LM_OK;
+}
+
+
+// write the new stamp beside the old one, true if they differ
+static bool lm_build_stamp_check(const char *build_dir, const char *name, lm_build_args_t *args)
+{
+    char path[LM_BUILD_MAX_PATH];
+    char new_path[LM_BUILD_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s", build_dir, name);
+    snprintf(new_path, sizeof(new_path), "%s/%s.new", build_dir, name);
+
+    FILE *file = fopen(new_path, "w");
+    if(file == NULL) {
+        return true;
+    }
+
+    for(int i = 0; i < args->count; i++) {
+        fprintf(file, "%s\n", args->argv[i]);
+    }
+    fclose(file);
+
+    if(lm_file_is_same(path, new_path)) {
+        remove(new_path);
+        return false;
+    }
+
+    return true;
+}
+
+
+// the header the objects were last compiled against, lm explain names the macros that changed since
+static void lm_build_header_commit(const char *build_dir, const char *header_file)
+{
+    char path[LM_BUILD_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s", build_dir, LM_BUILD_HEADER_STAMP);
+    if(!lm_file_is_same(header_file, path)) {
+        lm_clone_file(header_file, path, false);
+    }
+}
+
+
+static void lm_build_stamp_commit(const char *build_dir, const char *name)
+{
+    char path[LM_BUILD_MAX_PATH];
+    char new_path[LM_BUILD_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s", build_dir, name);
+    snprintf(new_path, sizeof(new_path), "%s/%s.new", build_dir, name);
+
+    if(access(new_path, F_OK) == 0) {
+        rename(new_path, path);
+    }
+}
+
+
+static int lm_build_run_tool(const char *tool, const char *flag1, const char *flag2, const char *in, const char *out)
+{
+    lm_build_args_t args = {0};
+
+    lm_build_args_split(&args, tool);
+    lm_build_args_push(&args, flag1);
+    lm_build_args_push(&args, flag2);
+    lm_build_args_push(&args, in);
+    lm_build_args_push(&args, out);
+
+    int ret = lm_build_spawn(args.argv);
+    lm_build_args_free(&args);
+    return ret;
+}
+
+
+/*
+ * Thin archive of the objects of one LIBRARY block. It only references the
+ * objects, and is rewritten only when one of them is newer than the archive.
+ */
+static int lm_build_archive(const char *build_dir, const char *gcc_prefix, const char *library, char *archive, bool *updated)
+{
+    char tool[LM_BUILD_MAX_PATH];
+    lm_build_args_t args = {0};
+
+    snprintf(tool, sizeof(tool), "%s/lib", build_dir);
+    if(lm_build_mtime(tool) < 0) {
+        lm_mkdir(tool);
+    }
+
+    snprintf(archive, LM_BUILD_MAX_PATH, "%s/lib/lib%s.a", build_dir, library);
+
+    int64_t archive_time = lm_build_mtime(archive);
+    bool stale = archive_time < 0;
+
+    for(int i = 0; !stale && i < ctx.task_count; i++) {
+        stale = ctx.tasks[i].library == library && lm_build_mtime(ctx.tasks[i].obj) > archive_time;
+    }
+
+    if(!stale) {
+        return LM_OK;
+    }
+
+    snprintf(tool, sizeof(tool), "%sar", gcc_prefix);
+    lm_build_args_push(&args, tool);
+    lm_build_args_push(&args, "rcsT");
+    lm_build_args_push(&args, archive);
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        if(ctx.tasks[i].library == library) {
+            lm_build_args_push(&args, ctx.tasks[i].obj);
+        }
+    }
+
+    printf("AR   %s\n", archive);
+    fflush(stdout);
+
+    // ar would keep members of sources that left the library
+    remove(archive);
+    int ret = lm_build_spawn(args.argv);
+    if(ret != LM_OK) {
+        remove(archive);
+    }
+
+    *updated = true;
+    lm_build_args_free(&args);
+    return ret;
+}
+
+
+// push the <value> of every TARGET_MEMBER entry <target>:<key>:<value>
+static int lm_build_target_args(lm_build_args_t *args, const char *target, const char *key, const char *prefix)
+{
+    lm_array_t *members = lm_parser_get_list(VAR_TARGET_MEMBER);
+    char head[LM_BUILD_MAX_PATH];
+    lm_list_node_t *node;
+    int count = 0;
+
+    int len = snprintf(head, sizeof(head), "%s:%s:", target, key);
+
+    lm_list_for_each(node, &members->head) {
+        const char *member = container_of(node, lm_array_node_t, node)->string;
+
+        if(strncmp(member, head, len) == 0) {
+            if(prefix) {
+                lm_build_args_push(args, prefix);
+            }
+            lm_build_args_split(args, member + len);
+            count++;
+        }
+    }
+
+    return count;
+}
+
+
+/*
+ * Link one executable: the objects outside any TARGET block plus those of
+ * target, or every object for the single project target (target NULL).
+ */
+static int lm_build_link(const char *name, const char *target, const char *build_dir, const char *gcc_prefix,
+                         lm_build_args_t *archives, bool force, lm_build_args_t *outputs)
+{
+    char out_path[LM_BUILD_MAX_PATH];
+    char tool[LM_BUILD_MAX_PATH];
+    char map_flag[LM_BUILD_MAX_PATH];
+    lm_build_args_t lds_args = {0};
+    lm_build_args_t args = {0};
+    int ret = LM_OK;
+
+    if(target == NULL || lm_build_target_args(&lds_args, target, "LDS", "-T") == 0) {
+        lm_array_t *lds = lm_parser_get_list(VAR_LDS_SOURCE);
+        lm_list_node_t *node;
+
+        lm_list_for_each(node, &lds->head) {
+            lm_array_node_t *array_node = container_of(node, lm_array_node_t, node);
+            lm_build_args_push(&lds_args, "-T");
+            lm_build_args_push(&lds_args, array_node->string);
+        }
+    }
+
+    bool is_elf = lds_args.count > 0;
+    snprintf(out_path, sizeof(out_path), "%s/%s%s", build_dir, name, is_elf ? ".elf" : ".exe");
+
+    int64_t target_time = lm_build_mtime(out_path);
+    bool need_link = force || target_time < 0;
+
+    for(int i = 0; !need_link && i < archives->count; i++) {
+        need_link = lm_build_mtime(archives->argv[i]) > target_time;
+    }
+
+    for(int i = 0; !need_link && i < ctx.task_count; i++) {
+        if(lm_build_task_links(&ctx.tasks[i], target)) {
+            need_link = lm_build_mtime(ctx.tasks[i].obj) > target_time;
+        }
+    }
+
+    if(!need_link) {
+        printf("Nothing to be done for '%s'\n", out_path);
+        lm_build_args_free(&lds_args);
+        return LM_OK;
+    }
+
+    snprintf(tool, sizeof(tool), "%sgcc", gcc_prefix);
+    lm_build_args_push(&args, tool);
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        lm_build_task_t *task = &ctx.tasks[i];
+        if(task->library == NULL && lm_build_task_links(task, target)) {
+            lm_build_args_push(&args, task->obj);
+        }
+    }
+
+    // a group lets archives reference each other in any order
+    if(archives->count > 0) {
+        lm_build_args_push(&args, "-Wl,--start-group");
+        for(int i = 0; i < archives->count; i++) {
+            lm_build_args_push(&args, archives->argv[i]);
+        }
+        lm_build_args_push(&args, "-Wl,--end-group");
+    }
+
+    lm_build_args_add_list(&args, VAR_MC_FLAG);
+    lm_build_args_add_list(&args, VAR_LD_FLAG);
+    if(target) {
+        lm_build_target_args(&args, target, "LDFLAG", NULL);
+    }
+    lm_build_args_add_list(&args, VAR_LIB_PATH);
+    lm_build_args_add_list(&args, VAR_LIB_NAME);
+
+    for(int i = 0; i < lds_args.count; i++) {
+        lm_build_args_push(&args, lds_args.argv[i]);
+    }
+
+    snprintf(map_flag, sizeof(map_flag), "-Wl,-Map=%s/%s.map", build_dir, name);
+    lm_build_args_push(&args, map_flag);
+    lm_build_args_push(&args, "-o");
+    lm_build_args_push(&args, out_path);
+
+    printf("LD   %s\n", out_path);
+    fflush(stdout);
+    ctx.linked++;
+
+    if(lm_build_spawn(args.argv) != LM_OK) {
+        remove(out_path);
+        ret = LM_ERR;
+        goto exit;
+    }
+
+    if(is_elf) {
+        char out[LM_BUILD_MAX_PATH];
+
+        snprintf(tool, sizeof(tool), "%sobjcopy", gcc_prefix);
+
+        snprintf(out, sizeof(out), "%s/%s.hex", build_dir, name);
+        printf("HEX   %s\n", out);
+        ret = lm_build_run_tool(tool, "-O", "ihex", out_path, out);
+
+        snprintf(out, sizeof(out), "%s/%s.bin", build_dir, name);
+        printf("BIN   %s\n", out);
+        if(ret == LM_OK) {
+            ret = lm_build_run_tool(tool, "-O", "binary", out_path, out);
+        }
+    }
+
+    lm_build_args_push(outputs, out_path);
+
+exit:
+    lm_build_args_free(&lds_args);
+    lm_build_args_free(&args);
+    return ret;
+}
+
+
+static int lm_build_link_all(const char *pro_name, const char *build_dir, const char *gcc_prefix, bool force)
+{
+    lm_array_t *libs = lm_parser_get_list(VAR_LIBRARY);
+    lm_array_t *targets = lm_parser_get_list(VAR_TARGETS);
+    lm_build_args_t archives = {0};
+    lm_build_args_t outputs = {0};
+    lm_list_node_t *node;
+    int ret = LM_OK;
+
+    force = force || ctx.compiled > 0;
+
+    lm_list_for_each(node, &libs->head) {
+        char archive[LM_BUILD_MAX_PATH];
+
+        ret = lm_build_archive(build_dir, gcc_prefix, container_of(node, lm_array_node_t, node)->string, archive, &force);
+        if(ret != LM_OK) {
+            goto exit;
+        }
+        lm_build_args_push(&archives, archive);
+    }
+
+    if(targets->count == 0) {
+        ret = lm_build_link(pro_name, NULL, build_dir, gcc_prefix, &archives, force, &outputs);
+    }
+
+    lm_list_for_each(node, &targets->head) {
+        const char *target = container_of(node, lm_array_node_t, node)->string;
+
+        ret = lm_build_link(target, target, build_dir, gcc_prefix, &archives, force, &outputs);
+        if(ret != LM_OK) {
+            goto exit;
+        }
+    }
+
+    // the summary comes last, as in the Makefile
+    if(ret == LM_OK && ctx.linked > 0) {
+        printf("\nBuild Successful!\n");
+        for(int i = 0; i < outputs.count; i++) {
+            printf("ELF   %s\n", outputs.argv[i]);
+        }
+    }
+
+exit:
+    lm_build_args_free(&archives);
+    lm_build_args_free(&outputs);
+    return ret;
+}
+
+
+static void lm_build_args_init(const char *gcc_prefix)
+{
+    char tool[LM_BUILD_MAX_PATH];
+
+    snprintf(tool, sizeof(tool), "%sgcc", gcc_prefix);
+
+    lm_build_args_push(&ctx.cc_args, tool);
+    lm_build_args_push(&ctx.cc_args, "-c");
+    lm_build_args_add_list(&ctx.cc_args, VAR_MC_FLAG);
+    lm_build_args_add_list(&ctx.cc_args, VAR_C_PATH);
+    lm_build_args_add_list(&ctx.cc_args, VAR_C_DEFINE);
+    lm_build_args_add_list(&ctx.cc_args, VAR_C_FLAG);
+    lm_build_args_add_list(&ctx.cc_args, VAR_CPP_FLAG);
+
+    lm_build_args_push(&ctx.as_args, tool);
+    lm_build_args_push(&ctx.as_args, "-x");
+    lm_build_args_push(&ctx.as_args, "assembler-with-cpp");
+    lm_build_args_push(&ctx.as_args, "-c");
+    lm_build_args_add_list(&ctx.as_args, VAR_MC_FLAG);
+    lm_build_args_add_list(&ctx.as_args, VAR_C_PATH);
+    lm_build_args_add_list(&ctx.as_args, VAR_C_DEFINE);
+    lm_build_args_add_list(&ctx.as_args, VAR_AS_FLAG);
+
+    for(int i = 0; i < ctx.cc_args.count; i++) {
+        lm_build_args_push(&ctx.cxx_args, ctx.cc_args.argv[i]);
+    }
+}
+
+
+// everything the link stamp covers
+static void lm_build_ld_args(lm_build_args_t *args)
+{
+    lm_build_args_add_list(args, VAR_MC_FLAG);
+    lm_build_args_add_list(args, VAR_LD_FLAG);
+    lm_build_args_add_list(args, VAR_LIB_PATH);
+    lm_build_args_add_list(args, VAR_LIB_NAME);
+    lm_build_args_add_list(args, VAR_LDS_SOURCE);
+    lm_build_args_add_list(args, VAR_TARGET_MEMBER);
+}
+
+
+int lm_build_run(const char *pro_name, const char *build_dir, const char *gcc_prefix, const char *header_file, int jobs)
+{
+    bool jobs_set = jobs > 0;
+    int ret = LM_OK;
+
+    memset(&ctx, 0, sizeof(ctx));
+    pthread_mutex_init(&ctx.state_lock, NULL);
+    pthread_mutex_init(&ctx.js_lock, NULL);
+
+    if(!jobs_set) {
+        jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    lm_build_jobserver_init(&jobs, jobs_set);
+    if(jobs < 1) {
+        jobs = 1;
+    }
+
+    if(lm_build_mtime(build_dir) < 0 && lm_mkdir(build_dir) != 0) {
+        LM_LOG_ERROR("can not create %s", build_dir);
+        return LM_ERR;
+    }
+
+    // compile through the object cache by re-running ourselves with --cache-exec
+    const char *cache_dir = getenv(LM_CACHE_DIR_ENV);
+    if(cache_dir && cache_dir[0]) {
+        ssize_t len = readlink("/proc/self/exe", ctx.cache_exe, sizeof(ctx.cache_exe) - 1);
+        ctx.cache_exe[len > 0 ? len : 0] = '\0';
+    }
+
+    lm_build_args_init(gcc_prefix);
+
+    // a changed flag set makes every object stale, make only sees this through the Makefile
+    bool cflags_changed = lm_build_stamp_check(build_dir, LM_BUILD_CFLAGS_STAMP, &ctx.cc_args);
+    bool asflags_changed = lm_build_stamp_check(build_dir, LM_BUILD_ASFLAGS_STAMP, &ctx.as_args);
+    ctx.force = cflags_changed || asflags_changed;
+
+    if(lm_build_list_has_suffix(VAR_C_SOURCE, ".c")) {
+        ret = lm_build_pch(build_dir, "c", "c-header", &ctx.cc_args);
+    }
+    if(ret == LM_OK && lm_build_list_has_suffix(VAR_C_SOURCE, ".cpp")) {
+        ret = lm_build_pch(build_dir, "cxx", "c++-header", &ctx.cxx_args);
+    }
+
+    int src_count = lm_parser_get_list(VAR_C_SOURCE)->count;
+    int asm_count = lm_parser_get_list(VAR_ASM_SOURCE)->count;
+    ctx.tasks = calloc(src_count + asm_count + 1, sizeof(lm_build_task_t));
+
+    lm_build_add_tasks(build_dir, VAR_C_SOURCE, false);
+    lm_build_add_tasks(build_dir, VAR_ASM_SOURCE, true);
+    lm_build_merge_tasks();
+
+    // like make, batched sources are compiled through their unity_NNNN.c
+    int batches = lm_build_unity(build_dir);
+    if(batches > 0) {
+        lm_build_unity_tasks(build_dir, batches);
+    }
+
+    if(ret == LM_OK) {
+        ret = lm_build_compile_all(jobs);
+    }
+
+    if(ret == LM_OK) {
+        lm_build_stamp_commit(build_dir, LM_BUILD_CFLAGS_STAMP);
+        lm_build_stamp_commit(build_dir, LM_BUILD_ASFLAGS_STAMP);
+        lm_build_header_commit(build_dir, header_file);
+
+        lm_build_args_t ld_args = {0};
+        lm_build_ld_args(&ld_args);
+        bool ldflags_changed = lm_build_stamp_check(build_dir, LM_BUILD_LDFLAGS_STAMP, &ld_args);
+        lm_build_args_free(&ld_args);
+
+        ret = lm_build_link_all(pro_name, build_dir, gcc_prefix, ldflags_changed);
+        if(ret == LM_OK) {
+            lm_build_stamp_commit(build_dir, LM_BUILD_LDFLAGS_STAMP);
+        }
+    }
+    else {
+        LM_LOG_ERROR("build failed");
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        lm_build_task_free(&ctx.tasks[i]);
+    }
+
+    free(ctx.tasks);
+    lm_build_args_free(&ctx.cc_args);
+    lm_build_args_free(&ctx.cxx_args);
+    lm_build_args_free(&ctx.as_args);
+
+    if(ctx.js_fifo) {
+        close(ctx.js_read);
+    }
+    pthread_mutex_destroy(&ctx.state_lock);
+    pthread_mutex_destroy(&ctx.js_lock);
+
+    return ret;
+}
+
+
+// one stamp or header line per entry, without the newline
+static void lm_build_lines_read(const char *path, lm_build_args_t *lines)
+{
+    char line[LM_BUILD_MAX_PATH];
+
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return;
+    }
+
+    while(fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+        lm_build_args_push(lines, line);
+    }
+
+    fclose(file);
+}
+
+
+// compare a flag stamp with the flags we would build with now, print "+new -gone"
+static bool lm_build_explain_flags(const char *build_dir, const char *name, const char *label, lm_build_args_t *args)
+{
+    char path[LM_BUILD_MAX_PATH];
+    lm_build_args_t old = {0};
+
+    snprintf(path, sizeof(path), "%s/%s", build_dir, name);
+    if(lm_build_mtime(path) < 0) {
+        return false;
+    }
+
+    lm_build_lines_read(path, &old);
+
+    bool changed = old.count != args->count;
+    for(int i = 0; !changed && i < args->count; i++) {
+        changed = strcmp(old.argv[i], args->argv[i]) != 0;
+    }
+
+    if(changed) {
+        printf("%s set changed:", label);
+        for(int i = 0; i < args->count; i++) {
+            if(!lm_build_args_has(&old, args->argv[i])) {
+                printf(" +%s", args->argv[i]);
+            }
+        }
+        for(int i = 0; i < old.count; i++) {
+            if(!lm_build_args_has(args, old.argv[i])) {
+                printf(" -%s", old.argv[i]);
+            }
+        }
+        printf("\n");
+    }
+
+    lm_build_args_free(&old);
+    return changed;
+}
+
+
+// "#define NAME VALUE" or "// NAME is not set" -> NAME, NULL for any other header line
+static const char *lm_build_macro_name(const char *line, int *len)
+{
+    const char *p;
+
+    if(strncmp(line, "#define ", 8) == 0) {
+        p = line + 8;
+    }
+    else if(strncmp(line, "// ", 3) == 0 && strstr(line, " is not set")) {
+        p = line + 3;
+    }
+    else {
+        return NULL;
+    }
+
+    p += strspn(p, " \t");
+    *len = strcspn(p, " \t");
+    return *len ? p : NULL;
+}
+
+
+static int lm_build_macro_cmp(const void *a, const void *b)
+{
+    const char *line_a = *(const char * const *)a;
+    const char *line_b = *(const char * const *)b;
+    int len_a;
+    int len_b;
+
+    const char *name_a = lm_build_macro_name(line_a, &len_a);
+    const char *name_b = lm_build_macro_name(line_b, &len_b);
+
+    int ret = strncmp(name_a, name_b, len_a < len_b ? len_a : len_b);
+    return ret ? ret : len_a - len_b;
+}
+
+
+static void lm_build_macro_lines(lm_build_args_t *lines)
+{
+    int count = 0;
+    int len;
+
+    for(int i = 0; i < lines->count; i++) {
+        if(lm_build_macro_name(lines->argv[i], &len)) {
+            lines->argv[count++] = lines->argv[i];
+        }
+        else {
+            free(lines->argv[i]);
+        }
+    }
+
+    lines->count = count;
+    qsort(lines->argv, count, sizeof(char*), lm_build_macro_cmp);
+}
+
+
+/*
+ * The macros whose line differs between the header the objects were built
+ * against (the stamp lm build keeps, else the header on disk) and a header
+ * generated from the current configuration.
+ */
+static void lm_build_explain_macros(const char *build_dir, const char *header_file, lm_build_args_t *changed)
+{
+    char path[LM_BUILD_MAX_PATH];
+    char tmp_path[LM_BUILD_MAX_PATH];
+    lm_build_args_t old = {0};
+    lm_build_args_t now = {0};
+    int len;
+
+    // nothing built yet, every object is missing anyway
+    if(lm_build_mtime(build_dir) < 0) {
+        return;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", build_dir, LM_BUILD_HEADER_STAMP);
+    snprintf(tmp_path, sizeof(tmp_path), "%s/%s.%d", build_dir, LM_BUILD_HEADER_STAMP, (int)getpid());
+
+    if(lm_gen_header_file(tmp_path) != LM_OK) {
+        remove(tmp_path);
+        return;
+    }
+
+    lm_build_lines_read(lm_build_mtime(path) < 0 ? header_file : path, &old);
+    lm_build_lines_read(tmp_path, &now);
+    remove(tmp_path);
+
+    lm_build_macro_lines(&old);
+    lm_build_macro_lines(&now);
+
+    int i = 0;
+    int j = 0;
+    while(i < old.count || j < now.count) {
+        int cmp = i == old.count ? 1 : j == now.count ? -1 : lm_build_macro_cmp(&old.argv[i], &now.argv[j]);
+        const char *line = cmp < 0 ? old.argv[i] : now.argv[j];
+
+        if(cmp != 0 || strcmp(old.argv[i], now.argv[j]) != 0) {
+            const char *name = lm_build_macro_name(line, &len);
+            char buf[LM_BUILD_MAX_PATH];
+
+            snprintf(buf, sizeof(buf), "%.*s", len, name);
+            lm_build_args_push(changed, buf);
+        }
+
+        i += cmp <= 0;
+        j += cmp >= 0;
+    }
+
+    lm_build_args_free(&old);
+    lm_build_args_free(&now);
+}
+
+
+typedef struct lm_build_why {
+    const char *src;
+    lm_build_args_t *members;
+    struct stat *member_st;
+    int64_t obj_time;
+    struct stat header;
+    bool has_header;
+    bool uses_header;
+    lm_build_args_t deps;
+    int dep_count;
+}lm_build_why_t;
+
+
+static bool lm_build_dep_why_fn(const char *dep, void *user)
+{
+    lm_build_why_t *why = user;
+    struct stat st;
+
+    // the source is the first prerequisite, it has its own reason, so do unity members
+    if(strcmp(dep, why->src) == 0 || lm_build_args_has(why->members, dep)) {
+        return false;
+    }
+
+    if(stat(dep, &st) != 0) {
+        why->dep_count++;
+        if(why->deps.count < LM_BUILD_EXPLAIN_SHOW) {
+            char buf[LM_BUILD_MAX_PATH];
+            snprintf(buf, sizeof(buf), "header %s removed", dep);
+            lm_build_args_push(&why->deps, buf);
+        }
+        return false;
+    }
+
+    // the unity file includes its members through a relative path
+    for(int i = 0; i < why->members->count; i++) {
+        if(st.st_dev == why->member_st[i].st_dev && st.st_ino == why->member_st[i].st_ino) {
+            return false;
+        }
+    }
+
+    bool is_header = why->has_header && st.st_dev == why->header.st_dev && st.st_ino == why->header.st_ino;
+    why->uses_header = why->uses_header || is_header;
+
+    int64_t dep_time = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+    if(dep_time > why->obj_time && !is_header) {
+        why->dep_count++;
+        if(why->deps.count < LM_BUILD_EXPLAIN_SHOW) {
+            char buf[LM_BUILD_MAX_PATH];
+            snprintf(buf, sizeof(buf), "header %s newer", dep);
+            lm_build_args_push(&why->deps, buf);
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * What the generated rules have besides the source and its .d: Makefile,
+ * and $(PCH_C) or $(PCH_CXX) for C and C++ objects.
+ */
+typedef struct lm_build_pch_state {
+    char reason[LM_BUILD_MAX_PATH];
+    int64_t newest;
+    bool used;
+}lm_build_pch_state_t;
+
+
+typedef struct lm_build_explain {
+    bool flags_changed;
+    const char *header_file;
+    lm_build_args_t macros;
+    int64_t makefile_time;
+    lm_build_pch_state_t pch_c;
+    lm_build_pch_state_t pch_cxx;
+}lm_build_explain_t;
+
+
+/*
+ * The directory the generated Makefile builds in: with --variant that is
+ * <build>/$(LM_CONFIG_HASH) as .lm.mk set it, <build>/current without a hash.
+ */
+static void lm_build_explain_dir(const char *build_dir, const char *lmmk_file, char *dir, int size)
+{
+    char path[LM_BUILD_MAX_PATH];
+    char line[LM_BUILD_MAX_PATH];
+    char hex[LM_BUILD_MAX_PATH];
+    struct stat st;
+
+    snprintf(dir, size, "%s", build_dir);
+    snprintf(path, sizeof(path), "%s/%s", build_dir, LM_VARIANT_CURRENT);
+    if(lstat(path, &st) != 0 || !S_ISLNK(st.st_mode)) {
+        return;
+    }
+
+    snprintf(dir, size, "%s", path);
+
+    FILE *file = fopen(lmmk_file, "r");
+    if(file == NULL) {
+        return;
+    }
+
+    while(fgets(line, sizeof(line), file)) {
+        if(sscanf(line, "LM_CONFIG_HASH := %4095s", hex) == 1) {
+            snprintf(dir, size, "%s/%s", build_dir, hex);
+            break;
+        }
+    }
+
+    fclose(file);
+}
+
+
+// a .gch missing or older than what it was built from is rebuilt first, and every object after it
+static void lm_build_explain_pch(const char *dir, const char *lang, const char *suffix, lm_build_pch_state_t *state)
+{
+    lm_array_t *list = lm_parser_get_list(VAR_PCH_SOURCE);
+    char pch_dir[LM_BUILD_MAX_PATH];
+    char stub[LM_BUILD_MAX_PATH];
+    char gch[LM_BUILD_MAX_PATH + 8];
+    char dep[LM_BUILD_MAX_PATH + 16];
+    lm_list_node_t *node;
+
+    state->reason[0] = '\0';
+    state->newest = -1;
+    state->used = list->count > 0 && lm_build_list_has_suffix(VAR_C_SOURCE, suffix);
+    if(!state->used) {
+        return;
+    }
+
+    snprintf(pch_dir, sizeof(pch_dir), "%s/pch/%s", dir, lang);
+
+    lm_list_for_each(node, &list->head) {
+        const char *src = container_of(node, lm_array_node_t, node)->string;
+
+        lm_build_pch_name(pch_dir, src, stub, sizeof(stub));
+        snprintf(gch, sizeof(gch), "%s.gch", stub);
+        snprintf(dep, sizeof(dep), "%s.d", gch);
+
+        int64_t gch_time = lm_build_mtime(gch);
+        if(gch_time > state->newest) {
+            state->newest = gch_time;
+        }
+
+        if(state->reason[0]) {
+            continue;
+        }
+
+        if(gch_time < 0) {
+            snprintf(state->reason, sizeof(state->reason), "precompiled header %s not built", src);
+        }
+        else if(lm_build_mtime(stub) > gch_time || lm_build_dep_is_newer(dep, gch_time)) {
+            snprintf(state->reason, sizeof(state->reason), "precompiled header %s out of date", src);
+        }
+    }
+}
+
+
+static bool lm_build_explain_is_target(const char *filter)
+{
+    lm_array_t *targets = lm_parser_get_list(VAR_TARGETS);
+    lm_list_node_t *node;
+
+    lm_list_for_each(node, &targets->head) {
+        if(strcmp(container_of(node, lm_array_node_t, node)->string, filter) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// a target links the objects outside any TARGET block and every library, besides its own
+static bool lm_build_explain_match(lm_build_task_t *task, const char *filter, bool is_target)
+{
+    if(filter == NULL) {
+        return true;
+    }
+
+    if(is_target) {
+        return lm_build_task_links(task, filter);
+    }
+
+    return (task->library && strcmp(task->library, filter) == 0) ||
+           strcmp(task->src, filter) == 0 || strcmp(task->obj, filter) == 0;
+}
+
+
+// print why the object rebuilds, false if it is up to date
+static bool lm_build_explain_task(lm_build_task_t *task, lm_build_explain_t *explain)
+{
+    lm_build_pch_state_t *pch = task->is_asm ? NULL : task->is_cxx ? &explain->pch_cxx : &explain->pch_c;
+    lm_build_args_t *macros = &explain->macros;
+    lm_build_why_t why = {0};
+    bool header_newer = false;
+    bool rebuild = false;
+
+    why.src = task->src;
+    why.members = &task->members;
+    why.obj_time = lm_build_mtime(task->obj);
+    why.has_header = stat(explain->header_file, &why.header) == 0;
+
+    if(why.obj_time < 0) {
+        printf("%s\n    no object\n", task->obj);
+        return true;
+    }
+
+    why.member_st = calloc(task->members.count + 1, sizeof(struct stat));
+    for(int i = 0; i < task->members.count; i++) {
+        stat(task->members.argv[i], &why.member_st[i]);
+    }
+
+    int64_t header_time = why.has_header ? (int64_t)why.header.st_mtim.tv_sec * 1000000000 + why.header.st_mtim.tv_nsec : -1;
+    bool has_dep = lm_build_dep_scan(task->dep, lm_build_dep_why_fn, &why);
+    free(why.member_st);
+    header_newer = why.uses_header && header_time > why.obj_time;
+
+    // a batch object stands for its members, the unity file itself is rewritten with them
+    int sources_newer = 0;
+    for(int i = 0; i < task->members.count; i++) {
+        sources_newer += lm_build_mtime(task->members.argv[i]) > why.obj_time;
+    }
+    if(task->members.count == 0) {
+        sources_newer = lm_build_mtime(task->src) > why.obj_time;
+    }
+
+    bool config_changed = why.uses_header && macros->count > 0;
+    bool makefile_newer = explain->makefile_time > why.obj_time;
+    bool pch_stale = pch && pch->used && pch->reason[0];
+    bool pch_newer = pch && pch->used && !pch_stale && pch->newest > why.obj_time;
+
+    rebuild = explain->flags_changed || sources_newer || !has_dep || why.dep_count || config_changed || header_newer ||
+              makefile_newer || pch_stale || pch_newer;
+
+    if(rebuild) {
+        printf("%s\n", task->obj);
+    }
+
+    if(explain->flags_changed) {
+        printf("    %s set changed\n", task->is_asm ? "ASFLAG" : "CFLAG");
+    }
+    if(makefile_newer) {
+        printf("    %s regenerated\n", LM_BUILD_MAKEFILE);
+    }
+
+    for(int i = 0, shown = 0; i < task->members.count; i++) {
+        if(lm_build_mtime(task->members.argv[i]) > why.obj_time && shown++ < LM_BUILD_EXPLAIN_SHOW) {
+            printf("    source %s newer\n", task->members.argv[i]);
+        }
+    }
+    if(task->members.count == 0 && sources_newer) {
+        printf("    source %s newer\n", task->src);
+    }
+    else if(sources_newer > LM_BUILD_EXPLAIN_SHOW) {
+        printf("    and %d more sources\n", sources_newer - LM_BUILD_EXPLAIN_SHOW);
+    }
+
+    if(!has_dep) {
+        printf("    no dependency file %s\n", task->dep);
+    }
+    if(pch_stale) {
+        printf("    %s\n", pch->reason);
+    }
+    else if(pch_newer) {
+        printf("    precompiled header newer\n");
+    }
+
+    if(config_changed) {
+        for(int i = 0; i < macros->count && i < LM_BUILD_EXPLAIN_SHOW; i++) {
+            printf("    config macro %s changed\n", macros->argv[i]);
+        }
+        if(macros->count > LM_BUILD_EXPLAIN_SHOW) {
+            printf("    and %d more config macros\n", macros->count - LM_BUILD_EXPLAIN_SHOW);
+        }
+    }
+    else if(header_newer) {
+        printf("    header %s newer\n", explain->header_file);
+    }
+
+    for(int i = 0; i < why.deps.count; i++) {
+        printf("    %s\n", why.deps.argv[i]);
+    }
+    if(why.dep_count > why.deps.count) {
+        printf("    and %d more headers\n", why.dep_count - why.deps.count);
+    }
+
+    lm_build_args_free(&why.deps);
+    return rebuild;
+}
+
+
+int lm_build_explain(const char *build_dir, const char *lmmk_file, const char *gcc_prefix, const char *header_file,
+                     const char *filter)
+{
+    lm_build_explain_t explain = {0};
+    lm_build_args_t ld_args = {0};
+    char dir[LM_BUILD_MAX_PATH];
+    int rebuild = 0;
+    int matched = 0;
+
+    memset(&ctx, 0, sizeof(ctx));
+    lm_build_explain_dir(build_dir, lmmk_file, dir, sizeof(dir));
+    lm_build_args_init(gcc_prefix);
+    lm_build_ld_args(&ld_args);
+
+    bool cflags_changed = lm_build_explain_flags(dir, LM_BUILD_CFLAGS_STAMP, "CFLAG", &ctx.cc_args);
+    bool asflags_changed = lm_build_explain_flags(dir, LM_BUILD_ASFLAGS_STAMP, "ASFLAG", &ctx.as_args);
+    bool ldflags_changed = lm_build_explain_flags(dir, LM_BUILD_LDFLAGS_STAMP, "LDFLAG", &ld_args);
+
+    lm_build_explain_macros(dir, header_file, &explain.macros);
+
+    // lm build stamps both flag sets together, either one rebuilds everything
+    explain.flags_changed = cflags_changed || asflags_changed;
+    explain.header_file = header_file;
+    explain.makefile_time = lm_build_mtime(LM_BUILD_MAKEFILE);
+    lm_build_explain_pch(dir, "c", ".c", &explain.pch_c);
+    lm_build_explain_pch(dir, "cxx", ".cpp", &explain.pch_cxx);
+
+    int src_count = lm_parser_get_list(VAR_C_SOURCE)->count;
+    int asm_count = lm_parser_get_list(VAR_ASM_SOURCE)->count;
+    ctx.tasks = calloc(src_count + asm_count + 1, sizeof(lm_build_task_t));
+
+    lm_build_add_tasks(dir, VAR_C_SOURCE, false);
+    lm_build_add_tasks(dir, VAR_ASM_SOURCE, true);
+    lm_build_merge_tasks();
+
+    int batches = lm_build_unity(dir);
+    int *leader = calloc(batches + 1, sizeof(int));
+    bool is_target = filter && lm_build_explain_is_target(filter);
+
+    // the first matching member of a batch carries the others
+    for(int i = 0; i < ctx.task_count; i++) {
+        lm_build_task_t *task = &ctx.tasks[i];
+
+        if(task->batch == 0 || !lm_build_explain_match(task, filter, is_target)) {
+            continue;
+        }
+
+        if(leader[task->batch] == 0) {
+            leader[task->batch] = i + 1;
+        }
+        lm_build_args_push(&ctx.tasks[leader[task->batch] - 1].members, task->src);
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        if(ctx.tasks[i].batch && leader[ctx.tasks[i].batch] == i + 1) {
+            ctx.tasks[i].src = ctx.tasks[i].batch_src;
+        }
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        lm_build_task_t *task = &ctx.tasks[i];
+
+        if(task->batch ? leader[task->batch] != i + 1 : !lm_build_explain_match(task, filter, is_target)) {
+            continue;
+        }
+
+        matched++;
+        rebuild += lm_build_explain_task(task, &explain);
+    }
+
+    if(filter && matched == 0) {
+        LM_LOG_ERROR("no target, library or source named %s", filter);
+    }
+    else if(rebuild == 0 && !ldflags_changed) {
+        printf("nothing to rebuild\n");
+    }
+    else {
+        printf("%d of %d objects rebuild%s\n", rebuild, matched, rebuild || ldflags_changed ? ", link needed" : "");
+    }
+
+    for(int i = 0; i < ctx.task_count; i++) {
+        lm_build_task_free(&ctx.tasks[i]);
+    }
+
+    free(leader);
+    free(ctx.tasks);
+    lm_build_args_free(&ctx.cc_args);
+    lm_build_args_free(&ctx.cxx_args);
+    lm_build_args_free(&ctx.as_args);
+    lm_build_args_free(&ld_args);
+    lm_build_args_free(&explain.macros);
+
+    return filter && matched == 0 ? LM_ERR : LM_OK;
+}
+
+
+#else
+
+int lm_build_run(const char *pro_name, const char *build_dir, const char *gcc_prefix, const char *header_file, int jobs)
+{
+    (void)pro_name;
+    (void)build_dir;
+    (void)gcc_prefix;
+    (void)header_file;
+    (void)jobs;
+
+    LM_LOG_ERROR("lm build is only supported on linux, please use make");
+    return LM_ERR;
+}
+
+
+int lm_build_explain(const char *build_dir, const char *lmmk_file, const char *gcc_prefix, const char *header_file,
+                     const char *filter)
+{
+    (void)build_dir;
+    (void)lmmk_file;
+    (void)gcc_prefix;
+    (void)header_file;
+    (void)filter;
+
+    LM_LOG_ERROR("lm explain is only supported on linux");
+    return LM_ERR;
+}
+
+#endif
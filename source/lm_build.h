@@ -0,0 +1,57 @@
+/* source/lm_build.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_BUILD_H__
+#define __LM_BUILD_H__
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Compile and link the parsed project without make. The SRC/ASM/LDS lists and
+ * flags come straight from the parser; jobs <= 0 means one job per cpu.
+ */
+int lm_build_run(const char *pro_name, const char *build_dir, const char *gcc_prefix, const char *header_file, int jobs);
+
+
+/**
+ * Build nothing, print each object lm build or make would recompile and why:
+ * missing object or .d, newer source or header, changed flag stamps or config
+ * macros, a regenerated Makefile or precompiled header. Objects are looked
+ * up where make puts them: <build>/$(LM_CONFIG_HASH) from lmmk_file for a
+ * --variant build, unity batch objects for batched sources. filter limits
+ * the report to a source, a library, or a target and all it links.
+ */
+int lm_build_explain(const char *build_dir, const char *lmmk_file, const char *gcc_prefix, const char *header_file,
+                     const char *filter);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_BUILD_H__
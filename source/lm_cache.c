@@ -0,0 +1,922 @@
+/* source/lm_cache.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lm_cache.h"
+#include "lm_hash.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+
+
+#if ( __linux__)
+
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <spawn.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+
+#define    LM_CACHE_MAX_PATH        4096
+#define    LM_CACHE_VERSION         "lm-cache-1"
+#define    LM_CACHE_DEFAULT_MB      2048
+#define    LM_CACHE_EVICT_PERCENT   80
+#define    LM_CACHE_PIPE_BUF        (1024 * 64)
+
+
+/*
+ * cache layout:
+ *   <dir>/ab/cdef.../{o,d,lst,info}   one entry per key, info holds the object hash and entry size
+ *   <dir>/compilers/<key>             `cc --version` hash, keyed by compiler path, size and mtime
+ *   <dir>/tmp/                        entries are built here and renamed into place
+ *   <dir>/stats, <dir>/lock           counters, updated under flock
+ */
+
+
+/* the outputs of one compile command, found by scanning its argv */
+typedef struct lm_cache_cmd {
+    int argc;
+    char **argv;
+    const char *obj;
+    const char *dep;
+    const char *lst;
+    int lst_arg;
+    bool cacheable;
+}lm_cache_cmd_t;
+
+
+typedef struct lm_cache_stat {
+    long long hits;
+    long long misses;
+    long long size;
+}lm_cache_stat_t;
+
+
+typedef struct lm_cache_entry {
+    char name[LM_HASH_HEX_LEN + 2];
+    int64_t used;
+    long long size;
+}lm_cache_entry_t;
+
+
+static const char *cache_root;
+
+
+/* options whose value is the next argument */
+static const char *lm_cache_value_opts[] = {
+    "-o", "-MF", "-MT", "-MQ", "-I", "-D", "-U", "-x", "-include", "-imacros",
+    "-isystem", "-idirafter", "-iquote", "-Xassembler", "-Xpreprocessor", NULL,
+};
+
+
+static bool lm_cache_takes_value(const char *arg)
+{
+    for(int i = 0; lm_cache_value_opts[i]; i++) {
+        if(strcmp(arg, lm_cache_value_opts[i]) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+/*
+ * only single-input `-c` commands are cached; a custom -MT/-MQ target would
+ * not survive the .d rewrite on restore, so those go straight to the compiler
+ */
+static void lm_cache_scan(lm_cache_cmd_t *cmd, int argc, char *argv[])
+{
+    bool compile_only = false;
+    bool unsupported = false;
+    int inputs = 0;
+
+    memset(cmd, 0, sizeof(*cmd));
+    cmd->argc = argc;
+    cmd->argv = argv;
+    cmd->lst_arg = -1;
+
+    for(int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        const char *lst;
+
+        if(strcmp(arg, "-c") == 0) {
+            compile_only = true;
+        }
+        else if(lm_cache_takes_value(arg)) {
+            if(i + 1 >= argc || strcmp(arg, "-MT") == 0 || strcmp(arg, "-MQ") == 0) {
+                unsupported = true;
+                break;
+            }
+
+            if(strcmp(arg, "-o") == 0) {
+                cmd->obj = argv[i + 1];
+            }
+            else if(strcmp(arg, "-MF") == 0) {
+                cmd->dep = argv[i + 1];
+            }
+            i++;
+        }
+        else if(strncmp(arg, "-Wa,", 4) == 0 && (lst = strstr(arg, "-alms=")) != NULL) {
+            cmd->lst = lst + 6;
+            cmd->lst_arg = i;
+            if(strchr(cmd->lst, ',')) {
+                unsupported = true;
+            }
+        }
+        else if(arg[0] != '-') {
+            inputs++;
+        }
+    }
+
+    cmd->cacheable = compile_only && !unsupported && cmd->obj && inputs == 1;
+}
+
+
+static int lm_cache_wait(pid_t pid)
+{
+    int status;
+
+    while(waitpid(pid, &status, 0) < 0) {
+        if(errno != EINTR) {
+            return -1;
+        }
+    }
+
+    if(WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    }
+
+    return 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+}
+
+
+// run with the caller's stdio, return the exit code
+static int lm_cache_spawn(char **argv)
+{
+    pid_t pid;
+
+    int ret = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+    if(ret != 0) {
+        LM_LOG_ERROR("failed to run %s: %s", argv[0], strerror(ret));
+        return 127;
+    }
+
+    return lm_cache_wait(pid);
+}
+
+
+// run with stdout fed into the hash and stderr discarded
+static int lm_cache_capture(char **argv, lm_hash_t *hash)
+{
+    posix_spawn_file_actions_t actions;
+    char *buffer;
+    ssize_t len;
+    pid_t pid;
+    int fds[2];
+
+    if(pipe(fds) != 0) {
+        return LM_ERR;
+    }
+
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_adddup2(&actions, fds[1], STDOUT_FILENO);
+    posix_spawn_file_actions_addclose(&actions, fds[0]);
+    posix_spawn_file_actions_addclose(&actions, fds[1]);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    int ret = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    close(fds[1]);
+
+    if(ret != 0) {
+        close(fds[0]);
+        return LM_ERR;
+    }
+
+    buffer = malloc(LM_CACHE_PIPE_BUF);
+    while(buffer && (len = read(fds[0], buffer, LM_CACHE_PIPE_BUF)) != 0) {
+        if(len < 0) {
+            if(errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        lm_hash_update(hash, buffer, len);
+    }
+
+    free(buffer);
+    close(fds[0]);
+
+    return (lm_cache_wait(pid) == 0 && buffer) ? LM_OK : LM_ERR;
+}
+
+
+static int lm_cache_which(const char *name, char *path)
+{
+    const char *env = getenv("PATH");
+
+    if(strchr(name, '/')) {
+        snprintf(path, LM_CACHE_MAX_PATH, "%s", name);
+        return access(path, X_OK) == 0 ? LM_OK : LM_ERR;
+    }
+
+    while(env && *env) {
+        const char *end = strchr(env, ':');
+        int len = end ? (int)(end - env) : (int)strlen(env);
+
+        snprintf(path, LM_CACHE_MAX_PATH, "%.*s/%s", len ? len : 1, len ? env : ".", name);
+        if(access(path, X_OK) == 0) {
+            return LM_OK;
+        }
+
+        env += len;
+        if(*env == ':') {
+            env++;
+        }
+    }
+
+    return LM_ERR;
+}
+
+
+static int lm_cache_read_text(const char *path, char *text, int size)
+{
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    char *ret = fgets(text, size, file);
+    fclose(file);
+
+    if(ret == NULL) {
+        return LM_ERR;
+    }
+
+    text[strcspn(text, "\n")] = '\0';
+    return LM_OK;
+}
+
+
+// write next to the target and rename, so readers never see a partial file
+static int lm_cache_write_text(const char *path, const char *text)
+{
+    char tmp[LM_CACHE_MAX_PATH];
+
+    snprintf(tmp, sizeof(tmp), "%s.%d", path, (int)getpid());
+
+    FILE *file = fopen(tmp, "w");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    int ret = fputs(text, file);
+    if(fclose(file) != 0 || ret < 0 || rename(tmp, path) != 0) {
+        remove(tmp);
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+/*
+ * compiler identity is the hash of `cc --version`; running it for every file
+ * would double the process count, so it is remembered per binary path/size/mtime
+ */
+static int lm_cache_compiler_id(const char *compiler, char *hex)
+{
+    char path[LM_CACHE_MAX_PATH];
+    char id_path[LM_CACHE_MAX_PATH];
+    char key[LM_HASH_HEX_LEN];
+    struct stat st;
+    lm_hash_t hash;
+
+    if(lm_cache_which(compiler, path) != LM_OK || stat(path, &st) != 0) {
+        return LM_ERR;
+    }
+
+    lm_hash_init(&hash);
+    lm_hash_string(&hash, path);
+    lm_hash_update(&hash, &st.st_size, sizeof(st.st_size));
+    lm_hash_update(&hash, &st.st_mtim, sizeof(st.st_mtim));
+    lm_hash_final(&hash, key);
+
+    snprintf(id_path, sizeof(id_path), "%s/compilers/%s", cache_root, key);
+    if(lm_cache_read_text(id_path, hex, LM_HASH_HEX_LEN) == LM_OK && strlen(hex) == LM_HASH_HEX_LEN - 1) {
+        return LM_OK;
+    }
+
+    char *argv[] = { path, "--version", NULL };
+
+    lm_hash_init(&hash);
+    if(lm_cache_capture(argv, &hash) != LM_OK) {
+        return LM_ERR;
+    }
+    lm_hash_final(&hash, hex);
+
+    lm_cache_write_text(id_path, hex);
+    return LM_OK;
+}
+
+
+/* output paths are left out of the key so the same source hits from any build dir */
+static void lm_cache_hash_args(lm_cache_cmd_t *cmd, lm_hash_t *hash)
+{
+    for(int i = 1; i < cmd->argc; i++) {
+        const char *arg = cmd->argv[i];
+
+        if(i == cmd->lst_arg) {
+            lm_hash_update(hash, arg, cmd->lst - arg);
+            lm_hash_update(hash, "", 1);
+            continue;
+        }
+
+        lm_hash_string(hash, arg);
+        if(strcmp(arg, "-o") == 0 || strcmp(arg, "-MF") == 0) {
+            i++;
+        }
+    }
+}
+
+
+// the same command with -E instead of -c, without any output options
+static char **lm_cache_preprocess_argv(lm_cache_cmd_t *cmd)
+{
+    char **argv = malloc((cmd->argc + 2) * sizeof(char*));
+    int n = 0;
+
+    if(argv == NULL) {
+        return NULL;
+    }
+
+    argv[n++] = cmd->argv[0];
+    for(int i = 1; i < cmd->argc; i++) {
+        const char *arg = cmd->argv[i];
+
+        if(strcmp(arg, "-o") == 0 || strcmp(arg, "-MF") == 0) {
+            i++;
+            continue;
+        }
+
+        if(strcmp(arg, "-c") == 0 || strcmp(arg, "-MMD") == 0 || strcmp(arg, "-MD") == 0
+            || strcmp(arg, "-MP") == 0 || strncmp(arg, "-Wa,", 4) == 0) {
+            continue;
+        }
+
+        argv[n++] = cmd->argv[i];
+    }
+
+    argv[n++] = "-E";
+    argv[n] = NULL;
+    return argv;
+}
+
+
+static int lm_cache_key(lm_cache_cmd_t *cmd, char *hex)
+{
+    char compiler[LM_HASH_HEX_LEN];
+    lm_hash_t hash;
+
+    if(lm_cache_compiler_id(cmd->argv[0], compiler) != LM_OK) {
+        return LM_ERR;
+    }
+
+    char **argv = lm_cache_preprocess_argv(cmd);
+    if(argv == NULL) {
+        return LM_ERR;
+    }
+
+    lm_hash_init(&hash);
+    lm_hash_string(&hash, LM_CACHE_VERSION);
+    lm_hash_string(&hash, compiler);
+    lm_cache_hash_args(cmd, &hash);
+
+    int ret = lm_cache_capture(argv, &hash);
+    free(argv);
+
+    if(ret != LM_OK) {
+        return LM_ERR;
+    }
+
+    lm_hash_final(&hash, hex);
+    return LM_OK;
+}
+
+
+/* copy a .d file, replacing its first target (the object it was generated for) */
+static int lm_cache_copy_dep(const char *from, const char *to, const char *target)
+{
+    FILE *file = fopen(from, "rb");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    char *text = malloc(size + 1);
+    if(text == NULL || size < 0 || fread(text, 1, size, file) != (size_t)size) {
+        free(text);
+        fclose(file);
+        return LM_ERR;
+    }
+    fclose(file);
+    text[size] = '\0';
+
+    char *rules = text;
+    if(target) {
+        while(*rules && !(rules[0] == ':' && (rules[1] == ' ' || rules[1] == '\t'
+                || rules[1] == '\n' || rules[1] == '\r' || rules[1] == '\0'))) {
+            rules++;
+        }
+    }
+
+    remove(to);
+    file = fopen(to, "wb");
+    if(file == NULL) {
+        free(text);
+        return LM_ERR;
+    }
+
+    if(target && *rules) {
+        fputs(target, file);
+    }
+    else {
+        rules = text;
+    }
+    fwrite(rules, 1, size - (rules - text), file);
+
+    free(text);
+    return fclose(file) == 0 ? LM_OK : LM_ERR;
+}
+
+
+static int lm_cache_read_info(const char *entry, char *obj_hex, long long *size)
+{
+    char path[LM_CACHE_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/info", entry);
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    int ret = fscanf(file, "%32s %lld", obj_hex, size);
+    fclose(file);
+
+    return ret == 2 ? LM_OK : LM_ERR;
+}
+
+
+static bool lm_cache_exists(const char *entry, const char *name)
+{
+    char path[LM_CACHE_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s", entry, name);
+    return access(path, F_OK) == 0;
+}
+
+
+/*
+ * the object is linked into the build dir, so a compiler that later rewrites
+ * it in place would also change the cached copy: verify its hash every time
+ */
+static bool lm_cache_restore(lm_cache_cmd_t *cmd, const char *entry)
+{
+    char path[LM_CACHE_MAX_PATH];
+    char want[LM_HASH_HEX_LEN];
+    char have[LM_HASH_HEX_LEN];
+    long long size;
+
+    if(lm_cache_read_info(entry, want, &size) != LM_OK) {
+        return false;
+    }
+
+    if((cmd->dep && !lm_cache_exists(entry, "d")) || (cmd->lst && !lm_cache_exists(entry, "lst"))) {
+        return false;
+    }
+
+    snprintf(path, sizeof(path), "%s/o", entry);
+    if(lm_hash_file(path, have) != LM_OK || strcmp(want, have) != 0) {
+        return false;
+    }
+
+    if(lm_clone_file(path, cmd->obj, true) != 0) {
+        return false;
+    }
+
+    // make compares the object against its prerequisites, so it must look new
+    utimensat(AT_FDCWD, cmd->obj, NULL, 0);
+
+    if(cmd->dep) {
+        snprintf(path, sizeof(path), "%s/d", entry);
+        if(lm_cache_copy_dep(path, cmd->dep, cmd->obj) != LM_OK) {
+            return false;
+        }
+    }
+
+    if(cmd->lst) {
+        snprintf(path, sizeof(path), "%s/lst", entry);
+        if(lm_clone_file(path, cmd->lst, false) != 0) {
+            return false;
+        }
+    }
+
+    // the info mtime is the lru clock
+    snprintf(path, sizeof(path), "%s/info", entry);
+    utimensat(AT_FDCWD, path, NULL, 0);
+    return true;
+}
+
+
+static long long lm_cache_file_size(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 ? (long long)st.st_size : 0;
+}
+
+
+// build the entry under tmp/ and rename it into place, return its size
+static long long lm_cache_insert(lm_cache_cmd_t *cmd, const char *entry, const char *hex)
+{
+    char tmp[LM_CACHE_MAX_PATH];
+    char path[LM_CACHE_MAX_PATH];
+    char info[LM_HASH_HEX_LEN + 32];
+    char obj_hex[LM_HASH_HEX_LEN];
+    long long size = 0;
+
+    snprintf(tmp, sizeof(tmp), "%s/tmp/%d-%s", cache_root, (int)getpid(), hex);
+    lm_rm(tmp);
+    if(lm_mkdir(tmp) != 0) {
+        return 0;
+    }
+
+    // copied (or reflinked), never linked: the build dir copy may be rewritten later
+    snprintf(path, sizeof(path), "%s/o", tmp);
+    if(lm_clone_file(cmd->obj, path, false) != 0 || lm_hash_file(path, obj_hex) != LM_OK) {
+        goto fail;
+    }
+    size += lm_cache_file_size(path);
+
+    if(cmd->dep) {
+        snprintf(path, sizeof(path), "%s/d", tmp);
+        if(lm_cache_copy_dep(cmd->dep, path, NULL) != LM_OK) {
+            goto fail;
+        }
+        size += lm_cache_file_size(path);
+    }
+
+    if(cmd->lst) {
+        snprintf(path, sizeof(path), "%s/lst", tmp);
+        if(lm_clone_file(cmd->lst, path, false) != 0) {
+            goto fail;
+        }
+        size += lm_cache_file_size(path);
+    }
+
+    snprintf(path, sizeof(path), "%s/info", tmp);
+    snprintf(info, sizeof(info), "%s\n%lld\n", obj_hex, size);
+    if(lm_cache_write_text(path, info) != LM_OK) {
+        goto fail;
+    }
+
+    snprintf(path, sizeof(path), "%s/%.2s", cache_root, hex);
+    lm_mkdir(path);
+
+    // another job may have inserted the same key meanwhile, keep theirs
+    if(rename(tmp, entry) != 0) {
+        goto fail;
+    }
+
+    return size;
+
+fail:
+    lm_rm(tmp);
+    return 0;
+}
+
+
+static int lm_cache_lock(void)
+{
+    char path[LM_CACHE_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/lock", cache_root);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if(fd >= 0) {
+        while(flock(fd, LOCK_EX) != 0 && errno == EINTR);
+    }
+
+    return fd;
+}
+
+
+static void lm_cache_unlock(int fd)
+{
+    if(fd >= 0) {
+        flock(fd, LOCK_UN);
+        close(fd);
+    }
+}
+
+
+static void lm_cache_stat_read(lm_cache_stat_t *stat)
+{
+    char path[LM_CACHE_MAX_PATH];
+
+    memset(stat, 0, sizeof(*stat));
+
+    snprintf(path, sizeof(path), "%s/stats", cache_root);
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return;
+    }
+
+    if(fscanf(file, "hits %lld misses %lld size %lld", &stat->hits, &stat->misses, &stat->size) != 3) {
+        memset(stat, 0, sizeof(*stat));
+    }
+    fclose(file);
+}
+
+
+static void lm_cache_stat_write(const lm_cache_stat_t *stat)
+{
+    char path[LM_CACHE_MAX_PATH];
+    char text[128];
+
+    snprintf(path, sizeof(path), "%s/stats", cache_root);
+    snprintf(text, sizeof(text), "hits %lld\nmisses %lld\nsize %lld\n", stat->hits, stat->misses, stat->size);
+    lm_cache_write_text(path, text);
+}
+
+
+static long long lm_cache_capacity(void)
+{
+    const char *env = getenv(LM_CACHE_SIZE_ENV);
+    long long mb = env ? strtoll(env, NULL, 10) : 0;
+
+    return (mb > 0 ? mb : LM_CACHE_DEFAULT_MB) * 1024 * 1024;
+}
+
+
+static int lm_cache_entry_cmp(const void *a, const void *b)
+{
+    const lm_cache_entry_t *ea = a;
+    const lm_cache_entry_t *eb = b;
+
+    return (ea->used > eb->used) - (ea->used < eb->used);
+}
+
+
+static bool lm_cache_is_bucket(const char *name)
+{
+    return strlen(name) == 2 && strspn(name, "0123456789abcdef") == 2;
+}
+
+
+/*
+ * walk every entry, drop the least recently used ones down to 80% of the cap;
+ * the returned total also resyncs the size counter with what is on disk
+ */
+static long long lm_cache_evict(long long capacity)
+{
+    char path[LM_CACHE_MAX_PATH];
+    char obj_hex[LM_HASH_HEX_LEN];
+    lm_cache_entry_t *entries = NULL;
+    int count = 0;
+    int size = 0;
+    long long total = 0;
+    struct dirent *bucket;
+    struct dirent *item;
+    struct stat st;
+
+    DIR *root = opendir(cache_root);
+    if(root == NULL) {
+        return 0;
+    }
+
+    while((bucket = readdir(root)) != NULL) {
+        if(!lm_cache_is_bucket(bucket->d_name)) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", cache_root, bucket->d_name);
+        DIR *dir = opendir(path);
+        if(dir == NULL) {
+            continue;
+        }
+
+        while((item = readdir(dir)) != NULL) {
+            if(item->d_name[0] == '.' || strlen(item->d_name) != LM_HASH_HEX_LEN - 3) {
+                continue;
+            }
+
+            if(count == size) {
+                size = size ? size * 2 : 256;
+                lm_cache_entry_t *grow = realloc(entries, size * sizeof(*entries));
+                if(grow == NULL) {
+                    break;
+                }
+                entries = grow;
+            }
+
+            lm_cache_entry_t *entry = &entries[count];
+            snprintf(entry->name, sizeof(entry->name), "%s/%s", bucket->d_name, item->d_name);
+            snprintf(path, sizeof(path), "%s/%s", cache_root, entry->name);
+
+            if(lm_cache_read_info(path, obj_hex, &entry->size) != LM_OK) {
+                entry->size = 0;
+            }
+
+            snprintf(path, sizeof(path), "%s/%s/info", cache_root, entry->name);
+            entry->used = stat(path, &st) == 0 ? (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec : 0;
+
+            total += entry->size;
+            count++;
+        }
+        closedir(dir);
+    }
+    closedir(root);
+
+    if(total > capacity) {
+        long long target = capacity / 100 * LM_CACHE_EVICT_PERCENT;
+
+        qsort(entries, count, sizeof(*entries), lm_cache_entry_cmp);
+        for(int i = 0; i < count && total > target; i++) {
+            snprintf(path, sizeof(path), "%s/%s", cache_root, entries[i].name);
+            if(lm_rm(path) == 0) {
+                total -= entries[i].size;
+            }
+        }
+    }
+
+    free(entries);
+    return total;
+}
+
+
+static void lm_cache_account(long long hits, long long misses, long long size)
+{
+    lm_cache_stat_t stat;
+    long long capacity = lm_cache_capacity();
+
+    int fd = lm_cache_lock();
+
+    lm_cache_stat_read(&stat);
+    stat.hits += hits;
+    stat.misses += misses;
+    stat.size += size;
+
+    if(stat.size > capacity) {
+        stat.size = lm_cache_evict(capacity);
+    }
+
+    lm_cache_stat_write(&stat);
+    lm_cache_unlock(fd);
+}
+
+
+static void lm_cache_mkdirs(void)
+{
+    char path[LM_CACHE_MAX_PATH];
+
+    lm_mkdir(cache_root);
+
+    snprintf(path, sizeof(path), "%s/compilers", cache_root);
+    lm_mkdir(path);
+
+    snprintf(path, sizeof(path), "%s/tmp", cache_root);
+    lm_mkdir(path);
+}
+
+
+int lm_cache_exec(int argc, char *argv[])
+{
+    char entry[LM_CACHE_MAX_PATH];
+    char hex[LM_HASH_HEX_LEN];
+    lm_cache_cmd_t cmd;
+
+    if(argc < 1) {
+        LM_LOG_ERROR("--cache-exec needs a compile command");
+        return 1;
+    }
+
+    cache_root = getenv(LM_CACHE_DIR_ENV);
+    lm_cache_scan(&cmd, argc, argv);
+
+    if(cache_root == NULL || cache_root[0] == '\0' || !cmd.cacheable) {
+        return lm_cache_spawn(argv);
+    }
+
+    lm_cache_mkdirs();
+
+    // a failing preprocess is reported by the real compile below
+    if(lm_cache_key(&cmd, hex) != LM_OK) {
+        return lm_cache_spawn(argv);
+    }
+
+    snprintf(entry, sizeof(entry), "%s/%.2s/%s", cache_root, hex, hex + 2);
+    if(lm_cache_restore(&cmd, entry)) {
+        lm_cache_account(1, 0, 0);
+        return 0;
+    }
+
+    // a stale entry (e.g. the object was rewritten through a hardlink) is replaced
+    long long stale = 0;
+    char obj_hex[LM_HASH_HEX_LEN];
+    if(lm_cache_read_info(entry, obj_hex, &stale) != LM_OK || lm_rm(entry) != 0) {
+        stale = 0;
+    }
+
+    // break any hardlink into the cache before the compiler writes the object
+    remove(cmd.obj);
+
+    int ret = lm_cache_spawn(argv);
+    if(ret == 0) {
+        lm_cache_account(0, 1, lm_cache_insert(&cmd, entry, hex) - stale);
+    }
+
+    return ret;
+}
+
+
+int lm_cache_stats(void)
+{
+    lm_cache_stat_t stat;
+
+    cache_root = getenv(LM_CACHE_DIR_ENV);
+    if(cache_root == NULL || cache_root[0] == '\0') {
+        printf("object cache is disabled, set %s to enable it\n", LM_CACHE_DIR_ENV);
+        return 1;
+    }
+
+    int fd = lm_cache_lock();
+    lm_cache_stat_read(&stat);
+    lm_cache_unlock(fd);
+
+    long long lookups = stat.hits + stat.misses;
+
+    printf("cache directory:  %s\n", cache_root);
+    printf("hits:             %lld\n", stat.hits);
+    printf("misses:           %lld\n", stat.misses);
+    printf("hit rate:         %.1f%%\n", lookups ? stat.hits * 100.0 / lookups : 0.0);
+    printf("size:             %.1f MB / %lld MB\n", stat.size / 1048576.0, lm_cache_capacity() / 1048576);
+    return 0;
+}
+
+
+#else
+
+
+int lm_cache_exec(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    LM_LOG_ERROR("the object cache is only supported on linux");
+    return 1;
+}
+
+
+int lm_cache_stats(void)
+{
+    LM_LOG_ERROR("the object cache is only supported on linux");
+    return 1;
+}
+
+
+#endif
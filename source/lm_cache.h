@@ -0,0 +1,57 @@
+/* source/lm_cache.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_CACHE_H__
+#define __LM_CACHE_H__
+
+
+#define    LM_CACHE_DIR_ENV         "LM_CACHE_DIR"
+#define    LM_CACHE_SIZE_ENV        "LM_CACHE_SIZE"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Run one compile command through the object cache in $LM_CACHE_DIR. The key
+ * is the preprocessed input, the flags and the compiler identity; on a hit the
+ * object, .d and .lst files are restored instead of compiling. Without
+ * LM_CACHE_DIR the command is run as is. Returns the process exit code.
+ */
+int lm_cache_exec(int argc, char *argv[]);
+
+
+/**
+ * Print the hit/miss statistics and size of the cache in $LM_CACHE_DIR.
+ */
+int lm_cache_stats(void);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_CACHE_H__
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include "lm_cmd.h"
 #include <stdlib.h>
 #include <stdio.h>
@@ -5,8 +7,15 @@
 #include <dirent.h>
 #include <sys/stat.h>
 #if ( __linux__)
+#include <errno.h>
 #include <sys/types.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
 #endif
 
 
@@ -15,22 +24,366 @@ static int lm_rmfile(const char *path) {
 }
 
 
+#if ( __linux__)
+
+#define    LM_RM_MAX_THREADS        8
+#define    LM_RM_QUEUE_PER_THREAD   2
+#define    LM_RM_TOMBSTONE          ".lm-rm."
+
+
+/*
+ * A directory being emptied. Its fd stays open until every subdirectory has
+ * been removed through it; pending counts its own scan plus those subdirectories.
+ */
+typedef struct lm_rm_node {
+    struct lm_rm_node *parent;
+    struct lm_rm_node *next;
+    int fd;
+    int pending;
+    char name[];
+}lm_rm_node_t;
+
+
+typedef struct lm_rm_ctx {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    lm_rm_node_t *queue;
+    int queued;
+    int busy;
+    int workers;
+    bool failed;
+}lm_rm_ctx_t;
+
+
+static lm_rm_node_t *lm_rm_node_new(lm_rm_node_t *parent, int fd, const char *name)
+{
+    lm_rm_node_t *node = malloc(sizeof(lm_rm_node_t) + strlen(name) + 1);
+    if(node == NULL) {
+        close(fd);
+        return NULL;
+    }
+
+    node->parent = parent;
+    node->next = NULL;
+    node->fd = fd;
+    node->pending = 1;
+    strcpy(node->name, name);
+
+    return node;
+}
+
+
+// drop one pending count, remove the directory once nothing in it is left, and carry on upwards
+static void lm_rm_node_done(lm_rm_ctx_t *ctx, lm_rm_node_t *node)
+{
+    pthread_mutex_lock(&ctx->lock);
+
+    while(node && --node->pending == 0) {
+        lm_rm_node_t *parent = node->parent;
+
+        close(node->fd);
+        if(unlinkat(parent ? parent->fd : AT_FDCWD, node->name, AT_REMOVEDIR) != 0 && errno != ENOENT) {
+            ctx->failed = true;
+        }
+
+        free(node);
+        node = parent;
+    }
+
+    pthread_mutex_unlock(&ctx->lock);
+}
+
+
+/*
+ * Unlink the files of one directory through its fd. Subdirectories go to the
+ * queue while other workers are short of work, else they are emptied right
+ * here, depth first. Entries of one directory are not split across threads,
+ * they all contend for the same directory inode lock anyway.
+ */
+static void lm_rm_scan(lm_rm_ctx_t *ctx, lm_rm_node_t *node)
+{
+    int dir_fd = dup(node->fd);
+    DIR *dir = dir_fd < 0 ? NULL : fdopendir(dir_fd);
+    struct dirent *entry;
+    struct stat st;
+    bool failed = false;
+
+    if(dir == NULL) {
+        if(dir_fd >= 0) {
+            close(dir_fd);
+        }
+        failed = true;
+    }
+
+    while(dir && (entry = readdir(dir)) != NULL) {
+        if(strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        bool is_dir = entry->d_type == DT_DIR;
+        if(entry->d_type == DT_UNKNOWN) {
+            is_dir = fstatat(node->fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        if(!is_dir) {
+            if(unlinkat(node->fd, entry->d_name, 0) != 0 && errno != ENOENT) {
+                failed = true;
+            }
+            continue;
+        }
+
+        int fd = openat(node->fd, entry->d_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+        lm_rm_node_t *child = fd < 0 ? NULL : lm_rm_node_new(node, fd, entry->d_name);
+        if(child == NULL) {
+            failed = true;
+            continue;
+        }
+
+        pthread_mutex_lock(&ctx->lock);
+        node->pending++;
+
+        bool hand_out = ctx->queued < ctx->workers * LM_RM_QUEUE_PER_THREAD;
+        if(hand_out) {
+            child->next = ctx->queue;
+            ctx->queue = child;
+            ctx->queued++;
+            pthread_cond_signal(&ctx->cond);
+        }
+        pthread_mutex_unlock(&ctx->lock);
+
+        if(!hand_out) {
+            lm_rm_scan(ctx, child);
+            lm_rm_node_done(ctx, child);
+        }
+    }
+
+    if(dir) {
+        closedir(dir);
+    }
+
+    if(failed) {
+        pthread_mutex_lock(&ctx->lock);
+        ctx->failed = true;
+        pthread_mutex_unlock(&ctx->lock);
+    }
+}
+
+
+static void *lm_rm_worker(void *arg)
+{
+    lm_rm_ctx_t *ctx = arg;
+
+    pthread_mutex_lock(&ctx->lock);
+
+    for(;;) {
+        while(ctx->queue == NULL && ctx->busy > 0) {
+            pthread_cond_wait(&ctx->cond, &ctx->lock);
+        }
+
+        // nothing queued and nobody left who could queue more
+        if(ctx->queue == NULL) {
+            break;
+        }
+
+        lm_rm_node_t *node = ctx->queue;
+        ctx->queue = node->next;
+        ctx->queued--;
+        ctx->busy++;
+        pthread_mutex_unlock(&ctx->lock);
+
+        lm_rm_scan(ctx, node);
+        lm_rm_node_done(ctx, node);
+
+        pthread_mutex_lock(&ctx->lock);
+        if(--ctx->busy == 0 && ctx->queue == NULL) {
+            pthread_cond_broadcast(&ctx->cond);
+        }
+    }
+
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+}
+
+
 int lm_rm(const char *dir_name)
 {
-    DIR *dir;
+    struct stat path_stat;
+    pthread_t threads[LM_RM_MAX_THREADS];
+    lm_rm_ctx_t ctx = {0};
+
+    if (lstat(dir_name, &path_stat) != 0) {
+        return 0;
+    }
+
+    // a symlink to a directory (build/current) is removed, not followed
+    if (!S_ISDIR(path_stat.st_mode)) {
+        return lm_rmfile(dir_name);
+    }
+
+    int fd = open(dir_name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    lm_rm_node_t *root = fd < 0 ? NULL : lm_rm_node_new(NULL, fd, dir_name);
+    if(root == NULL) {
+        return -1;
+    }
+
+    // every level of a deep tree holds its directory fd until its children are gone
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    ctx.workers = cpus < 1 ? 1 : cpus > LM_RM_MAX_THREADS ? LM_RM_MAX_THREADS : (int)cpus;
+    ctx.queue = root;
+    ctx.queued = 1;
+    pthread_mutex_init(&ctx.lock, NULL);
+    pthread_cond_init(&ctx.cond, NULL);
+
+    int started = 1;
+    while(started < ctx.workers && pthread_create(&threads[started], NULL, lm_rm_worker, &ctx) == 0) {
+        started++;
+    }
+
+    lm_rm_worker(&ctx);
+
+    for(int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&ctx.cond);
+    pthread_mutex_destroy(&ctx.lock);
+
+    return ctx.failed ? -1 : 0;
+}
+
+
+// tombstones left behind by an interrupted background delete of the same path
+static void lm_rm_tombstones(const char *path)
+{
+    char *copy = strdup(path);
+    if(copy == NULL) {
+        return;
+    }
+
+    char *slash = strrchr(copy, '/');
+    const char *base = slash ? slash + 1 : copy;
+    const char *parent = slash ? (slash == copy ? "/" : copy) : ".";
+    if(slash) {
+        *slash = '\0';
+    }
+
+    size_t base_len = strlen(base);
+    size_t mark_len = strlen(LM_RM_TOMBSTONE);
+
+    int fd = open(parent, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR *dir = fd < 0 ? NULL : fdopendir(fd);
     struct dirent *entry;
-    char path[1024];
+
+    while(dir && (entry = readdir(dir)) != NULL) {
+        if(strncmp(entry->d_name, base, base_len) == 0 && strncmp(entry->d_name + base_len, LM_RM_TOMBSTONE, mark_len) == 0) {
+            size_t len = strlen(parent) + strlen(entry->d_name) + 2;
+            char *stale = malloc(len);
+            if(stale) {
+                snprintf(stale, len, "%s/%s", parent, entry->d_name);
+                lm_rm(stale);
+                free(stale);
+            }
+        }
+    }
+
+    if(dir) {
+        closedir(dir);
+    }
+    else if(fd >= 0) {
+        close(fd);
+    }
+    free(copy);
+}
+
+
+int lm_rm_async(const char *dir_name)
+{
     struct stat path_stat;
 
-    if (stat(dir_name, &path_stat) == 0) {
-        if (S_ISREG(path_stat.st_mode)) {
-            return lm_rmfile(dir_name);
+    if (lstat(dir_name, &path_stat) != 0) {
+        return 0;
+    }
+
+    if (!S_ISDIR(path_stat.st_mode)) {
+        return lm_rmfile(dir_name);
+    }
+
+    // rename beside the original, same filesystem, so the name is free the moment we return
+    size_t len = strlen(dir_name);
+    while(len > 1 && dir_name[len - 1] == '/') {
+        len--;
+    }
+
+    size_t size = len + strlen(LM_RM_TOMBSTONE) + 16;
+    char *tombstone = malloc(size);
+    if(tombstone == NULL) {
+        return lm_rm(dir_name);
+    }
+    snprintf(tombstone, size, "%.*s%s%d", (int)len, dir_name, LM_RM_TOMBSTONE, (int)getpid());
+
+    if(rename(dir_name, tombstone) != 0) {
+        free(tombstone);
+        return lm_rm(dir_name);
+    }
+
+    pid_t pid = fork();
+    if(pid < 0) {
+        int ret = lm_rm(tombstone);
+        free(tombstone);
+        return ret;
+    }
+
+    if(pid == 0) {
+        // detach from make: new session, and no hold on the pipes its output may go through
+        setsid();
+        int null_fd = open("/dev/null", O_RDWR);
+        if(null_fd >= 0) {
+            dup2(null_fd, STDIN_FILENO);
+            dup2(null_fd, STDOUT_FILENO);
+            dup2(null_fd, STDERR_FILENO);
+            if(null_fd > STDERR_FILENO) {
+                close(null_fd);
+            }
         }
+
+        lm_rm(tombstone);
+        tombstone[len] = '\0';
+        lm_rm_tombstones(tombstone);
+        _exit(0);
     }
-    else {
+
+    free(tombstone);
+    return 0;
+}
+
+#else
+
+int lm_rm(const char *dir_name)
+{
+    DIR *dir;
+    struct dirent *entry;
+    char path[1024];
+    struct stat path_stat;
+
+#if (_WIN32)
+    if (stat(dir_name, &path_stat) != 0) {
+#else
+    if (lstat(dir_name, &path_stat) != 0) {
+#endif
         return 0;
     }
 
+    // a symlink to a directory (build/current) is removed, not followed
+    if (!S_ISDIR(path_stat.st_mode)) {
+        return lm_rmfile(dir_name);
+    }
+
     dir = opendir(dir_name);
     if (!dir) {
         return -1;
@@ -42,7 +395,7 @@ int lm_rm(const char *dir_name)
         }
         
         snprintf(path, sizeof(path), "%s/%s", dir_name, entry->d_name);
-        lm_rmfile(path);
+        lm_rm(path);
     }
     closedir(dir);
     
@@ -54,6 +407,14 @@ int lm_rm(const char *dir_name)
 }
 
 
+int lm_rm_async(const char *dir_name)
+{
+    return lm_rm(dir_name);
+}
+
+#endif
+
+
 int lm_mkdir(const char *dir_name)
 {
 #if (_WIN32)
@@ -67,16 +428,131 @@ int lm_mkdir(const char *dir_name)
 #define BUFFER_SIZE (1024 * 128)  // 128 KB
 
 
+#if ( __linux__)
+
+// whatever the kernel can do without bouncing the data through user space, the buffer loop last
+static int lm_copy_fd(int src, int dst, off_t size)
+{
+    if(ioctl(dst, FICLONE, src) == 0) {
+        return 0;
+    }
+
+    // each step continues from the offsets the previous one stopped at
+    off_t left = size;
+    while(left > 0) {
+        ssize_t len = copy_file_range(src, NULL, dst, NULL, left, 0);
+        if(len <= 0) {
+            break;
+        }
+        left -= len;
+    }
+
+    while(left > 0) {
+        ssize_t len = sendfile(dst, src, NULL, left);
+        if(len <= 0) {
+            break;
+        }
+        left -= len;
+    }
+
+    if(left == 0) {
+        return 0;
+    }
+
+    char *buffer = malloc(BUFFER_SIZE);
+    if(buffer == NULL) {
+        return -1;
+    }
+
+    ssize_t len;
+    while((len = read(src, buffer, BUFFER_SIZE)) > 0) {
+        for(ssize_t done = 0; done < len; ) {
+            ssize_t ret = write(dst, buffer + done, len - done);
+            if(ret < 0) {
+                free(buffer);
+                return -1;
+            }
+            done += ret;
+        }
+    }
+
+    free(buffer);
+    return len < 0 ? -1 : 0;
+}
+
+
+/*
+ * Copy with the mode and timestamps of the source, so a staged artifact does
+ * not look newer than what it was built from. A destination that already has
+ * the same contents is left alone, and a new one is written beside it and
+ * renamed into place, never through a hardlink that may share its inode.
+ */
+int lm_copy_file(const char *source_path, const char *dest_path)
+{
+    struct stat src_st;
+    struct stat dst_st;
+
+    if(source_path == NULL || dest_path == NULL) {
+        LM_LOG_ERROR("missing destination path");
+        return -1;
+    }
+
+    int src = open(source_path, O_RDONLY | O_CLOEXEC);
+    if(src < 0 || fstat(src, &src_st) != 0) {
+        LM_LOG_ERROR("can not open file: %s\n", source_path);
+        if(src >= 0) {
+            close(src);
+        }
+        return -1;
+    }
+
+    if(stat(dest_path, &dst_st) == 0 && S_ISREG(dst_st.st_mode) && dst_st.st_size == src_st.st_size) {
+        bool same_inode = dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino;
+        if(same_inode || lm_file_is_same(source_path, dest_path)) {
+            close(src);
+            return 0;
+        }
+    }
+
+    size_t size = strlen(dest_path) + 32;
+    char *tmp_path = malloc(size);
+    if(tmp_path == NULL) {
+        close(src);
+        return -1;
+    }
+    snprintf(tmp_path, size, "%s.lm-cp.%d", dest_path, (int)getpid());
+
+    int dst = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if(dst < 0) {
+        LM_LOG_ERROR("can not create file: %s\n", dest_path);
+        close(src);
+        free(tmp_path);
+        return -1;
+    }
+
+    struct timespec times[2] = { src_st.st_atim, src_st.st_mtim };
+    int ret = lm_copy_fd(src, dst, src_st.st_size);
+
+    if(ret == 0) {
+        fchmod(dst, src_st.st_mode & 07777);
+        futimens(dst, times);
+    }
+
+    close(src);
+    if(close(dst) != 0 || ret != 0 || rename(tmp_path, dest_path) != 0) {
+        LM_LOG_ERROR("can not write file: %s\n", dest_path);
+        unlink(tmp_path);
+        ret = -1;
+    }
+
+    free(tmp_path);
+    return ret;
+}
+
+#else
+
 int lm_copy_file(const char *source_path, const char *dest_path) 
 {
-    #if (_WIN32)
-    #define    FSEEK  fseeko
-    #define    FTELL  ftello
-    #elif ( __linux__)
-    #define    FSEEK  fseek
-    #define    FTELL  ftell
-    #endif
-    
     if(source_path == NULL || dest_path == NULL) {
         LM_LOG_ERROR("missing destination path");
         return -1;
@@ -98,30 +574,112 @@ int lm_copy_file(const char *source_path, const char *dest_path)
     char *buffer = malloc(BUFFER_SIZE);
     if(!buffer) {
         LM_LOG_ERROR("can not allocate memory\n");
+        fclose(src);
+        fclose(dst);
+        return -1;
     }
 
-    memset(buffer, 0, BUFFER_SIZE);
-
     size_t bytes_read;
-    unsigned long long total_bytes = 0;
-
-    FSEEK(src, 0, SEEK_END);
-    off_t file_size = FTELL(src);
-    rewind(src);
+    int ret = 0;
 
     while ((bytes_read = fread(buffer, 1, BUFFER_SIZE, src)) > 0) {
-        fwrite(buffer, 1, bytes_read, dst);
-        total_bytes += bytes_read;
-
-        if (file_size > 0 && total_bytes % (file_size / 100) == 0) {
-            fflush(stdout);
+        if (fwrite(buffer, 1, bytes_read, dst) != bytes_read) {
+            ret = -1;
+            break;
         }
     }
 
     fclose(src);
-    fclose(dst);
+    if (fclose(dst) != 0) {
+        ret = -1;
+    }
     free(buffer);
-    return 0;
+    return ret;
+}
+
+#endif
+
+
+// reflink when the filesystem can share extents, else hardlink (if allowed), else copy
+int lm_clone_file(const char *source_path, const char *dest_path, bool allow_link)
+{
+    remove(dest_path);
+
+#if ( __linux__)
+    struct stat st;
+
+    int src = open(source_path, O_RDONLY);
+    if(src < 0) {
+        return -1;
+    }
+
+    int dst = open(dest_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(dst >= 0) {
+        int ret = ioctl(dst, FICLONE, src);
+
+        // same metadata as the link and copy fallbacks give
+        if(ret == 0 && fstat(src, &st) == 0) {
+            struct timespec times[2] = { st.st_atim, st.st_mtim };
+            fchmod(dst, st.st_mode & 07777);
+            futimens(dst, times);
+        }
+        close(dst);
+
+        if(ret == 0) {
+            close(src);
+            return 0;
+        }
+        remove(dest_path);
+    }
+    close(src);
+
+    if(allow_link && link(source_path, dest_path) == 0) {
+        return 0;
+    }
+#else
+    (void)allow_link;
+#endif
+
+    return lm_copy_file(source_path, dest_path);
+}
+
+
+#define COMPARE_SIZE (1024 * 16)
+
+
+bool lm_file_is_same(const char *path_a, const char *path_b)
+{
+    char buf_a[COMPARE_SIZE];
+    char buf_b[COMPARE_SIZE];
+    bool same = true;
+
+    FILE *file_a = fopen(path_a, "rb");
+    if(!file_a) {
+        return false;
+    }
+
+    FILE *file_b = fopen(path_b, "rb");
+    if(!file_b) {
+        fclose(file_a);
+        return false;
+    }
+
+    while(same) {
+        size_t len_a = fread(buf_a, 1, COMPARE_SIZE, file_a);
+        size_t len_b = fread(buf_b, 1, COMPARE_SIZE, file_b);
+
+        if(len_a != len_b || memcmp(buf_a, buf_b, len_a) != 0) {
+            same = false;
+        }
+
+        if(len_a < COMPARE_SIZE) {
+            break;
+        }
+    }
+
+    fclose(file_a);
+    fclose(file_b);
+    return same;
 }
 
 
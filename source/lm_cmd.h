@@ -2,12 +2,16 @@
 #define __LM_CMD_H__
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "lm_log.h"
 
 
 int lm_rm(const char *dir_name);
+int lm_rm_async(const char *dir_name);
 int lm_mkdir(const char *dir_name);
 int lm_copy_file(const char *source_path, const char *dest_path);
+int lm_clone_file(const char *source_path, const char *dest_path, bool allow_link);
+bool lm_file_is_same(const char *path_a, const char *path_b);
 void lm_echo(const char *info);
 void lm_echo_red(const char *info);
 void lm_echo_green(const char *info);
@@ -0,0 +1,1576 @@
+/* source/lm_dep.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "lm_dep.h"
+#include "lm_sat.h"
+#include "lm_parser.h"
+#include "lm_macro.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+#include "lm_hash.h"
+
+
+#define    LM_DEP_MAX_PATH          1024
+#define    LM_DEP_MAX_STATES        (1 << 20)
+#define    LM_DEP_WHY_DEPTH         8
+
+/* configs resolved together, one bit each; four words fill a 256 bit vector register */
+#define    LM_DEP_BLOCK_WORDS       4
+#define    LM_DEP_BLOCK             (LM_DEP_BLOCK_WORDS * 64)
+#define    LM_DEP_MAX_LINE          4096
+
+/* postfix opcodes, operands are macro indexes */
+#define    LM_DEP_NOT               -1
+#define    LM_DEP_AND               -2
+#define    LM_DEP_OR                -3
+
+
+typedef struct lm_dep_var {
+    lm_macro_t *macro;
+    int *rpn;
+    int rpn_len;
+    int rpn_size;
+    int64_t min;        // number macros take the integers min..max
+    int values;         // size of the value domain
+    int n_index;        // index of the "n" choice, -1 when there is none
+    int last_use;       // last macro whose depends refers to this one
+}lm_dep_var_t;
+
+
+static struct lm_dep_model {
+    lm_dep_var_t *vars;
+    int count;
+    int words;          // uint64_t words per truth bitset
+    int *stack;
+
+    bool solver;        // clauses of the model are loaded in the solver
+    bool *can_on;       // some valid configuration enables the macro
+    bool *can_off;
+}model;
+
+
+static bool lm_dep_is_name_char(char c)
+{
+    return c != '\0' && c != ' ' && c != '&' && c != '|' && c != '!' && c != '(' && c != ')';
+}
+
+
+static int lm_dep_emit(lm_dep_var_t *var, int op)
+{
+    if(var->rpn_len == var->rpn_size) {
+        var->rpn_size = var->rpn_size ? var->rpn_size * 2 : 16;
+        int *grow = realloc(var->rpn, var->rpn_size * sizeof(int));
+        if(grow == NULL) {
+            return LM_ERR;
+        }
+        var->rpn = grow;
+    }
+
+    var->rpn[var->rpn_len++] = op;
+    return LM_OK;
+}
+
+
+static int lm_dep_compile_or(lm_dep_var_t *var, int index, const char **p);
+
+
+static void lm_dep_skip_space(const char **p)
+{
+    while(**p == ' ' || **p == '\t') {
+        (*p)++;
+    }
+}
+
+
+// same grammar as the parser: '!' binds tightest, then '&', then '|'
+static int lm_dep_compile_factor(lm_dep_var_t *var, int index, const char **p)
+{
+    lm_dep_skip_space(p);
+
+    if(**p == '!') {
+        (*p)++;
+        if(lm_dep_compile_factor(var, index, p) != LM_OK) {
+            return LM_ERR;
+        }
+        return lm_dep_emit(var, LM_DEP_NOT);
+    }
+
+    if(**p == '(') {
+        (*p)++;
+        if(lm_dep_compile_or(var, index, p) != LM_OK) {
+            return LM_ERR;
+        }
+
+        lm_dep_skip_space(p);
+        if(**p != ')') {
+            LM_LOG_ERROR("%s: missing ')' in depends", var->macro->name);
+            return LM_ERR;
+        }
+        (*p)++;
+        return LM_OK;
+    }
+
+    int len = 0;
+    while(lm_dep_is_name_char((*p)[len])) {
+        len++;
+    }
+
+    if(len == 0) {
+        LM_LOG_ERROR("%s: invalid depends '%s'", var->macro->name, var->macro->depend);
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < index; i++) {
+        const char *name = model.vars[i].macro->name;
+        if((int)strlen(name) == len && strncmp(name, *p, len) == 0) {
+            *p += len;
+            model.vars[i].last_use = index;
+            return lm_dep_emit(var, i);
+        }
+    }
+
+    LM_LOG_ERROR("%s: depends on %.*s, which is not declared before it", var->macro->name, len, *p);
+    return LM_ERR;
+}
+
+
+static int lm_dep_compile_and(lm_dep_var_t *var, int index, const char **p)
+{
+    if(lm_dep_compile_factor(var, index, p) != LM_OK) {
+        return LM_ERR;
+    }
+
+    lm_dep_skip_space(p);
+    while(**p == '&') {
+        (*p)++;
+        if(lm_dep_compile_factor(var, index, p) != LM_OK || lm_dep_emit(var, LM_DEP_AND) != LM_OK) {
+            return LM_ERR;
+        }
+        lm_dep_skip_space(p);
+    }
+
+    return LM_OK;
+}
+
+
+static int lm_dep_compile_or(lm_dep_var_t *var, int index, const char **p)
+{
+    if(lm_dep_compile_and(var, index, p) != LM_OK) {
+        return LM_ERR;
+    }
+
+    lm_dep_skip_space(p);
+    while(**p == '|') {
+        (*p)++;
+        if(lm_dep_compile_and(var, index, p) != LM_OK || lm_dep_emit(var, LM_DEP_OR) != LM_OK) {
+            return LM_ERR;
+        }
+        lm_dep_skip_space(p);
+    }
+
+    return LM_OK;
+}
+
+
+static void lm_dep_domain(lm_dep_var_t *var)
+{
+    lm_macro_t *macro = var->macro;
+
+    var->n_index = -1;
+
+    if(lm_macro_type_get(macro) == LM_MACRO_NUMBER) {
+        int64_t lo = (int64_t)macro->range.min;
+        int64_t hi = (int64_t)macro->range.max;
+
+        if(lo < macro->range.min) {
+            lo++;
+        }
+        if(hi > macro->range.max) {
+            hi--;
+        }
+
+        var->min = lo;
+        var->values = hi < lo ? 0 : (hi - lo >= INT_MAX ? INT_MAX : (int)(hi - lo + 1));
+        return;
+    }
+
+    lm_list_node_t *node;
+    int index = 0;
+
+    lm_list_for_each(node, &macro->choice.head) {
+        if(strcmp(container_of(node, lm_array_node_t, node)->string, "n") == 0) {
+            var->n_index = index;
+        }
+        index++;
+    }
+
+    var->values = index;
+}
+
+
+void lm_dep_free(void)
+{
+    for(int i = 0; i < model.count; i++) {
+        free(model.vars[i].rpn);
+    }
+
+    free(model.vars);
+    free(model.stack);
+    free(model.can_on);
+    free(model.can_off);
+    lm_sat_free();
+    memset(&model, 0, sizeof(model));
+}
+
+
+int lm_dep_load(void)
+{
+    lm_macro_head_t *head = lm_parser_get_macro_head();
+    lm_list_node_t *node;
+    int max_rpn = 1;
+
+    lm_dep_free();
+
+    model.vars = calloc(head->count + 1, sizeof(lm_dep_var_t));
+    if(model.vars == NULL) {
+        LM_LOG_ERROR("out of memory");
+        return LM_ERR;
+    }
+
+    lm_list_for_each(node, &head->node) {
+        lm_dep_var_t *var = &model.vars[model.count];
+
+        var->macro = container_of(node, lm_macro_t, node);
+        var->last_use = -1;
+        lm_dep_domain(var);
+
+        if(var->macro->depend) {
+            const char *p = var->macro->depend;
+
+            if(lm_dep_compile_or(var, model.count, &p) != LM_OK) {
+                lm_dep_free();
+                return LM_ERR;
+            }
+
+            lm_dep_skip_space(&p);
+            if(*p != '\0') {
+                LM_LOG_ERROR("%s: invalid depends '%s'", var->macro->name, var->macro->depend);
+                lm_dep_free();
+                return LM_ERR;
+            }
+        }
+
+        if(var->rpn_len > max_rpn) {
+            max_rpn = var->rpn_len;
+        }
+        model.count++;
+    }
+
+    model.words = (model.count + 63) / 64 + 1;
+    model.stack = malloc(max_rpn * sizeof(int));
+    if(model.stack == NULL) {
+        lm_dep_free();
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
+
+static bool lm_dep_bit(const uint64_t *bits, int index)
+{
+    return (bits[index / 64] >> (index % 64)) & 1;
+}
+
+
+static void lm_dep_set_bit(uint64_t *bits, int index, bool on)
+{
+    if(on) {
+        bits[index / 64] |= (uint64_t)1 << (index % 64);
+    }
+    else {
+        bits[index / 64] &= ~((uint64_t)1 << (index % 64));
+    }
+}
+
+
+// bits holds whether each earlier macro is enabled
+static bool lm_dep_eval(const lm_dep_var_t *var, const uint64_t *bits)
+{
+    int top = 0;
+
+    if(var->rpn_len == 0) {
+        return true;
+    }
+
+    for(int i = 0; i < var->rpn_len; i++) {
+        int op = var->rpn[i];
+
+        if(op >= 0) {
+            model.stack[top++] = lm_dep_bit(bits, op);
+        }
+        else if(op == LM_DEP_NOT) {
+            model.stack[top - 1] = !model.stack[top - 1];
+        }
+        else {
+            top--;
+            if(op == LM_DEP_AND) {
+                model.stack[top - 1] = model.stack[top - 1] && model.stack[top];
+            }
+            else {
+                model.stack[top - 1] = model.stack[top - 1] || model.stack[top];
+            }
+        }
+    }
+
+    return model.stack[0];
+}
+
+
+// value index -1 is "n" for a macro turned off by its depends
+static void lm_dep_value(const lm_dep_var_t *var, int index, char *buf, int size)
+{
+    if(index < 0) {
+        snprintf(buf, size, "n");
+        return;
+    }
+
+    if(lm_macro_type_get(var->macro) == LM_MACRO_NUMBER) {
+        snprintf(buf, size, "%lld", (long long)(var->min + index));
+        return;
+    }
+
+    lm_list_node_t *node;
+    lm_list_for_each(node, &var->macro->choice.head) {
+        if(index-- == 0) {
+            snprintf(buf, size, "%s", container_of(node, lm_array_node_t, node)->string);
+            return;
+        }
+    }
+}
+
+
+static int lm_dep_write(const char *outdir, const char *prefix, int number, const int *choice, const char *note)
+{
+    char path[LM_DEP_MAX_PATH];
+    char value[LM_DEP_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s/%s_%06d.config", outdir, prefix, number);
+
+    FILE *file = fopen(path, "w");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not create %s", path);
+        return LM_ERR;
+    }
+
+    fprintf(file, "# lite-manager %s\n", note);
+
+    for(int i = 0; i < model.count; i++) {
+        lm_dep_value(&model.vars[i], choice[i], value, sizeof(value));
+        fprintf(file, "%s=%s\n", model.vars[i].macro->name, value);
+    }
+
+    fclose(file);
+    return LM_OK;
+}
+
+
+static uint64_t lm_dep_random(uint64_t *state)
+{
+    // splitmix64
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+
+int lm_dep_randconfig(const char *outdir, uint64_t seed, int count)
+{
+    uint64_t *bits = calloc(model.words, sizeof(uint64_t));
+    int *choice = calloc(model.count + 1, sizeof(int));
+    uint64_t state = seed;
+    char note[128];
+    int ret = LM_OK;
+
+    if(bits == NULL || choice == NULL) {
+        ret = LM_ERR;
+        goto exit;
+    }
+
+    lm_mkdir(outdir);
+    snprintf(note, sizeof(note), "randconfig, seed %llu", (unsigned long long)seed);
+
+    for(int n = 0; n < count && ret == LM_OK; n++) {
+        for(int i = 0; i < model.count; i++) {
+            lm_dep_var_t *var = &model.vars[i];
+
+            if(var->values == 0 || !lm_dep_eval(var, bits)) {
+                choice[i] = -1;
+            }
+            else {
+                choice[i] = (int)(lm_dep_random(&state) % (uint64_t)var->values);
+            }
+
+            lm_dep_set_bit(bits, i, choice[i] >= 0 && choice[i] != var->n_index);
+        }
+
+        ret = lm_dep_write(outdir, "rand", n, choice, note);
+    }
+
+    if(ret == LM_OK) {
+        printf("%d configurations written to %s\n", count, outdir);
+    }
+
+exit:
+    free(bits);
+    free(choice);
+    return ret;
+}
+
+
+static struct lm_dep_walk_state {
+    const char *outdir;
+    uint64_t *bits;
+    int *choice;
+    int written;
+    int limit;
+    int ret;
+}walk;
+
+
+static void lm_dep_walk(int index)
+{
+    if(walk.written >= walk.limit || walk.ret != LM_OK) {
+        return;
+    }
+
+    if(index == model.count) {
+        walk.ret = lm_dep_write(walk.outdir, "enum", walk.written++, walk.choice, "enumerate");
+        return;
+    }
+
+    lm_dep_var_t *var = &model.vars[index];
+
+    if(var->values == 0 || !lm_dep_eval(var, walk.bits)) {
+        walk.choice[index] = -1;
+        lm_dep_set_bit(walk.bits, index, false);
+        lm_dep_walk(index + 1);
+        return;
+    }
+
+    for(int k = 0; k < var->values; k++) {
+        walk.choice[index] = k;
+        lm_dep_set_bit(walk.bits, index, k != var->n_index);
+        lm_dep_walk(index + 1);
+    }
+}
+
+
+int lm_dep_enumerate(const char *outdir, int count)
+{
+    memset(&walk, 0, sizeof(walk));
+    walk.outdir = outdir;
+    walk.limit = count;
+    walk.bits = calloc(model.words, sizeof(uint64_t));
+    walk.choice = calloc(model.count + 1, sizeof(int));
+
+    if(walk.bits == NULL || walk.choice == NULL) {
+        walk.ret = LM_ERR;
+    }
+    else if(count > 0) {
+        lm_mkdir(outdir);
+        lm_dep_walk(0);
+    }
+
+    if(walk.ret == LM_OK) {
+        printf("%d configurations written to %s\n", walk.written, outdir);
+    }
+
+    free(walk.bits);
+    free(walk.choice);
+    return walk.ret;
+}
+
+
+/*
+ * Counting keeps one layer of distinct states per macro. A state only holds
+ * the enabled bits of macros that a later depends still reads, so macros
+ * nobody depends on never multiply the number of states.
+ */
+typedef struct lm_dep_layer {
+    uint64_t *bits;
+    uint64_t *ways;
+    int count;
+    int size;
+    int *slots;
+    int slot_size;
+}lm_dep_layer_t;
+
+
+static bool lm_dep_overflow;
+
+
+static uint64_t lm_dep_add(uint64_t a, uint64_t b)
+{
+    if(a > UINT64_MAX - b) {
+        lm_dep_overflow = true;
+        return UINT64_MAX;
+    }
+    return a + b;
+}
+
+
+static uint64_t lm_dep_mul(uint64_t a, uint64_t b)
+{
+    if(a != 0 && b > UINT64_MAX / a) {
+        lm_dep_overflow = true;
+        return UINT64_MAX;
+    }
+    return a * b;
+}
+
+
+static uint64_t lm_dep_hash_bits(const uint64_t *bits)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+
+    for(int i = 0; i < model.words; i++) {
+        h = (h ^ bits[i]) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+
+static void lm_dep_layer_reset(lm_dep_layer_t *layer)
+{
+    layer->count = 0;
+    for(int i = 0; i < layer->slot_size; i++) {
+        layer->slots[i] = -1;
+    }
+}
+
+
+static int lm_dep_layer_grow(lm_dep_layer_t *layer)
+{
+    int size = layer->size ? layer->size * 2 : 64;
+    uint64_t *bits = realloc(layer->bits, (size_t)size * model.words * sizeof(uint64_t));
+    if(bits == NULL) {
+        return LM_ERR;
+    }
+    layer->bits = bits;
+
+    uint64_t *ways = realloc(layer->ways, (size_t)size * sizeof(uint64_t));
+    if(ways == NULL) {
+        return LM_ERR;
+    }
+    layer->ways = ways;
+    layer->size = size;
+
+    int *slots = realloc(layer->slots, (size_t)size * 2 * sizeof(int));
+    if(slots == NULL) {
+        return LM_ERR;
+    }
+    layer->slots = slots;
+    layer->slot_size = size * 2;
+
+    for(int i = 0; i < layer->slot_size; i++) {
+        layer->slots[i] = -1;
+    }
+
+    for(int i = 0; i < layer->count; i++) {
+        int slot = lm_dep_hash_bits(&layer->bits[(size_t)i * model.words]) & (layer->slot_size - 1);
+        while(layer->slots[slot] >= 0) {
+            slot = (slot + 1) & (layer->slot_size - 1);
+        }
+        layer->slots[slot] = i;
+    }
+
+    return LM_OK;
+}
+
+
+static int lm_dep_layer_add(lm_dep_layer_t *layer, const uint64_t *bits, uint64_t ways)
+{
+    if(ways == 0) {
+        return LM_OK;
+    }
+
+    if(layer->count == layer->size && lm_dep_layer_grow(layer) != LM_OK) {
+        return LM_ERR;
+    }
+
+    size_t bytes = model.words * sizeof(uint64_t);
+    int slot = lm_dep_hash_bits(bits) & (layer->slot_size - 1);
+
+    while(layer->slots[slot] >= 0) {
+        int index = layer->slots[slot];
+        if(memcmp(&layer->bits[(size_t)index * model.words], bits, bytes) == 0) {
+            layer->ways[index] = lm_dep_add(layer->ways[index], ways);
+            return LM_OK;
+        }
+        slot = (slot + 1) & (layer->slot_size - 1);
+    }
+
+    memcpy(&layer->bits[(size_t)layer->count * model.words], bits, bytes);
+    layer->ways[layer->count] = ways;
+    layer->slots[slot] = layer->count++;
+
+    return LM_OK;
+}
+
+
+static void lm_dep_layer_free(lm_dep_layer_t *layer)
+{
+    free(layer->bits);
+    free(layer->ways);
+    free(layer->slots);
+}
+
+
+int lm_dep_count(void)
+{
+    lm_dep_layer_t layer[2] = {{0}};
+    uint64_t *bits = calloc(model.words, sizeof(uint64_t));
+    uint64_t total = 0;
+    int ret = LM_OK;
+
+    lm_dep_overflow = false;
+
+    if(bits == NULL || lm_dep_layer_grow(&layer[0]) != LM_OK || lm_dep_layer_grow(&layer[1]) != LM_OK) {
+        ret = LM_ERR;
+        goto exit;
+    }
+
+    lm_dep_layer_add(&layer[0], bits, 1);
+
+    for(int i = 0; i < model.count && ret == LM_OK; i++) {
+        lm_dep_layer_t *cur = &layer[i % 2];
+        lm_dep_layer_t *next = &layer[(i + 1) % 2];
+        lm_dep_var_t *var = &model.vars[i];
+        uint64_t on_values = var->values - (var->n_index >= 0);
+
+        lm_dep_layer_reset(next);
+
+        for(int s = 0; s < cur->count && ret == LM_OK; s++) {
+            memcpy(bits, &cur->bits[(size_t)s * model.words], model.words * sizeof(uint64_t));
+            uint64_t ways = cur->ways[s];
+            bool enabled = var->values > 0 && lm_dep_eval(var, bits);
+
+            // macros read for the last time here are dropped from the state
+            for(int j = 0; j <= i; j++) {
+                if(model.vars[j].last_use <= i) {
+                    lm_dep_set_bit(bits, j, false);
+                }
+            }
+
+            if(!enabled) {
+                ret = lm_dep_layer_add(next, bits, ways);
+                continue;
+            }
+
+            ret = lm_dep_layer_add(next, bits, lm_dep_mul(ways, var->n_index >= 0));
+            if(var->last_use > i) {
+                lm_dep_set_bit(bits, i, true);
+            }
+            if(ret == LM_OK) {
+                ret = lm_dep_layer_add(next, bits, lm_dep_mul(ways, on_values));
+            }
+        }
+
+        if(next->count > LM_DEP_MAX_STATES) {
+            LM_LOG_ERROR("too many macro combinations to count at %s", var->macro->name);
+            ret = LM_ERR;
+        }
+    }
+
+    if(ret == LM_OK) {
+        lm_dep_layer_t *last = &layer[model.count % 2];
+        for(int s = 0; s < last->count; s++) {
+            total = lm_dep_add(total, last->ways[s]);
+        }
+
+        if(lm_dep_overflow) {
+            printf("more than %llu valid configurations\n", (unsigned long long)UINT64_MAX);
+        }
+        else {
+            printf("%llu valid configurations\n", (unsigned long long)total);
+        }
+    }
+
+exit:
+    free(bits);
+    lm_dep_layer_free(&layer[0]);
+    lm_dep_layer_free(&layer[1]);
+    return ret;
+}
+
+
+/*
+ * Solver variable i is "macro i is enabled", followed by one variable per
+ * '&' and '|' of the depends. A macro that has an "n" choice may be off
+ * even when its depends hold; any other macro is on exactly when they hold.
+ */
+static int lm_dep_sat_depends(const lm_dep_var_t *var)
+{
+    int *stack = model.stack;
+    int top = 0;
+
+    for(int i = 0; i < var->rpn_len; i++) {
+        int op = var->rpn[i];
+
+        if(op >= 0) {
+            stack[top++] = LM_SAT_LIT(op, false);
+            continue;
+        }
+
+        if(op == LM_DEP_NOT) {
+            stack[top - 1] = LM_SAT_NEG(stack[top - 1]);
+            continue;
+        }
+
+        int a = stack[top - 2];
+        int b = stack[top - 1];
+        int t = LM_SAT_LIT(lm_sat_new_var(), false);
+
+        if(op == LM_DEP_AND) {
+            int c[3][3] = {{LM_SAT_NEG(t), a}, {LM_SAT_NEG(t), b}, {t, LM_SAT_NEG(a), LM_SAT_NEG(b)}};
+            lm_sat_add_clause(c[0], 2);
+            lm_sat_add_clause(c[1], 2);
+            lm_sat_add_clause(c[2], 3);
+        }
+        else {
+            int c[3][3] = {{t, LM_SAT_NEG(a)}, {t, LM_SAT_NEG(b)}, {LM_SAT_NEG(t), a, b}};
+            lm_sat_add_clause(c[0], 2);
+            lm_sat_add_clause(c[1], 2);
+            lm_sat_add_clause(c[2], 3);
+        }
+
+        stack[--top - 1] = t;
+    }
+
+    return stack[0];
+}
+
+
+static void lm_dep_sat_mark(bool *can_on, bool *can_off)
+{
+    for(int i = 0; i < model.count; i++) {
+        if(lm_sat_value(i)) {
+            can_on[i] = true;
+        }
+        else {
+            can_off[i] = true;
+        }
+    }
+}
+
+
+/*
+ * Which macros can be on and which can be off under the assumptions. Every
+ * model found settles all macros at once, so only the ones no model has
+ * shown yet need a solve of their own. assume has room for one more literal.
+ */
+static int lm_dep_sat_range(int *assume, int count, bool *can_on, bool *can_off)
+{
+    memset(can_on, 0, model.count * sizeof(bool));
+    memset(can_off, 0, model.count * sizeof(bool));
+
+    for(int phase = 1; phase >= 0; phase--) {
+        for(int i = 0; i < model.count; i++) {
+            lm_sat_set_phase(i, phase);
+        }
+        if(lm_sat_solve(assume, count) != LM_SAT_SAT) {
+            return LM_ERR;
+        }
+        lm_dep_sat_mark(can_on, can_off);
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        for(int neg = 0; neg < 2; neg++) {
+            if(neg ? can_off[i] : can_on[i]) {
+                continue;
+            }
+
+            assume[count] = LM_SAT_LIT(i, neg);
+            if(lm_sat_solve(assume, count + 1) == LM_SAT_SAT) {
+                lm_dep_sat_mark(can_on, can_off);
+            }
+        }
+    }
+
+    return LM_OK;
+}
+
+
+static int lm_dep_sat_build(void)
+{
+    int assume[1];
+
+    if(model.solver) {
+        return LM_OK;
+    }
+
+    model.can_on = malloc((model.count + 1) * sizeof(bool));
+    model.can_off = malloc((model.count + 1) * sizeof(bool));
+
+    if(model.can_on == NULL || model.can_off == NULL || lm_sat_init() != LM_OK) {
+        LM_LOG_ERROR("out of memory");
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        lm_sat_new_var();
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        lm_dep_var_t *var = &model.vars[i];
+        int on = LM_SAT_LIT(i, false);
+        int off = LM_SAT_LIT(i, true);
+
+        if(var->values == 0) {
+            lm_sat_add_clause(&off, 1);
+        }
+        else if(var->rpn_len == 0) {
+            if(var->n_index < 0) {
+                lm_sat_add_clause(&on, 1);
+            }
+        }
+        else {
+            int depends = lm_dep_sat_depends(var);
+            int c[2][2] = {{off, depends}, {on, LM_SAT_NEG(depends)}};
+
+            lm_sat_add_clause(c[0], 2);
+            if(var->n_index < 0) {
+                lm_sat_add_clause(c[1], 2);
+            }
+        }
+    }
+
+    model.solver = true;
+
+    // every macro has a value once the ones before it are set, so this never fails
+    return lm_dep_sat_range(assume, 0, model.can_on, model.can_off);
+}
+
+
+static int lm_dep_find(const char *name)
+{
+    for(int i = 0; i < model.count; i++) {
+        if(strcmp(model.vars[i].macro->name, name) == 0) {
+            return i;
+        }
+    }
+
+    LM_LOG_ERROR("macro %s is not declared", name);
+    return -1;
+}
+
+
+// print why a dead macro can not be enabled, following dead macros its depends name
+static void lm_dep_why(int index, int depth, int max_depth, char *shown)
+{
+    lm_dep_var_t *var = &model.vars[index];
+    bool chained = false;
+
+    if(var->values == 0) {
+        printf("%*s%s has no value in its range\n", depth * 2, "", var->macro->name);
+        return;
+    }
+
+    printf("%*s%s depends on '%s'\n", depth * 2, "", var->macro->name, var->macro->depend + strspn(var->macro->depend, " "));
+
+    if(shown[index]) {
+        return;
+    }
+    shown[index] = 1;
+
+    for(int i = 0; i < var->rpn_len; i++) {
+        int op = var->rpn[i];
+        if(op < 0 || model.can_on[op]) {
+            continue;
+        }
+
+        if(!shown[op] && depth < max_depth) {
+            lm_dep_why(op, depth + 1, max_depth, shown);
+        }
+        else if(!shown[op]) {
+            printf("%*s%s can never be enabled either\n", depth * 2 + 2, "", model.vars[op].macro->name);
+            shown[op] = 1;
+        }
+        chained = true;
+    }
+
+    if(!chained) {
+        printf("%*swhich contradicts the depends of the macros it names\n", depth * 2 + 2, "");
+    }
+}
+
+
+static bool lm_dep_enabled_now(const lm_dep_var_t *var)
+{
+    const char *value = var->macro->value;
+    return value != NULL && strcmp(value, "n") != 0 && strcmp(value, " ") != 0;
+}
+
+
+/*
+ * The solver only knows whether a macro is enabled, an enabled macro may
+ * take any value of its domain but "n". A value is printed only when that
+ * leaves a single one.
+ */
+static void lm_dep_print_change(const lm_dep_var_t *var, bool on)
+{
+    const char *follows = var->n_index < 0 ? "  (follows its depends)" : "";
+    char value[LM_DEP_MAX_PATH] = "n";
+    int len = 0;
+
+    if(on && var->values - (var->n_index >= 0) == 1) {
+        lm_dep_value(var, var->n_index == 0 ? 1 : 0, value, sizeof(value));
+    }
+    else if(on && lm_macro_type_get(var->macro) == LM_MACRO_NUMBER) {
+        printf("  %s enabled (any of %lld..%lld)%s\n", var->macro->name,
+               (long long)var->min, (long long)(var->min + var->values - 1), follows);
+        return;
+    }
+    else if(on) {
+        for(int i = 0; i < var->values && len < (int)sizeof(value) - 1; i++) {
+            if(i != var->n_index) {
+                len += snprintf(value + len, sizeof(value) - len, "%s", len ? ", " : "");
+                lm_dep_value(var, i, value + len, sizeof(value) - len);
+                len += strlen(value + len);
+            }
+        }
+
+        printf("  %s enabled (any of %s)%s\n", var->macro->name, value, follows);
+        return;
+    }
+
+    printf("  %s=%s%s\n", var->macro->name, value, follows);
+}
+
+
+/*
+ * Start from a model close to the current configuration (the saved phases
+ * are the current values), then put back each changed macro that has an
+ * "n" choice whenever the others still allow it. What is left is a set of
+ * changes none of which can be dropped.
+ */
+static int lm_dep_print_path(int index)
+{
+    int *assume = malloc((model.count + 1) * sizeof(int));
+    char *now = malloc(model.count);
+    char *flip = malloc(model.count);
+    int changes = 0;
+
+    if(assume == NULL || now == NULL || flip == NULL) {
+        free(assume);
+        free(now);
+        free(flip);
+        LM_LOG_ERROR("out of memory");
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        now[i] = lm_dep_enabled_now(&model.vars[i]);
+        lm_sat_set_phase(i, now[i]);
+    }
+
+    assume[0] = LM_SAT_LIT(index, false);
+    lm_sat_solve(assume, 1);
+
+    for(int i = 0; i < model.count; i++) {
+        flip[i] = lm_sat_value(i) != now[i];
+    }
+
+    for(int v = 0; v < model.count; v++) {
+        lm_dep_var_t *var = &model.vars[v];
+        if(!flip[v] || v == index || var->n_index < 0 || var->values == 0) {
+            continue;
+        }
+
+        flip[v] = 0;
+
+        int count = 1;
+        for(int i = 0; i < model.count; i++) {
+            if(i != index && model.vars[i].n_index >= 0 && model.vars[i].values > 0) {
+                assume[count++] = LM_SAT_LIT(i, now[i] == flip[i]);
+            }
+        }
+
+        if(lm_sat_solve(assume, count) == LM_SAT_SAT) {
+            for(int i = 0; i < model.count; i++) {
+                flip[i] = lm_sat_value(i) != now[i];
+            }
+        }
+        else {
+            flip[v] = 1;
+        }
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        if(flip[i]) {
+            lm_dep_print_change(&model.vars[i], !now[i]);
+            changes++;
+        }
+    }
+
+    if(changes == 0) {
+        printf("  nothing to change\n");
+    }
+
+    free(assume);
+    free(now);
+    free(flip);
+    return LM_OK;
+}
+
+
+int lm_dep_can_enable(const char *name, bool path)
+{
+    int index = lm_dep_find(name);
+
+    if(index < 0 || lm_dep_sat_build() != LM_OK) {
+        return LM_ERR;
+    }
+
+    if(!model.can_on[index]) {
+        char *shown = calloc(model.count, 1);
+        printf("%s can never be enabled:\n", name);
+        if(shown != NULL) {
+            lm_dep_why(index, 1, LM_DEP_WHY_DEPTH, shown);
+        }
+        free(shown);
+        return LM_ERR;
+    }
+
+    if(!path) {
+        printf("%s can be enabled\n", name);
+        return LM_OK;
+    }
+
+    printf("changes to the current configuration that enable %s:\n", name);
+    return lm_dep_print_path(index);
+}
+
+
+int lm_dep_forced_by(const char *name)
+{
+    int index = lm_dep_find(name);
+
+    if(index < 0 || lm_dep_sat_build() != LM_OK) {
+        return LM_ERR;
+    }
+
+    if(!model.can_on[index]) {
+        printf("%s can never be enabled\n", name);
+        return LM_ERR;
+    }
+
+    bool *can_on = malloc(model.count * sizeof(bool));
+    bool *can_off = malloc(model.count * sizeof(bool));
+    int assume[2] = { LM_SAT_LIT(index, false) };
+    int forced = 0;
+    int ret = LM_ERR;
+
+    if(can_on == NULL || can_off == NULL) {
+        LM_LOG_ERROR("out of memory");
+        goto exit;
+    }
+
+    ret = lm_dep_sat_range(assume, 1, can_on, can_off);
+    if(ret != LM_OK) {
+        goto exit;
+    }
+
+    printf("enabling %s forces:\n", name);
+
+    // macros that never move in any configuration are left out
+    for(int i = 0; i < model.count; i++) {
+        if(i == index || !model.can_on[i] || !model.can_off[i]) {
+            continue;
+        }
+
+        if(!can_on[i] || !can_off[i]) {
+            lm_dep_print_change(&model.vars[i], can_on[i]);
+            forced++;
+        }
+    }
+
+    if(forced == 0) {
+        printf("  nothing\n");
+    }
+
+exit:
+    free(can_on);
+    free(can_off);
+    return ret;
+}
+
+
+int lm_dep_check(bool verbose)
+{
+    if(lm_dep_sat_build() != LM_OK) {
+        return LM_ERR;
+    }
+
+    char *shown = calloc(model.count, 1);
+    int dead = 0;
+
+    if(shown == NULL) {
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        if(model.can_on[i]) {
+            continue;
+        }
+
+        LM_LOG_WARN("%s can never be enabled:", model.vars[i].macro->name);
+        // every dead macro gets its own entry, one level of the chain is enough
+        memset(shown, 0, model.count);
+        lm_dep_why(i, 1, 1, shown);
+        dead++;
+    }
+
+    if(verbose) {
+        printf("%d macros checked, %d can never be enabled\n", model.count, dead);
+    }
+
+    free(shown);
+    return dead == 0 ? LM_OK : LM_ERR;
+}
+
+
+// everything lm_dep_check looks at: macro names, value domains and depends
+static void lm_dep_model_hash(char *hex)
+{
+    lm_macro_head_t *head = lm_parser_get_macro_head();
+    lm_list_node_t *node, *choice;
+    lm_hash_t hash;
+
+    lm_hash_init(&hash);
+
+    lm_list_for_each(node, &head->node) {
+        lm_macro_t *macro = container_of(node, lm_macro_t, node);
+
+        lm_hash_string(&hash, macro->name);
+        lm_hash_string(&hash, macro->depend ? macro->depend : "");
+        lm_hash_update(&hash, &macro->range, sizeof(macro->range));
+
+        lm_list_for_each(choice, &macro->choice.head) {
+            lm_hash_string(&hash, container_of(choice, lm_array_node_t, node)->string);
+        }
+        lm_hash_string(&hash, "");
+    }
+
+    lm_hash_final(&hash, hex);
+}
+
+
+int lm_dep_check_cached(const char *lmmk_file)
+{
+    char stamp[LM_DEP_MAX_PATH];
+    char hex[LM_HASH_HEX_LEN];
+    char old[LM_HASH_HEX_LEN] = {0};
+
+    snprintf(stamp, sizeof(stamp), "%s.dep", lmmk_file);
+    lm_dep_model_hash(hex);
+
+    FILE *file = fopen(stamp, "r");
+    if(file != NULL) {
+        if(fgets(old, sizeof(old), file) == NULL) {
+            old[0] = '\0';
+        }
+        fclose(file);
+
+        if(strcmp(old, hex) == 0) {
+            return LM_OK;
+        }
+    }
+
+    int ret = lm_dep_load();
+    if(ret == LM_OK) {
+        ret = lm_dep_check(false);
+    }
+    lm_dep_free();
+
+    // a model with dead macros keeps no stamp, so the warnings come back on every run
+    if(ret != LM_OK) {
+        remove(stamp);
+        return ret;
+    }
+
+    file = fopen(stamp, "w");
+    if(file != NULL) {
+        fprintf(file, "%s", hex);
+        fclose(file);
+    }
+
+    return LM_OK;
+}
+
+
+typedef struct lm_dep_block {
+    uint64_t *want;     // per macro, the config asks for a value other than "n"
+    uint64_t *bad;      // per macro, that value is not in the domain
+    bool *default_bad;  // per macro, the default is not in the domain
+    uint64_t *set;      // per macro, the config names it
+    uint64_t *on;       // per macro, resolved enable
+    uint64_t *stack;
+    int *order;         // macro indexes sorted by name
+    int fail_macro[LM_DEP_BLOCK];
+    int fail_line[LM_DEP_BLOCK];
+}lm_dep_block_t;
+
+
+static int lm_dep_name_cmp(const void *a, const void *b)
+{
+    return strcmp(model.vars[*(const int*)a].macro->name, model.vars[*(const int*)b].macro->name);
+}
+
+
+static int lm_dep_lookup(const int *order, const char *name)
+{
+    int lo = 0;
+    int hi = model.count - 1;
+
+    while(lo <= hi) {
+        int mid = (lo + hi) / 2;
+        int cmp = strcmp(model.vars[order[mid]].macro->name, name);
+
+        if(cmp == 0) {
+            return order[mid];
+        }
+        if(cmp < 0) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid - 1;
+        }
+    }
+
+    return -1;
+}
+
+
+static bool lm_dep_is_off(const char *value)
+{
+    return value == NULL || strcmp(value, "n") == 0 || strcmp(value, " ") == 0;
+}
+
+
+// what the parser resolves for a macro the config does not name, when its depends hold
+static void lm_dep_default(lm_macro_t *macro, bool *on, bool *bad)
+{
+    *bad = false;
+
+    if(macro->def_flag == 1 && macro->type == LM_MACRO_NUMBER) {
+        *on = true;
+        *bad = macro->def_num < macro->range.min || macro->def_num > macro->range.max;
+        return;
+    }
+
+    if(macro->def_flag == 1) {
+        *on = !lm_dep_is_off(macro->def_str);
+        *bad = !lm_macro_value_is_valid(macro, macro->def_str);
+        return;
+    }
+
+    *on = !lm_dep_is_off(lm_macro_choice_get_first(macro));
+}
+
+
+// same reading as lm_parser_config_file: the first line naming a macro wins
+static void lm_dep_read_config(lm_dep_block_t *block, const char *path, int lane)
+{
+    int word = lane / 64;
+    uint64_t bit = (uint64_t)1 << (lane % 64);
+    char line[LM_DEP_MAX_LINE];
+    char name[LM_DEP_MAX_LINE];
+    int line_count = 0;
+    int last = -1;
+
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        block->fail_line[lane] = 0;
+        return;
+    }
+
+    while(fgets(line, sizeof(line), file)) {
+        line_count++;
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if(line[0] == '#' || line[strspn(line, " \t")] == '\0') {
+            continue;
+        }
+
+        char *eq = strchr(line, '=');
+        if(eq == NULL) {
+            block->fail_line[lane] = line_count;
+            break;
+        }
+
+        int len = 0;
+        for(char *p = line; p < eq; p++) {
+            if(*p != ' ' && *p != '\t') {
+                name[len++] = *p;
+            }
+        }
+        name[len] = '\0';
+
+        // generated configs list the macros in declaration order, try the next one first
+        int index = last + 1;
+        if(index >= model.count || strcmp(model.vars[index].macro->name, name) != 0) {
+            index = lm_dep_lookup(block->order, name);
+        }
+        if(index < 0) {
+            continue;
+        }
+
+        uint64_t *set = &block->set[index * LM_DEP_BLOCK_WORDS + word];
+        if(*set & bit) {
+            continue;
+        }
+        *set |= bit;
+        last = index;
+
+        char *value = eq + 1;
+        value += strspn(value, " \t");
+        for(char *end = value + strlen(value); end > value && (end[-1] == ' ' || end[-1] == '\t'); end--) {
+            end[-1] = '\0';
+        }
+        if(*value == '\0') {
+            value = " ";
+        }
+
+        lm_macro_t *macro = model.vars[index].macro;
+        uint64_t *want = &block->want[index * LM_DEP_BLOCK_WORDS + word];
+        uint64_t *bad = &block->bad[index * LM_DEP_BLOCK_WORDS + word];
+        bool valid = true;
+
+        if(strcmp(value, "n") == 0) {
+            *want &= ~bit;
+        }
+        else {
+            valid = lm_macro_value_is_valid(macro, strcmp(value, "'n'") == 0 ? "n" : value);
+            *want = strcmp(value, " ") == 0 ? *want & ~bit : *want | bit;
+        }
+        *bad = valid ? *bad & ~bit : *bad | bit;
+    }
+
+    fclose(file);
+}
+
+
+// every operation works on LM_DEP_BLOCK_WORDS words, one lane per config
+static void lm_dep_eval_block(lm_dep_block_t *block, const lm_dep_var_t *var, uint64_t *out)
+{
+    uint64_t *stack = block->stack;
+    int top = 0;
+
+    if(var->rpn_len == 0) {
+        memset(out, 0xff, LM_DEP_BLOCK_WORDS * sizeof(uint64_t));
+        return;
+    }
+
+    for(int i = 0; i < var->rpn_len; i++) {
+        int op = var->rpn[i];
+
+        if(op >= 0) {
+            memcpy(&stack[top++ * LM_DEP_BLOCK_WORDS], &block->on[op * LM_DEP_BLOCK_WORDS], LM_DEP_BLOCK_WORDS * sizeof(uint64_t));
+            continue;
+        }
+
+        uint64_t *a = &stack[(top - 1) * LM_DEP_BLOCK_WORDS];
+
+        if(op == LM_DEP_NOT) {
+            for(int k = 0; k < LM_DEP_BLOCK_WORDS; k++) {
+                a[k] = ~a[k];
+            }
+            continue;
+        }
+
+        uint64_t *b = a;
+        a = &stack[(--top - 1) * LM_DEP_BLOCK_WORDS];
+
+        if(op == LM_DEP_AND) {
+            for(int k = 0; k < LM_DEP_BLOCK_WORDS; k++) {
+                a[k] &= b[k];
+            }
+        }
+        else {
+            for(int k = 0; k < LM_DEP_BLOCK_WORDS; k++) {
+                a[k] |= b[k];
+            }
+        }
+    }
+
+    memcpy(out, stack, LM_DEP_BLOCK_WORDS * sizeof(uint64_t));
+}
+
+
+static void lm_dep_resolve_block(lm_dep_block_t *block, char **configs, int lanes)
+{
+    size_t words = (size_t)model.count * LM_DEP_BLOCK_WORDS;
+    uint64_t depends[LM_DEP_BLOCK_WORDS];
+
+    memset(block->set, 0, words * sizeof(uint64_t));
+
+    memset(block->bad, 0, words * sizeof(uint64_t));
+
+    for(int i = 0; i < model.count; i++) {
+        bool on;
+
+        lm_dep_default(model.vars[i].macro, &on, &block->default_bad[i]);
+        for(int k = 0; k < LM_DEP_BLOCK_WORDS; k++) {
+            block->want[i * LM_DEP_BLOCK_WORDS + k] = on ? UINT64_MAX : 0;
+        }
+    }
+
+    for(int lane = 0; lane < lanes; lane++) {
+        block->fail_macro[lane] = -1;
+        block->fail_line[lane] = -1;
+        lm_dep_read_config(block, configs[lane], lane);
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        uint64_t *want = &block->want[i * LM_DEP_BLOCK_WORDS];
+        uint64_t *bad = &block->bad[i * LM_DEP_BLOCK_WORDS];
+        uint64_t *set = &block->set[i * LM_DEP_BLOCK_WORDS];
+        uint64_t *on = &block->on[i * LM_DEP_BLOCK_WORDS];
+
+        lm_dep_eval_block(block, &model.vars[i], depends);
+
+        /*
+         * The parser checks a value from the config as soon as the choices
+         * are read, before the depends, so those fail whatever the depends
+         * say; a default only matters when it is used.
+         */
+        for(int k = 0; k < LM_DEP_BLOCK_WORDS; k++) {
+            on[k] = depends[k] & want[k];
+            if(block->default_bad[i]) {
+                bad[k] |= depends[k] & ~set[k];
+            }
+
+            // rare, walk the failing lanes one by one
+            for(uint64_t fail = bad[k]; fail; fail &= fail - 1) {
+                int lane = k * 64 + __builtin_ctzll(fail);
+                if(lane < lanes && block->fail_macro[lane] < 0) {
+                    block->fail_macro[lane] = i;
+                }
+            }
+        }
+    }
+}
+
+
+int lm_dep_check_configs(char **configs, int count)
+{
+    lm_dep_block_t block = {0};
+    size_t words = (size_t)model.count * LM_DEP_BLOCK_WORDS + 1;
+    int max_rpn = 1;
+    int failed = 0;
+    int ret = LM_ERR;
+
+    for(int i = 0; i < model.count; i++) {
+        if(model.vars[i].rpn_len > max_rpn) {
+            max_rpn = model.vars[i].rpn_len;
+        }
+    }
+
+    block.want = malloc(words * sizeof(uint64_t));
+    block.bad = malloc(words * sizeof(uint64_t));
+    block.set = malloc(words * sizeof(uint64_t));
+    block.on = malloc(words * sizeof(uint64_t));
+    block.stack = malloc((size_t)max_rpn * LM_DEP_BLOCK_WORDS * sizeof(uint64_t));
+    block.order = malloc((model.count + 1) * sizeof(int));
+    block.default_bad = malloc((model.count + 1) * sizeof(bool));
+    char *result = calloc(count + 1, sizeof(char));
+    int *reason = malloc((count + 1) * sizeof(int));
+
+    if(block.want == NULL || block.bad == NULL || block.set == NULL || block.on == NULL
+        || block.stack == NULL || block.order == NULL || block.default_bad == NULL || result == NULL || reason == NULL) {
+        LM_LOG_ERROR("out of memory");
+        goto exit;
+    }
+
+    for(int i = 0; i < model.count; i++) {
+        block.order[i] = i;
+    }
+    qsort(block.order, model.count, sizeof(int), lm_dep_name_cmp);
+
+    for(int first = 0; first < count; first += LM_DEP_BLOCK) {
+        int lanes = count - first < LM_DEP_BLOCK ? count - first : LM_DEP_BLOCK;
+
+        lm_dep_resolve_block(&block, configs + first, lanes);
+
+        // a config that can not be read fails before any value is looked at
+        for(int lane = 0; lane < lanes; lane++) {
+            bool fail = block.fail_line[lane] >= 0 || block.fail_macro[lane] >= 0;
+
+            result[first + lane] = fail;
+            reason[first + lane] = block.fail_line[lane] >= 0 ? -2 - block.fail_line[lane] : block.fail_macro[lane];
+            failed += fail;
+        }
+    }
+
+    printf("%d configs checked, %d passed, %d failed\n", count, count - failed, failed);
+
+    for(int i = 0; i < count; i++) {
+        if(!result[i]) {
+            continue;
+        }
+
+        printf("  %s\n", configs[i]);
+        if(reason[i] == -2) {
+            printf("      can not be opened\n");
+        }
+        else if(reason[i] < -2) {
+            printf("      line %d: syntax error\n", -2 - reason[i]);
+        }
+        else {
+            printf("      %s: invalid value\n", model.vars[reason[i]].macro->name);
+        }
+    }
+
+    ret = failed == 0 ? LM_OK : LM_ERR;
+
+exit:
+    free(block.want);
+    free(block.bad);
+    free(block.set);
+    free(block.on);
+    free(block.stack);
+    free(block.order);
+    free(block.default_bad);
+    free(result);
+    free(reason);
+    return ret;
+}
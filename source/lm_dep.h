@@ -0,0 +1,113 @@
+/* source/lm_dep.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_DEP_H__
+#define __LM_DEP_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Build the dependency model from the parsed macro list: the value domain of
+ * every macro and its depends expression compiled to postfix form. Depends
+ * can only name macros declared before, so the model is ordered.
+ */
+int lm_dep_load(void);
+
+
+/**
+ * Release the model built by lm_dep_load.
+ */
+void lm_dep_free(void);
+
+
+/**
+ * Print the number of valid configurations. Only macros that later depends
+ * expressions still refer to are tracked, so this does not walk every one.
+ */
+int lm_dep_count(void);
+
+
+/**
+ * Write the first count valid configurations, in choice order, as
+ * <outdir>/enum_NNNNNN.config.
+ */
+int lm_dep_enumerate(const char *outdir, int count);
+
+
+/**
+ * Write count random valid configurations as <outdir>/rand_NNNNNN.config.
+ * Each macro is drawn uniformly from its domain once its depends hold, so
+ * no configuration is ever rejected. The same seed gives the same files.
+ */
+int lm_dep_randconfig(const char *outdir, uint64_t seed, int count);
+
+
+/**
+ * Queries answered by a SAT solver over every depends and value domain.
+ * lm_dep_can_enable reports whether name is enabled by any valid
+ * configuration, or the chain of depends that rules it out; with path it
+ * also lists macros of the current configuration to change, none of them
+ * superfluous.
+ * lm_dep_forced_by lists the macros that enabling name turns on or off.
+ */
+int lm_dep_can_enable(const char *name, bool path);
+int lm_dep_forced_by(const char *name);
+
+
+/**
+ * Warn about every macro no valid configuration can enable, with the depends
+ * chain behind it. Returns LM_ERR when there is one.
+ */
+int lm_dep_check(bool verbose);
+
+
+/**
+ * lm_dep_check without the summary, skipped when the macro names, value
+ * domains and depends hash the same as the last check that found no dead
+ * macro. The hash is kept in <lmmk_file>.dep.
+ */
+int lm_dep_check_cached(const char *lmmk_file);
+
+
+/**
+ * Resolve which macros every config enables, 256 configs at a time: each
+ * config is one bit of a word per macro, so a depends is walked once per
+ * block with bitwise operations. Configs naming a value outside the domain
+ * of a macro fail, as they do in the parser.
+ */
+int lm_dep_check_configs(char **configs, int count);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_DEP_H__
@@ -5,16 +5,54 @@
 #include "lm_error.h"
 #include "lm_parser.h"
 #include "lm_string.h"
+#include "lm_cmd.h"
+#include "lm_hash.h"
+#include "lm_variant.h"
+#include "lm_unity.h"
+#include "lm_trace.h"
 
 
+#define    LM_GEN_TMP_SUFFIX        ".lmtmp"
+
+
+FILE *lm_gen_open(const char *file_path, char *tmp_path)
+{
+    snprintf(tmp_path, LM_GEN_MAX_PATH, "%s%s", file_path, LM_GEN_TMP_SUFFIX);
+    return fopen(tmp_path, "w");
+}
+
+
+// keep the old file and its timestamp when nothing changed, so make does not rebuild
+int lm_gen_commit(FILE *file, const char *file_path, const char *tmp_path)
+{
+    LM_TRACE_SCOPE("lm_gen_commit", file_path);
+    fclose(file);
+
+    if(lm_file_is_same(file_path, tmp_path)) {
+        remove(tmp_path);
+        return LM_OK;
+    }
+
+    remove(file_path);
+    if(rename(tmp_path, file_path) != 0) {
+        LM_LOG_ERROR("Failed to update the %s\n", file_path);
+        remove(tmp_path);
+        return LM_ERR;
+    }
+
+    return LM_OK;
+}
+
 
 int lm_gen_header_file(const char* file_path)
 {
+    LM_TRACE_SCOPE("lm_gen_header_file", file_path);
     lm_macro_head_t* macro_list = lm_parser_get_macro_head();
     lm_list_node_t *node = lm_list_next_node(&macro_list->node);
     lm_macro_t *macro = NULL;
+    char tmp_path[LM_GEN_MAX_PATH];
 
-    FILE* file = fopen(file_path, "w");
+    FILE* file = lm_gen_open(file_path, tmp_path);
     if (file == NULL) {
         printf("Failed to open or create the %s\n", file_path);
         return LM_ERR;
@@ -63,19 +101,58 @@ int lm_gen_header_file(const char* file_path)
     }
 
     fprintf(file, "\n\n#endif  //!__CONFIG_H__\n");
-    
-    fclose(file);
-    return LM_OK;
+
+    return lm_gen_commit(file, file_path, tmp_path);
+}
+
+
+// TARGET_MEMBER entries are <target>:<key>:<value>, make reads them as TARGET_<target>_<key>
+static void lm_gen_target_vars(FILE *file)
+{
+    static const char *keys[] = { "SRC", "ASM", "LDS", "LDFLAG" };
+    lm_array_t *targets = lm_parser_get_list(VAR_TARGETS);
+    lm_array_t *members = lm_parser_get_list(VAR_TARGET_MEMBER);
+    char prefix[LM_GEN_MAX_PATH];
+    lm_list_node_t *target_node;
+    lm_list_node_t *node;
+
+    lm_list_for_each(target_node, &targets->head) {
+        const char *target = container_of(target_node, lm_array_node_t, node)->string;
+
+        for(size_t i = 0; i < sizeof(keys) / sizeof(keys[0]); i++) {
+            int len = snprintf(prefix, sizeof(prefix), "%s:%s:", target, keys[i]);
+            bool found = false;
+
+            lm_list_for_each(node, &members->head) {
+                const char *member = container_of(node, lm_array_node_t, node)->string;
+                if(strncmp(member, prefix, len) != 0) {
+                    continue;
+                }
+
+                if(!found) {
+                    fprintf(file, "TARGET_%s_%s :=", target, keys[i]);
+                    found = true;
+                }
+                fprintf(file, " %s", member + len);
+            }
+
+            if(found) {
+                fprintf(file, "\n\n");
+            }
+        }
+    }
 }
 
 
 int lm_gen_lmmk_file(const char* file_path)
 {
+    LM_TRACE_SCOPE("lm_gen_lmmk_file", file_path);
     lm_macro_head_t* macro_list = lm_parser_get_macro_head();
     lm_list_node_t *node = lm_list_next_node(&macro_list->node);
     lm_macro_t *macro = NULL;
+    char tmp_path[LM_GEN_MAX_PATH];
 
-    FILE* file = fopen(file_path, "w");
+    FILE* file = lm_gen_open(file_path, tmp_path);
     if (file == NULL) {
         printf("Failed to open or create the %s\n", file_path);
         return LM_ERR;
@@ -103,7 +180,11 @@ int lm_gen_lmmk_file(const char* file_path)
         node = lm_list_next_node(node);
     }
 
+    char hex[LM_HASH_HEX_LEN];
+    lm_variant_hash(hex);
+
     fprintf(file, "\n# Variables provided for Makefile\n");
+    fprintf(file, "LM_CONFIG_HASH := %s\n", hex);
 
     int len = lm_parser_get_parser_list_count() / sizeof(lm_array_t);
     lm_array_t *list = (lm_array_t*)lm_parser_get_parser_list_head();
@@ -111,8 +192,8 @@ int lm_gen_lmmk_file(const char* file_path)
 
     for(int i = 0; i < len; i++) {
 
-        if(list->count != 0) {
-            name = lm_parser_get_parser_list_name(i);
+        name = lm_parser_get_parser_list_name(i);
+        if(list->count != 0 && strcmp(name, VAR_TARGET_MEMBER) != 0) {
             if(name != NULL) {
                 fprintf(file, "%s := ", name);
             }
@@ -124,14 +205,16 @@ int lm_gen_lmmk_file(const char* file_path)
         list ++;
     }
 
-    fclose(file);
-    return LM_OK;
+    lm_gen_target_vars(file);
+
+    return lm_gen_commit(file, file_path, tmp_path);
 }
 
 
 
 int lm_gen_projcfg_file(const char* file_path)
 {
+    LM_TRACE_SCOPE("lm_gen_projcfg_file", file_path);
     if(access(file_path, F_OK) == 0) {
         return LM_OK;
     }
@@ -153,9 +236,13 @@ int lm_gen_projcfg_file(const char* file_path)
 
 
 int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg, const char *projcfg, 
-                              const char *header_file, const char *pro_name, const char *build_dir, const char *gcc_prefix)
+                              const char *header_file, const char *pro_name, const char *build_dir, const char *gcc_prefix,
+                              bool variant)
 {
-    FILE* file = fopen(makefile, "w");
+    LM_TRACE_SCOPE("lm_gen_mkfile_file", makefile);
+    char tmp_path[LM_GEN_MAX_PATH];
+
+    FILE* file = lm_gen_open(makefile, tmp_path);
     if (file == NULL) {
         LM_LOG_ERROR("Failed to generate the %s file\n", makefile);
         return LM_ERR;
@@ -171,7 +258,14 @@ int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg
     }
 
     fprintf(file, "TARGET    := %s\n", pro_name);
-    fprintf(file, "BUILD_DIR := %s\n", build_dir);
+    if(variant) {
+        fprintf(file, "BUILD_ROOT := %s\n", build_dir);
+        fprintf(file, "LM_KEEP_VARIANTS ?= %d\n", LM_VARIANT_KEEP);
+        fprintf(file, "LM_VARIANT_AGE ?= %d\n", LM_VARIANT_AGE_DAYS);
+    }
+    else {
+        fprintf(file, "BUILD_DIR := %s\n", build_dir);
+    }
     fprintf(file, "\n\n");
 
     fprintf(file, "# include configuration file for makefile\n");
@@ -182,7 +276,13 @@ int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg
     fprintf(file, "check_lmmk:\n");
     fprintf(file, "\t@echo \"Please run 'make config'\"\n");
     fprintf(file, "endif\n");
-    fprintf(file, "\n\n");
+    fprintf(file, "\n");
+    if(variant) {
+        fprintf(file, "# one build directory per configuration, $(BUILD_ROOT)/%s is the active one\n", LM_VARIANT_CURRENT);
+        fprintf(file, "BUILD_DIR := $(BUILD_ROOT)/$(LM_CONFIG_HASH)\n");
+        fprintf(file, "\n");
+    }
+    fprintf(file, "\n");
 
     fprintf(file, "# toolchain\n");
     fprintf(file, "CC_PREFIX ?= %s\n", gcc_prefix);
@@ -191,8 +291,20 @@ int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg
     fprintf(file, "CP = $(CC_PREFIX)objcopy\n");
     fprintf(file, "SZ = $(CC_PREFIX)size\n");
     fprintf(file, "OD = $(CC_PREFIX)objdump\n");
+    fprintf(file, "AR = $(CC_PREFIX)ar\n");
     fprintf(file, "HEX = $(CP) -O ihex\n");
     fprintf(file, "BIN = $(CP) -O binary -S\n");
+    fprintf(file, "\n");
+    fprintf(file, "# object cache, enabled by setting LM_CACHE_DIR\n");
+    fprintf(file, "ifneq ($(LM_CACHE_DIR),)\n");
+    fprintf(file, "export LM_CACHE_DIR\n");
+    fprintf(file, "LM_CACHE := ./lm.exe --cache-exec\n");
+    fprintf(file, "endif\n");
+    fprintf(file, "# build timeline, enabled by setting LM_TIMELINE to a log file, read it with ./lm.exe --build-report\n");
+    fprintf(file, "ifneq ($(LM_TIMELINE),)\n");
+    fprintf(file, "export LM_TIMELINE\n");
+    fprintf(file, "LM_TIME = ./lm.exe --time-cmd $@\n");
+    fprintf(file, "endif\n");
     fprintf(file, "\n\n");
 
 
@@ -207,48 +319,109 @@ int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg
     }
     fprintf(file, "\n\n");
 
+    fprintf(file, "# build targets (TARGET blocks): each links the objects outside any block plus its own\n");
+    fprintf(file, "TARGET_ELF     = $(strip $(or $(TARGET_$(1)_LDS),$(%s)))\n", VAR_LDS_SOURCE);
+    fprintf(file, "TARGET_FILE    = $(BUILD_DIR)/$(1)$(if $(call TARGET_ELF,$(1)),.elf,.exe)\n");
+    fprintf(file, "TARGET_OUTPUTS = $(call TARGET_FILE,$(1)) $(if $(call TARGET_ELF,$(1)),$(BUILD_DIR)/$(1).hex $(BUILD_DIR)/$(1).bin)\n");
+    fprintf(file, "\n\n");
+
     fprintf(file, ".PHONY: all\n");
+    fprintf(file, "ifneq ($(%s),)\n", VAR_TARGETS);
+    fprintf(file, "all: $(foreach t,$(%s),$(call TARGET_OUTPUTS,$(t))) targets_info\n", VAR_TARGETS);
+    fprintf(file, "else\n");
     if(lm_parser_lds_is_empty()) {
         fprintf(file, "all: $(BUILD_DIR)/$(TARGET)%s elf_info\n", target);
     }
     else {
         fprintf(file, "all: $(BUILD_DIR)/$(TARGET)%s $(BUILD_DIR)/$(TARGET).hex $(BUILD_DIR)/$(TARGET).bin elf_info\n", target);
     }
+    fprintf(file, "endif\n");
     fprintf(file, "\n\n");
 
+    fprintf(file, "# unity build (UNITY key): batched sources are compiled through $(BUILD_DIR)/%s/unity_NNNN.c\n", LM_UNITY_DIR);
+    fprintf(file, "-include $(BUILD_DIR)/%s/%s\n", LM_UNITY_DIR, LM_UNITY_MK);
+    fprintf(file, "C_BUILD_SOURCE := $(filter-out $(UNITY_MEMBERS),$(%s)) $(UNITY_SOURCE)\n", VAR_C_SOURCE);
+    fprintf(file, "\n");
+
     fprintf(file, "# list of c and c++ program objects\n");
-    fprintf(file, "OBJECTS = $(addprefix $(BUILD_DIR)/,$(notdir $(patsubst %%.c, %%.o, $(patsubst %%.cpp, %%.o, $(%s)))))\n", VAR_C_SOURCE);
-    fprintf(file, "vpath %%.c $(sort $(dir $(%s)))\n", VAR_C_SOURCE);
-    fprintf(file, "vpath %%.cpp $(sort $(dir $(%s)))\n", VAR_C_SOURCE);
+    fprintf(file, "OBJECTS = $(addprefix $(BUILD_DIR)/,$(notdir $(patsubst %%.c, %%.o, $(patsubst %%.cpp, %%.o, $(C_BUILD_SOURCE)))))\n");
+    fprintf(file, "vpath %%.c $(sort $(dir $(C_BUILD_SOURCE)))\n");
+    fprintf(file, "vpath %%.cpp $(sort $(dir $(C_BUILD_SOURCE)))\n");
     fprintf(file, "# list of ASM program objects\n");
     fprintf(file, "OBJECTS += $(addprefix $(BUILD_DIR)/,$(notdir $(%s:.S=.o)))\n", VAR_ASM_SOURCE);
     fprintf(file, "vpath %%.S $(sort $(dir $(%s)))\n", VAR_ASM_SOURCE);
     fprintf(file, "\n\n");
 
+    fprintf(file, "# static libraries (LIBRARY blocks): each is a thin archive of its own objects,\n");
+    fprintf(file, "# rewritten only when one of them changes; the other objects are linked directly\n");
+    fprintf(file, "LM_LINK_GROUP ?= y\n");
+    fprintf(file, "comma := ,\n");
+    fprintf(file, "LIBRARY_OBJECTS = $(addprefix $(BUILD_DIR)/,$(notdir $(addsuffix .o,$(basename \\\n");
+    fprintf(file, "\t$(patsubst $(1):%%,%%,$(filter $(1):%%,$(%s)))))))\n", VAR_LIBRARY_MEMBER);
+    fprintf(file, "ARCHIVES = $(foreach l,$(%s),$(BUILD_DIR)/lib/lib$(l).a)\n", VAR_LIBRARY);
+    fprintf(file, "LINK_OBJECTS = $(filter-out $(foreach l,$(%s),$(call LIBRARY_OBJECTS,$(l))),$(OBJECTS))\n", VAR_LIBRARY);
+    fprintf(file, "ifneq ($(LM_LINK_GROUP),)\n");
+    fprintf(file, "LINK_ARCHIVES = $(if $(ARCHIVES),-Wl$(comma)--start-group $(ARCHIVES) -Wl$(comma)--end-group)\n");
+    fprintf(file, "else\n");
+    fprintf(file, "LINK_ARCHIVES = $(ARCHIVES)\n");
+    fprintf(file, "endif\n");
+    fprintf(file, "\n");
+    fprintf(file, "define LM_LIBRARY_RULE\n");
+    fprintf(file, "$(BUILD_DIR)/lib/lib$(1).a: $(call LIBRARY_OBJECTS,$(1))\n");
+    fprintf(file, "\t@mkdir -p $$(@D)\n");
+    fprintf(file, "\t@echo \"AR   $$@\"\n");
+    fprintf(file, "\t@rm -f $$@\n");
+    fprintf(file, "\t@$$(LM_TIME) $$(AR) rcsT $$@ $$^\n");
+    fprintf(file, "endef\n");
+    fprintf(file, "$(foreach l,$(%s),$(eval $(call LM_LIBRARY_RULE,$(l))))\n", VAR_LIBRARY);
+    fprintf(file, "\n\n");
 
-    fprintf(file, "$(BUILD_DIR)/%%.o: %%.c Makefile | $(BUILD_DIR)\n");
+    fprintf(file, "# precompiled headers: a stub including each header is compiled once per language,\n");
+    fprintf(file, "# gcc uses stub.gch when the stub is force-included and the flags match;\n");
+    fprintf(file, "# stubs are named after the whole path, so a/common.h and b/common.h do not collide\n");
+    fprintf(file, "PCH_STUB = $(subst /,_,$(1))\n");
+    fprintf(file, "PCH_C   := $(if $(filter %%.c,$(%s)),$(addprefix $(BUILD_DIR)/pch/c/,$(addsuffix .gch,$(call PCH_STUB,$(%s)))))\n", VAR_C_SOURCE, VAR_PCH_SOURCE);
+    fprintf(file, "PCH_CXX := $(if $(filter %%.cpp,$(%s)),$(addprefix $(BUILD_DIR)/pch/cxx/,$(addsuffix .gch,$(call PCH_STUB,$(%s)))))\n", VAR_C_SOURCE, VAR_PCH_SOURCE);
+    fprintf(file, "PCH_C_FLAGS   := $(if $(PCH_C),$(addprefix -include ,$(PCH_C:.gch=)) -Winvalid-pch)\n");
+    fprintf(file, "PCH_CXX_FLAGS := $(if $(PCH_CXX),$(addprefix -include ,$(PCH_CXX:.gch=)) -Winvalid-pch)\n");
+    fprintf(file, "\n");
+    fprintf(file, "define LM_PCH_RULE\n");
+    fprintf(file, "$(BUILD_DIR)/pch/$(1)/$(call PCH_STUB,$(2)): Makefile\n");
+    fprintf(file, "\t@mkdir -p $$(@D)\n");
+    fprintf(file, "\t@echo '#include \"$(abspath $(2))\"' > $$@\n");
+    fprintf(file, "$(BUILD_DIR)/pch/$(1)/$(call PCH_STUB,$(2)).gch: $(BUILD_DIR)/pch/$(1)/$(call PCH_STUB,$(2))\n");
+    fprintf(file, "\t@echo \"PCH  $(2)\"\n");
+    fprintf(file, "\t@$$(LM_TIME) $$(CC) -x $(3) -c $$(CFLAGS) -MMD -MP -MF $$@.d $$< -o $$@\n");
+    fprintf(file, "endef\n");
+    fprintf(file, "$(foreach h,$(%s),$(eval $(call LM_PCH_RULE,c,$(h),c-header)))\n", VAR_PCH_SOURCE);
+    fprintf(file, "$(foreach h,$(%s),$(eval $(call LM_PCH_RULE,cxx,$(h),c++-header)))\n", VAR_PCH_SOURCE);
+    fprintf(file, "-include $(wildcard $(BUILD_DIR)/pch/*/*.d)\n");
+    fprintf(file, "\n\n");
+
+
+    fprintf(file, "$(BUILD_DIR)/%%.o: %%.c Makefile $(PCH_C) | $(BUILD_DIR)\n");
     fprintf(file, "\t@echo \"CC   $<\"\n");
-    fprintf(file, "\t@$(CC) -c $(CFLAGS) -MMD -MP \\\n");
+    fprintf(file, "\t@$(LM_TIME) $(LM_CACHE) $(CC) -c $(CFLAGS) $(PCH_C_FLAGS) -MMD -MP \\\n");
     fprintf(file, "\t\t-MF  $(BUILD_DIR)/$(notdir $(<:.c=.d)) \\\n");
     fprintf(file, "\t\t-Wa,-a,-ad,-alms=$(BUILD_DIR)/$(notdir $(<:.c=.lst)) $< -o $@\n");
     fprintf(file, "\n");
 
-    fprintf(file, "$(BUILD_DIR)/%%.o: %%.cpp Makefile | $(BUILD_DIR)\n");
+    fprintf(file, "$(BUILD_DIR)/%%.o: %%.cpp Makefile $(PCH_CXX) | $(BUILD_DIR)\n");
     fprintf(file, "\t@echo \"CC   $<\"\n");
-    fprintf(file, "\t@$(CC) -c $(CFLAGS) -MMD -MP \\\n");
+    fprintf(file, "\t@$(LM_TIME) $(LM_CACHE) $(CC) -c $(CFLAGS) $(PCH_CXX_FLAGS) -MMD -MP \\\n");
     fprintf(file, "\t\t-MF  $(BUILD_DIR)/$(notdir $(<:.cpp=.d)) \\\n");
     fprintf(file, "\t\t-Wa,-a,-ad,-alms=$(BUILD_DIR)/$(notdir $(<:.cpp=.lst)) $< -o $@\n");
     fprintf(file, "\n");
 
     fprintf(file, "$(BUILD_DIR)/%%.o: %%.S Makefile | $(BUILD_DIR)\n");
     fprintf(file, "\t@echo \"AS   $<\"\n");
-    fprintf(file, "\t@$(AS) -c $(ASFLAGS) -MMD -MP  \\\n");
+    fprintf(file, "\t@$(LM_TIME) $(LM_CACHE) $(AS) -c $(ASFLAGS) -MMD -MP  \\\n");
     fprintf(file, "\t\t-MF $(BUILD_DIR)/$(notdir $(<:.S=.d)) $< -o $@\n");
     fprintf(file, "\n\n");
 
-    fprintf(file, "$(BUILD_DIR)/$(TARGET)%s: $(OBJECTS) Makefile\n", target);
+    fprintf(file, "$(BUILD_DIR)/$(TARGET)%s: $(LINK_OBJECTS) $(ARCHIVES) Makefile\n", target);
     fprintf(file, "\t@echo \"LD   $@\"\n");
-    fprintf(file, "\t@$(CC) $(OBJECTS) $(LDFLAGS) -o $@\n");
+    fprintf(file, "\t@$(LM_TIME) $(CC) $(LINK_OBJECTS) $(LINK_ARCHIVES) $(LDFLAGS) -o $@\n");
     fprintf(file, "\t@$(OD) $(BUILD_DIR)/$(TARGET)%s -xS > $(BUILD_DIR)/$(TARGET).s $@\n", target);
     fprintf(file, "\t@echo ''\n");
     fprintf(file, "\t@echo \"Build Successful!\"\n");
@@ -256,17 +429,35 @@ int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg
     fprintf(file, "\n\n");
 
 
-    if(!lm_parser_lds_is_empty()) {
-        fprintf(file, "$(BUILD_DIR)/%%.hex: $(BUILD_DIR)/%%.elf | $(BUILD_DIR)\n");
-        fprintf(file, "\t@echo \"HEX   $@\"\n");
-        fprintf(file, "\t@$(HEX) $< $@\n");
-        fprintf(file, "\n");
+    fprintf(file, "TARGET_OBJECTS = $(addprefix $(BUILD_DIR)/,$(notdir $(addsuffix .o,$(basename $(TARGET_$(1)_SRC) $(TARGET_$(1)_ASM)))))\n");
+    fprintf(file, "COMMON_OBJECTS = $(filter-out $(foreach t,$(%s),$(call TARGET_OBJECTS,$(t))),$(LINK_OBJECTS))\n", VAR_TARGETS);
+    fprintf(file, "\n");
+    fprintf(file, "define LM_TARGET_RULE\n");
+    fprintf(file, "$(call TARGET_FILE,$(1)): $(COMMON_OBJECTS) $(call TARGET_OBJECTS,$(1)) $(ARCHIVES) Makefile\n");
+    fprintf(file, "\t@echo \"LD   $$@\"\n");
+    fprintf(file, "\t@$$(LM_TIME) $$(CC) $(COMMON_OBJECTS) $(call TARGET_OBJECTS,$(1)) $$(LINK_ARCHIVES) \\\n");
+    fprintf(file, "\t\t$$(%s) $$(%s) $(TARGET_$(1)_LDFLAG) $$(%s) $$(%s) $(addprefix -T,$(call TARGET_ELF,$(1))) \\\n", VAR_MC_FLAG, VAR_LD_FLAG, VAR_LIB_PATH, VAR_LIB_NAME);
+    fprintf(file, "\t\t-Wl,-Map=$(BUILD_DIR)/$(1).map -o $$@\n");
+    fprintf(file, "\t@$$(OD) $$@ -xS > $(BUILD_DIR)/$(1).s\n");
+    fprintf(file, "endef\n");
+    fprintf(file, "$(foreach t,$(%s),$(eval $(call LM_TARGET_RULE,$(t))))\n", VAR_TARGETS);
+    fprintf(file, "\n");
 
-        fprintf(file, "$(BUILD_DIR)/%%.bin: $(BUILD_DIR)/%%.elf | $(BUILD_DIR)\n");
-        fprintf(file, "\t@echo \"BIN   $@\"\n");
-        fprintf(file, "\t@$(BIN) $< $@\n");
-        fprintf(file, "\n");
-    }
+    fprintf(file, "targets_info: $(foreach t,$(%s),$(call TARGET_FILE,$(t)))\n", VAR_TARGETS);
+    fprintf(file, "\t@echo \"==================================================================\"\n");
+    fprintf(file, "\t@$(SZ) $^\n");
+    fprintf(file, "\t@echo \"==================================================================\"\n");
+    fprintf(file, "\n\n");
+
+    fprintf(file, "$(BUILD_DIR)/%%.hex: $(BUILD_DIR)/%%.elf | $(BUILD_DIR)\n");
+    fprintf(file, "\t@echo \"HEX   $@\"\n");
+    fprintf(file, "\t@$(HEX) $< $@\n");
+    fprintf(file, "\n");
+
+    fprintf(file, "$(BUILD_DIR)/%%.bin: $(BUILD_DIR)/%%.elf | $(BUILD_DIR)\n");
+    fprintf(file, "\t@echo \"BIN   $@\"\n");
+    fprintf(file, "\t@$(BIN) $< $@\n");
+    fprintf(file, "\n");
 
     fprintf(file, "elf_info: $(BUILD_DIR)/$(TARGET)%s\n", target);
     fprintf(file, "\t@echo \"==================================================================\"\n");
@@ -275,25 +466,45 @@ int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg
     fprintf(file, "\n\n");
 
     fprintf(file, "$(BUILD_DIR):\n");
-    fprintf(file, "\t@mkdir $@\n");
+    fprintf(file, variant ? "\t@mkdir -p $@\n" : "\t@mkdir $@\n");
     fprintf(file, "\n\n");
 
     fprintf(file, "# Pseudo command\n");
     fprintf(file, ".PHONY: config clean\n");
     fprintf(file, "\n");
 
+    if(variant) {
+        // switching configs keeps the old objects, only stale variants are pruned
+        fprintf(file, "LM_CONFIGURE = ./lm.exe --projcfg %s --lmcfg %s --out %s \\\n", projcfg, lmcfg, header_file);
+        fprintf(file, "\t--variant --build $(BUILD_ROOT) --keep-variants $(LM_KEEP_VARIANTS) --variant-age $(LM_VARIANT_AGE)\n");
+    }
+    else {
+        fprintf(file, "LM_CONFIGURE = ./lm.exe --projcfg %s --lmcfg %s --out %s --build $(BUILD_DIR)\n", projcfg, lmcfg, header_file);
+    }
+    fprintf(file, "\n");
+
     fprintf(file, "# Check if the %s file exists\n", projcfg);
     fprintf(file, "config: %s\n", projcfg);
-    fprintf(file, "\t@./lm.exe --projcfg %s --lmcfg %s --out %s --mem 50\n", projcfg, lmcfg, header_file);
-    fprintf(file, "\t@./lm.exe --rm $(BUILD_DIR)\n");
+    if(!variant) {
+        fprintf(file, "\t@./lm.exe --rm-async $(BUILD_DIR)\n");
+    }
+    fprintf(file, "\t@$(LM_CONFIGURE)\n");
+    fprintf(file, "\n");
+
+    // clean deletes the batches with the build directory, make restarts once they are written again
+    fprintf(file, "ifneq ($(%s),)\n", VAR_UNITY);
+    fprintf(file, "ifeq ($(wildcard $(BUILD_DIR)/%s/%s),)\n", LM_UNITY_DIR, LM_UNITY_MK);
+    fprintf(file, "$(BUILD_DIR)/%s/%s:\n", LM_UNITY_DIR, LM_UNITY_MK);
+    fprintf(file, "\t@$(LM_CONFIGURE) --blind\n");
+    fprintf(file, "endif\n");
+    fprintf(file, "endif\n");
     fprintf(file, "\n\n");
 
     fprintf(file, "# clean command, delete build directory\n");
     fprintf(file, "clean:\n");
-    fprintf(file, "\t@./lm.exe --rm $(BUILD_DIR)\n");
+    fprintf(file, "\t@./lm.exe --rm-async $(BUILD_DIR)\n");
     fprintf(file, "\n");
 
-    fclose(file);
-    return LM_OK;
+    return lm_gen_commit(file, makefile, tmp_path);
 }
 
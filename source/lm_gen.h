@@ -1,11 +1,24 @@
 #ifndef __LM_GEN_H__
 #define __LM_GEN_H__
 
+#include <stdio.h>
+#include <stdbool.h>
+
+
+#define    LM_GEN_MAX_PATH          1024
+
+
+/* write-if-changed: write to the FILE from lm_gen_open, lm_gen_commit keeps the old file and its mtime if equal */
+FILE *lm_gen_open(const char *file_path, char *tmp_path);
+int lm_gen_commit(FILE *file, const char *file_path, const char *tmp_path);
+
+
 int lm_gen_header_file(const char* file_path);
 int lm_gen_lmmk_file(const char* file_path);
 int lm_gen_projcfg_file(const char* file_path);
 int lm_gen_mkfile_file(const char *makefile, const char *lmmk, const char *lmcfg, const char *projcfg, 
-                       const char *header_file, const char *pro_name, const char *build_dir, const char *gcc_prefix);
+                       const char *header_file, const char *pro_name, const char *build_dir, const char *gcc_prefix,
+                       bool variant);
 
 
 
@@ -0,0 +1,144 @@
+/* source/lm_hash.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "lm_hash.h"
+#include "lm_error.h"
+
+
+#define    LM_HASH_PRIME1           0x9E3779B185EBCA87ULL
+#define    LM_HASH_PRIME2           0xC2B2AE3D27D4EB4FULL
+#define    LM_HASH_SEED1            0xcbf29ce484222325ULL
+#define    LM_HASH_SEED2            0x84222325cbf29ce4ULL
+#define    LM_HASH_FILE_BUF         (1024 * 64)
+
+
+static inline uint64_t lm_hash_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+
+static inline uint64_t lm_hash_fmix(uint64_t k)
+{
+    k ^= k >> 33;
+    k *= 0xff51afd7ed558ccdULL;
+    k ^= k >> 33;
+    k *= 0xc4ceb9fe1a85ec53ULL;
+    k ^= k >> 33;
+    return k;
+}
+
+
+// two independent lanes over every 8 byte word
+static inline void lm_hash_word(lm_hash_t *hash, uint64_t word)
+{
+    hash->h1 = lm_hash_rotl(hash->h1 ^ (word * LM_HASH_PRIME2), 31) * LM_HASH_PRIME1;
+    hash->h2 = lm_hash_rotl(hash->h2 + word, 27) * LM_HASH_PRIME2 + hash->h1;
+}
+
+
+void lm_hash_init(lm_hash_t *hash)
+{
+    hash->h1 = LM_HASH_SEED1;
+    hash->h2 = LM_HASH_SEED2;
+    hash->length = 0;
+    hash->tail_len = 0;
+}
+
+
+void lm_hash_update(lm_hash_t *hash, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint64_t word;
+
+    hash->length += len;
+
+    while(len && hash->tail_len) {
+        hash->tail[hash->tail_len++] = *p++;
+        len--;
+
+        if(hash->tail_len == 8) {
+            memcpy(&word, hash->tail, 8);
+            lm_hash_word(hash, word);
+            hash->tail_len = 0;
+        }
+    }
+
+    while(len >= 8) {
+        memcpy(&word, p, 8);
+        lm_hash_word(hash, word);
+        p += 8;
+        len -= 8;
+    }
+
+    while(len--) {
+        hash->tail[hash->tail_len++] = *p++;
+    }
+}
+
+
+// the terminator is hashed too, so "ab","c" and "a","bc" give different keys
+void lm_hash_string(lm_hash_t *hash, const char *str)
+{
+    lm_hash_update(hash, str, strlen(str) + 1);
+}
+
+
+void lm_hash_final(lm_hash_t *hash, char *hex)
+{
+    uint64_t word = 0;
+
+    memcpy(&word, hash->tail, hash->tail_len);
+    lm_hash_word(hash, word ^ ((uint64_t)hash->tail_len << 56));
+
+    uint64_t h1 = lm_hash_fmix(hash->h1 ^ hash->length);
+    uint64_t h2 = lm_hash_fmix(hash->h2 ^ lm_hash_rotl(hash->length, 32));
+    h1 += h2;
+    h2 += h1;
+
+    snprintf(hex, LM_HASH_HEX_LEN, "%016llx%016llx", (unsigned long long)h1, (unsigned long long)h2);
+}
+
+
+int lm_hash_file(const char *path, char *hex)
+{
+    char buffer[LM_HASH_FILE_BUF];
+    lm_hash_t hash;
+    size_t len;
+
+    FILE *file = fopen(path, "rb");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    lm_hash_init(&hash);
+    while((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        lm_hash_update(&hash, buffer, len);
+    }
+
+    fclose(file);
+    lm_hash_final(&hash, hex);
+    return LM_OK;
+}
@@ -0,0 +1,61 @@
+/* source/lm_hash.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_HASH_H__
+#define __LM_HASH_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+
+#define    LM_HASH_HEX_LEN          33
+
+
+/* 128 bit streaming hash for content keys, not a cryptographic hash */
+typedef struct lm_hash {
+    uint64_t h1;
+    uint64_t h2;
+    uint64_t length;
+    uint8_t  tail[8];
+    int      tail_len;
+}lm_hash_t;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+void lm_hash_init(lm_hash_t *hash);
+void lm_hash_update(lm_hash_t *hash, const void *data, size_t len);
+void lm_hash_string(lm_hash_t *hash, const char *str);
+void lm_hash_final(lm_hash_t *hash, char *hex);
+int lm_hash_file(const char *path, char *hex);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_HASH_H__
@@ -0,0 +1,558 @@
+/* source/lm_install.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include "lm_install.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+
+#if ( __linux__)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+typedef enum {
+    LM_INSTALL_PENDING = 0,
+    LM_INSTALL_COPIED,
+    LM_INSTALL_UNCHANGED,
+    LM_INSTALL_FAILED,
+}lm_install_state_e;
+
+
+typedef struct lm_install_entry {
+    char *src;
+    char *dest;
+    char *path;
+    lm_install_state_e state;
+    dev_t dir_dev;
+    ino_t dir_ino;
+}lm_install_entry_t;
+
+
+typedef struct lm_install_ctx {
+    const char *outdir;
+    lm_install_entry_t *entry;
+    int count;
+#if ( __linux__)
+    pthread_mutex_t lock;
+#endif
+    int next;
+}lm_install_ctx_t;
+
+
+static char *lm_install_join(const char *dir, const char *name)
+{
+    size_t len = strlen(dir) + strlen(name) + 2;
+    char *path = malloc(len);
+
+    if(path) {
+        snprintf(path, len, "%s/%s", dir, name);
+    }
+
+    return path;
+}
+
+
+static char *lm_install_trim(char *str)
+{
+    while(*str == ' ' || *str == '\t') {
+        str++;
+    }
+
+    char *end = str + strlen(str);
+    while(end > str && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\n' || end[-1] == '\r')) {
+        *--end = '\0';
+    }
+
+    return str;
+}
+
+
+// stale entries are removed by name, so a dest must stay inside outdir
+static bool lm_install_dest_is_valid(const char *dest)
+{
+    if(dest[0] == '\0' || dest[0] == '/') {
+        return false;
+    }
+
+    for(const char *p = dest; p; p = strchr(p, '/')) {
+        p += *p == '/';
+        if(strncmp(p, "..", 2) == 0 && (p[2] == '/' || p[2] == '\0')) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*
+ * "pkg//f", "./pkg/f" and "pkg/f/" name one file, and must compare equal for
+ * the duplicate check and the stale record. ".." is left for the validity check.
+ */
+static void lm_install_normalize(char *dest)
+{
+    char *out = dest;
+    char *p = dest;
+
+    // an absolute path keeps its slash so it is still rejected
+    if(*p == '/') {
+        out++;
+        p++;
+    }
+
+    while(*p) {
+        char *end = p + strcspn(p, "/");
+        size_t len = end - p;
+
+        if(len > 0 && !(len == 1 && *p == '.')) {
+            if(out > dest && out[-1] != '/') {
+                *out++ = '/';
+            }
+            memmove(out, p, len);
+            out += len;
+        }
+
+        p = *end ? end + 1 : end;
+    }
+
+    *out = '\0';
+}
+
+
+static int lm_install_dest_cmp(const void *a, const void *b)
+{
+    return strcmp(((const lm_install_entry_t*)a)->dest, ((const lm_install_entry_t*)b)->dest);
+}
+
+
+static int lm_install_add(lm_install_entry_t **entry, int *count, int *size, char *src, char *dest)
+{
+    if(*count == *size) {
+        *size = *size ? *size * 2 : 256;
+        lm_install_entry_t *grow = realloc(*entry, *size * sizeof(lm_install_entry_t));
+        if(grow == NULL) {
+            return LM_ERR;
+        }
+        *entry = grow;
+    }
+
+    // "dir/" keeps the file name of the source
+    size_t len = strlen(dest);
+    if(len == 0 || dest[len - 1] == '/') {
+        const char *base = strrchr(src, '/');
+        base = base ? base + 1 : src;
+
+        char *full = malloc(len + strlen(base) + 1);
+        if(full == NULL) {
+            return LM_ERR;
+        }
+        sprintf(full, "%s%s", dest, base);
+        dest = full;
+    }
+    else {
+        dest = strdup(dest);
+    }
+
+    if(dest) {
+        lm_install_normalize(dest);
+    }
+
+    lm_install_entry_t *item = &(*entry)[*count];
+    item->src = strdup(src);
+    item->dest = dest;
+    item->path = NULL;
+    item->state = LM_INSTALL_PENDING;
+    item->dir_dev = 0;
+    item->dir_ino = 0;
+    (*count)++;
+
+    return item->src && item->dest ? LM_OK : LM_ERR;
+}
+
+
+static int lm_install_read(const char *manifest, lm_install_entry_t **entry, int *count)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    int size = 0;
+    int lines = 0;
+    int ret = LM_OK;
+
+    FILE *file = fopen(manifest, "r");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not open %s", manifest);
+        return LM_ERR;
+    }
+
+    while(ret == LM_OK && getline(&line, &cap, file) != -1) {
+        char *src = lm_install_trim(line);
+        lines++;
+
+        if(*src == '\0' || *src == '#') {
+            continue;
+        }
+
+        char *dest = src + strcspn(src, " \t");
+        if(*dest == '\0') {
+            dest = strchr(src, ':');
+        }
+        if(dest == NULL || dest == src) {
+            LM_LOG_ERROR("%s:%d expected \"src dest\" or \"src:dest\"", manifest, lines);
+            ret = LM_ERR;
+            break;
+        }
+
+        *dest++ = '\0';
+        dest = lm_install_trim(dest);
+
+        ret = lm_install_add(entry, count, &size, src, dest);
+        if(ret != LM_OK) {
+            LM_LOG_ERROR("out of memory");
+        }
+        else if(!lm_install_dest_is_valid((*entry)[*count - 1].dest)) {
+            LM_LOG_ERROR("%s:%d %s must be a relative path inside the output directory", manifest, lines, dest);
+            ret = LM_ERR;
+        }
+    }
+
+    free(line);
+    fclose(file);
+    return ret;
+}
+
+
+// the directory holding path, found through any symlinks on the way
+static bool lm_install_dir_id(const char *path, dev_t *dev, ino_t *ino)
+{
+    struct stat st;
+    char *dir = strdup(path);
+    bool ret = false;
+
+    if(dir) {
+        char *slash = strrchr(dir, '/');
+        if(slash) {
+            *slash = '\0';
+        }
+
+        if(stat(slash ? dir : ".", &st) == 0) {
+            *dev = st.st_dev;
+            *ino = st.st_ino;
+            ret = true;
+        }
+        free(dir);
+    }
+
+    return ret;
+}
+
+
+static void lm_install_mkdirs(char *path)
+{
+    for(char *p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+        *p = '\0';
+        lm_mkdir(path);
+        *p = '/';
+    }
+}
+
+
+// drop empty directories left behind by a removed file, up to the output root
+static void lm_install_prune_dirs(const char *outdir, char *path)
+{
+    size_t root = strlen(outdir);
+    char *slash;
+
+    while((slash = strrchr(path, '/')) != NULL && (size_t)(slash - path) > root) {
+        *slash = '\0';
+        if(rmdir(path) != 0) {
+            break;
+        }
+    }
+}
+
+
+static void lm_install_one(lm_install_entry_t *item)
+{
+    struct stat src_st;
+    struct stat dst_st;
+
+    if(stat(item->src, &src_st) != 0 || !S_ISREG(src_st.st_mode)) {
+        LM_LOG_ERROR("%s is not a file", item->src);
+        item->state = LM_INSTALL_FAILED;
+        return;
+    }
+
+    if(stat(item->path, &dst_st) == 0 && S_ISREG(dst_st.st_mode) && dst_st.st_size == src_st.st_size) {
+        bool same_inode = dst_st.st_dev == src_st.st_dev && dst_st.st_ino == src_st.st_ino;
+        if(same_inode || lm_file_is_same(item->src, item->path)) {
+            item->state = LM_INSTALL_UNCHANGED;
+            return;
+        }
+    }
+
+    lm_install_mkdirs(item->path);
+
+    if(lm_clone_file(item->src, item->path, true) != 0) {
+        LM_LOG_ERROR("can not install %s to %s", item->src, item->path);
+        item->state = LM_INSTALL_FAILED;
+        return;
+    }
+
+    item->state = LM_INSTALL_COPIED;
+}
+
+
+/*
+ * A stale name may still reach an installed file, through a symlinked
+ * directory or a record written before names were normalized. The same
+ * directory and file name means the same directory entry. Only the entry is
+ * compared, not the file inode: hardlinked installs of one source share it.
+ */
+static bool lm_install_is_installed(lm_install_ctx_t *ctx, const char *path)
+{
+    dev_t dev;
+    ino_t ino;
+
+    if(!lm_install_dir_id(path, &dev, &ino)) {
+        return false;
+    }
+
+    const char *name = strrchr(path, '/');
+    name = name ? name + 1 : path;
+
+    for(int i = 0; i < ctx->count; i++) {
+        lm_install_entry_t *item = &ctx->entry[i];
+        const char *item_name = strrchr(item->path, '/') + 1;
+
+        if(item->dir_ino == ino && item->dir_dev == dev && item->state != LM_INSTALL_FAILED && strcmp(item_name, name) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+static void *lm_install_worker(void *arg)
+{
+    lm_install_ctx_t *ctx = arg;
+
+    for(;;) {
+#if ( __linux__)
+        pthread_mutex_lock(&ctx->lock);
+#endif
+        int index = ctx->next < ctx->count ? ctx->next++ : -1;
+#if ( __linux__)
+        pthread_mutex_unlock(&ctx->lock);
+#endif
+
+        if(index < 0) {
+            return NULL;
+        }
+
+        lm_install_one(&ctx->entry[index]);
+    }
+}
+
+
+static void lm_install_run(lm_install_ctx_t *ctx, int jobs)
+{
+#if ( __linux__)
+    pthread_t threads[LM_INSTALL_MAX_JOBS];
+    int started = 1;
+
+    pthread_mutex_init(&ctx->lock, NULL);
+
+    while(started < jobs && pthread_create(&threads[started], NULL, lm_install_worker, ctx) == 0) {
+        started++;
+    }
+
+    lm_install_worker(ctx);
+
+    for(int i = 1; i < started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&ctx->lock);
+#else
+    (void)jobs;
+    lm_install_worker(ctx);
+#endif
+}
+
+
+/*
+ * Everything the previous run installed and this manifest no longer lists.
+ * The new record keeps the names that could not be removed, so they are
+ * tried again next time.
+ */
+static int lm_install_stale(lm_install_ctx_t *ctx, FILE *record)
+{
+    char *line = NULL;
+    size_t cap = 0;
+    int removed = 0;
+
+    char *record_path = lm_install_join(ctx->outdir, LM_INSTALL_RECORD);
+    FILE *file = record_path ? fopen(record_path, "r") : NULL;
+    free(record_path);
+
+    while(file && getline(&line, &cap, file) != -1) {
+        lm_install_entry_t key;
+
+        key.dest = lm_install_trim(line);
+        lm_install_normalize(key.dest);
+        if(*key.dest == '\0' || !lm_install_dest_is_valid(key.dest)) {
+            continue;
+        }
+
+        if(bsearch(&key, ctx->entry, ctx->count, sizeof(lm_install_entry_t), lm_install_dest_cmp)) {
+            continue;
+        }
+
+        char *path = lm_install_join(ctx->outdir, key.dest);
+        if(path == NULL) {
+            continue;
+        }
+
+        if(lm_install_is_installed(ctx, path)) {
+            free(path);
+            continue;
+        }
+
+        if(remove(path) == 0 || errno == ENOENT) {
+            lm_install_prune_dirs(ctx->outdir, path);
+            removed++;
+        }
+        else {
+            LM_LOG_WARN("can not remove stale %s", path);
+            fprintf(record, "%s\n", key.dest);
+        }
+        free(path);
+    }
+
+    if(file) {
+        fclose(file);
+    }
+    free(line);
+    return removed;
+}
+
+
+int lm_install(const char *manifest, const char *outdir, int jobs)
+{
+    lm_install_entry_t *entry = NULL;
+    int count = 0;
+    int ret = lm_install_read(manifest, &entry, &count);
+
+    // duplicates would race on the same file, and the record must be searchable
+    if(ret == LM_OK) {
+        qsort(entry, count, sizeof(lm_install_entry_t), lm_install_dest_cmp);
+
+        for(int i = 1; i < count; i++) {
+            if(strcmp(entry[i - 1].dest, entry[i].dest) == 0) {
+                LM_LOG_ERROR("%s is installed from both %s and %s", entry[i].dest, entry[i - 1].src, entry[i].src);
+                ret = LM_ERR;
+            }
+        }
+    }
+
+    for(int i = 0; ret == LM_OK && i < count; i++) {
+        entry[i].path = lm_install_join(outdir, entry[i].dest);
+        if(entry[i].path == NULL) {
+            LM_LOG_ERROR("out of memory");
+            ret = LM_ERR;
+        }
+    }
+
+    char *record_path = lm_install_join(outdir, LM_INSTALL_RECORD ".tmp");
+    FILE *record = NULL;
+
+    if(ret == LM_OK) {
+        lm_mkdir(outdir);
+        record = record_path ? fopen(record_path, "w") : NULL;
+        if(record == NULL) {
+            LM_LOG_ERROR("can not write to %s", outdir);
+            ret = LM_ERR;
+        }
+    }
+
+    if(ret == LM_OK) {
+        lm_install_ctx_t ctx = { .outdir = outdir, .entry = entry, .count = count, .next = 0 };
+
+        if(jobs <= 0) {
+#if ( __linux__)
+            jobs = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+        }
+        jobs = jobs > count ? count : jobs;
+        jobs = jobs > LM_INSTALL_MAX_JOBS ? LM_INSTALL_MAX_JOBS : jobs < 1 ? 1 : jobs;
+
+        lm_install_run(&ctx, jobs);
+
+        for(int i = 0; i < count; i++) {
+            lm_install_dir_id(entry[i].path, &entry[i].dir_dev, &entry[i].dir_ino);
+        }
+
+        int removed = lm_install_stale(&ctx, record);
+        int copied = 0;
+        int unchanged = 0;
+        int failed = 0;
+
+        for(int i = 0; i < count; i++) {
+            copied += entry[i].state == LM_INSTALL_COPIED;
+            unchanged += entry[i].state == LM_INSTALL_UNCHANGED;
+            failed += entry[i].state == LM_INSTALL_FAILED;
+            fprintf(record, "%s\n", entry[i].dest);
+        }
+
+        char *final_path = lm_install_join(outdir, LM_INSTALL_RECORD);
+        if(fclose(record) != 0 || final_path == NULL || rename(record_path, final_path) != 0) {
+            LM_LOG_ERROR("can not update %s/%s", outdir, LM_INSTALL_RECORD);
+            failed++;
+        }
+        free(final_path);
+
+        printf("%d installed, %d unchanged, %d removed, %d failed\n", copied, unchanged, removed, failed);
+        ret = failed ? LM_ERR : LM_OK;
+    }
+
+    for(int i = 0; i < count; i++) {
+        free(entry[i].src);
+        free(entry[i].dest);
+        free(entry[i].path);
+    }
+    free(entry);
+    free(record_path);
+
+    return ret;
+}
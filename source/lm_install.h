@@ -0,0 +1,53 @@
+/* source/lm_install.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_INSTALL_H__
+#define __LM_INSTALL_H__
+
+
+#define    LM_INSTALL_RECORD        ".lm_install"
+#define    LM_INSTALL_MAX_JOBS      64
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Stage the files listed in manifest into outdir. Each line is "src dest" or
+ * "src:dest", dest is relative to outdir and takes the name of src when it
+ * ends with '/'. Entries are reflinked, hardlinked or copied by up to jobs
+ * threads (one per cpu when jobs <= 0), unchanged ones are left alone, and
+ * files recorded in <outdir>/.lm_install by the previous run but missing
+ * from this manifest are removed.
+ */
+int lm_install(const char *manifest, const char *outdir, int jobs);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_INSTALL_H__
@@ -27,6 +27,15 @@
 #include <string.h>
 
 
+static FILE *lm_log_output = NULL;
+
+
+void lm_log_set_output(FILE *file)
+{
+    lm_log_output = file;
+}
+
+
 #if CONFIG_DEBUG
 
 /**
@@ -41,11 +50,13 @@
 */
 void lm_log(const char *level, const char * format, ...)
 {
-    printf("%s", level);
+    FILE *output = lm_log_output ? lm_log_output : stdout;
+
+    fprintf(output, "%s", level);
     va_list args;
     va_start(args, format);
-    vfprintf(stdout, format, args);
-    printf("\n");
+    vfprintf(output, format, args);
+    fprintf(output, "\n");
     va_end(args);
 }
 
@@ -25,6 +25,7 @@
 #define __LM_LOG_H__
 
 
+#include <stdio.h>
 #include "config.h"
 
 
@@ -42,6 +43,16 @@ extern "C" {
 #define _LM_LOG_LEVEL_NUM  6 /**< Number of log levels*/
 
 
+/**
+ * @brief Send log lines to file instead of stdout, NULL goes back to stdout
+ * 
+ * @param file:  output stream
+ * 
+ * @return none
+*/
+void lm_log_set_output(FILE *file);
+
+
 #if CONFIG_DEBUG
 
 /**
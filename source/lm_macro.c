@@ -28,6 +28,7 @@
 #include "lm_error.h"
 #include "lm_mem.h"
 #include "lm_log.h"
+#include "lm_time.h"
 
 
 #if (_WIN32)
@@ -247,9 +248,12 @@ lm_macro_t *lm_macro_search_by_name(lm_macro_head_t *head, char *name)
         return NULL;
     }
     
+    lm_time_count(LM_TIME_LOOKUPS);
+
     for(int i = 0; i < CONFIG_MACRO_CACHE_SIZE; i++) {
         if(head->cache[i].macro) {
             if(strcmp(head->cache[i].macro->name, name) == 0) {
+                lm_time_count(LM_TIME_CACHE_HITS);
                 head->cache[i].count ++;
                 return head->cache[i].macro;
             }
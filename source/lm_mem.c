@@ -21,42 +21,371 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include "lm_mem.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "lm_log.h"
 
+#if ( __linux__)
+#include <sys/mman.h>
+#endif
 
-static void* lm_mem_pool = NULL;
-static tlsf_t tlsf_pool;
 
+#define    LM_MEM_CHUNK_MIN         (1024*1024)
+#define    LM_MEM_MAX_CHUNKS        48
+#define    LM_MEM_CLASSES           14      // 16 bytes .. 64KB, then larger
+#define    LM_MEM_MAX_SITES         256
+#define    LM_MEM_SHOW_SITES        16
 
-int lm_mem_init(int size_mb)
+
+typedef struct lm_mem_chunk {
+    void *mem;
+    size_t size;
+}lm_mem_chunk_t;
+
+
+#if CONFIG_DEBUG
+typedef struct lm_mem_tag {
+    const char *file;
+    size_t line;
+}lm_mem_tag_t;
+#define    LM_MEM_TAG_SIZE          sizeof(lm_mem_tag_t)
+#else
+#define    LM_MEM_TAG_SIZE          0
+#endif
+
+
+typedef struct lm_mem_site {
+    const char *file;       // NULL: grouped by size class, release builds
+    int line;
+    size_t blocks;
+    size_t bytes;
+}lm_mem_site_t;
+
+
+typedef struct lm_mem_walk {
+    size_t used;
+    size_t used_blocks;
+    size_t free;
+    size_t free_max;
+    lm_mem_site_t sites[LM_MEM_MAX_SITES];
+    int site_count;
+}lm_mem_walk_t;
+
+
+static struct lm_mem_stats {
+    bool enable;
+    size_t current;
+    size_t peak;
+    size_t allocs;
+    size_t frees;
+    size_t failed;
+    size_t classes[LM_MEM_CLASSES];
+}lm_mem_stats;
+
+
+static lm_mem_chunk_t lm_mem_chunks[LM_MEM_MAX_CHUNKS];
+static int lm_mem_chunk_count = 0;
+static size_t lm_mem_total = 0;
+static size_t lm_mem_limit = 0;
+static tlsf_t tlsf_pool = NULL;
+
+
+static void* lm_mem_map(size_t size)
+{
+#if ( __linux__)
+    // pages are only backed once tlsf touches them
+    void *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return mem == MAP_FAILED ? NULL : mem;
+#else
+    return malloc(size);
+#endif
+}
+
+
+static void lm_mem_unmap(void *mem, size_t size)
+{
+#if ( __linux__)
+    munmap(mem, size);
+#else
+    (void)size;
+    free(mem);
+#endif
+}
+
+
+/*
+ * Add a pool big enough for an allocation of bytes. Each chunk doubles the
+ * last one, so a big tree needs a handful of pools and a small one stays at
+ * LM_MEM_CHUNK_MIN. The last chunk is trimmed to fit the --mem limit.
+ */
+static int lm_mem_grow(size_t bytes)
 {
-    lm_mem_pool = malloc(size_mb*1024*1024);
-    if(lm_mem_pool == NULL) {
+    size_t need = bytes + tlsf_pool_overhead() + tlsf_alloc_overhead() + tlsf_align_size();
+    size_t size = LM_MEM_CHUNK_MIN;
+
+    if(lm_mem_chunk_count == LM_MEM_MAX_CHUNKS) {
+        return -1;
+    }
+
+    if(lm_mem_chunk_count == 0) {
+        need += tlsf_size();
+    }
+    else {
+        size = lm_mem_chunks[lm_mem_chunk_count - 1].size * 2;
+    }
+
+    while(size < need) {
+        size *= 2;
+    }
+
+    if(size - tlsf_pool_overhead() > tlsf_block_size_max()) {
+        size = (tlsf_block_size_max() + tlsf_pool_overhead()) & ~(size_t)4095;
+    }
+
+    if(lm_mem_limit > 0 && lm_mem_total + size > lm_mem_limit) {
+        size = (lm_mem_limit - lm_mem_total) & ~(size_t)4095;
+    }
+
+    if(size < need) {
+        if(lm_mem_limit > 0) {
+            LM_LOG_ERROR("memory limit of %dMB reached, raise --mem", (int)(lm_mem_limit / 1024 / 1024));
+        }
+        return -1;
+    }
+
+    void *mem = lm_mem_map(size);
+    if(mem == NULL) {
+        return -1;
+    }
+
+    if(lm_mem_chunk_count == 0) {
+        tlsf_pool = tlsf_create_with_pool(mem, size);
+    }
+    else if(tlsf_add_pool(tlsf_pool, mem, size) == NULL) {
+        lm_mem_unmap(mem, size);
         return -1;
     }
 
-    tlsf_pool = tlsf_create_with_pool(lm_mem_pool, size_mb*1024*1024);
+    lm_mem_chunks[lm_mem_chunk_count].mem = mem;
+    lm_mem_chunks[lm_mem_chunk_count].size = size;
+    lm_mem_chunk_count++;
+    lm_mem_total += size;
 
     return 0;
 }
 
 
-void* lm_malloc(size_t size)
+int lm_mem_init(int size_mb)
+{
+    lm_mem_chunk_count = 0;
+    lm_mem_total = 0;
+    lm_mem_limit = size_mb > 0 ? (size_t)size_mb * 1024 * 1024 : 0;
+
+    bool enable = lm_mem_stats.enable;
+    memset(&lm_mem_stats, 0, sizeof(lm_mem_stats));
+    lm_mem_stats.enable = enable;
+
+    return lm_mem_grow(0);
+}
+
+
+void lm_mem_set_stats(bool enable)
+{
+    lm_mem_stats.enable = enable;
+}
+
+
+static int lm_mem_class(size_t size)
+{
+    int index = 0;
+
+    while(index < LM_MEM_CLASSES - 1 && size > ((size_t)16 << index)) {
+        index++;
+    }
+
+    return index;
+}
+
+
+void* lm_mem_alloc(size_t size, const char *file, int line)
 {
-    return tlsf_malloc(lm_mem_pool, size);
+    void *p = tlsf_malloc(tlsf_pool, size + LM_MEM_TAG_SIZE);
+
+    if(p == NULL && lm_mem_grow(size + LM_MEM_TAG_SIZE) == 0) {
+        p = tlsf_malloc(tlsf_pool, size + LM_MEM_TAG_SIZE);
+    }
+
+    if(p == NULL) {
+        lm_mem_stats.failed++;
+        return NULL;
+    }
+
+    lm_mem_stats.allocs++;
+    lm_mem_stats.classes[lm_mem_class(size)]++;
+    lm_mem_stats.current += tlsf_block_size(p);
+    if(lm_mem_stats.current > lm_mem_stats.peak) {
+        lm_mem_stats.peak = lm_mem_stats.current;
+    }
+
+#if CONFIG_DEBUG
+    lm_mem_tag_t *tag = p;
+    tag->file = file;
+    tag->line = line;
+    return (char*)p + LM_MEM_TAG_SIZE;
+#else
+    (void)file;
+    (void)line;
+    return p;
+#endif
 }
 
 
 void lm_free(void *p)
 {
-    tlsf_free(lm_mem_pool, p);
+    if(p == NULL) {
+        return;
+    }
+
+    p = (char*)p - LM_MEM_TAG_SIZE;
+    lm_mem_stats.frees++;
+    lm_mem_stats.current -= tlsf_block_size(p);
+    tlsf_free(tlsf_pool, p);
+}
+
+
+static void lm_mem_walker(void *ptr, size_t size, int used, void *user)
+{
+    lm_mem_walk_t *walk = user;
+
+    if(!used) {
+        walk->free += size;
+        if(size > walk->free_max) {
+            walk->free_max = size;
+        }
+        return;
+    }
+
+    walk->used += size;
+    walk->used_blocks++;
+
+#if CONFIG_DEBUG
+    const char *file = ((lm_mem_tag_t*)ptr)->file;
+    int line = ((lm_mem_tag_t*)ptr)->line;
+#else
+    const char *file = NULL;
+    int line = lm_mem_class(size);
+    (void)ptr;
+#endif
+
+    int i;
+    for(i = 0; i < walk->site_count; i++) {
+        if(walk->sites[i].file == file && walk->sites[i].line == line) {
+            break;
+        }
+    }
+
+    if(i == walk->site_count) {
+        if(walk->site_count == LM_MEM_MAX_SITES) {
+            return;
+        }
+        walk->sites[i].file = file;
+        walk->sites[i].line = line;
+        walk->site_count++;
+    }
+
+    walk->sites[i].blocks++;
+    walk->sites[i].bytes += size;
+}
+
+
+static int lm_mem_site_cmp(const void *a, const void *b)
+{
+    const lm_mem_site_t *sa = a;
+    const lm_mem_site_t *sb = b;
+
+    return (sa->bytes < sb->bytes) - (sa->bytes > sb->bytes);
+}
+
+
+static void lm_mem_report(void)
+{
+    lm_mem_walk_t *walk = calloc(1, sizeof(lm_mem_walk_t));
+    if(walk == NULL) {
+        return;
+    }
+
+    for(int i = 0; i < lm_mem_chunk_count; i++) {
+        pool_t pool = i == 0 ? tlsf_get_pool(tlsf_pool) : (char*)lm_mem_chunks[i].mem;
+        tlsf_walk_pool(pool, lm_mem_walker, walk);
+    }
+
+    printf("memory pools:     %d, %.1f MB", lm_mem_chunk_count, lm_mem_total / 1048576.0);
+    if(lm_mem_limit > 0) {
+        printf(" of %d MB", (int)(lm_mem_limit / 1048576));
+    }
+    printf("\n");
+    printf("peak:             %.1f KB\n", lm_mem_stats.peak / 1024.0);
+    printf("current:          %.1f KB in %zu blocks\n", lm_mem_stats.current / 1024.0, walk->used_blocks);
+    printf("allocations:      %zu, freed %zu, failed %zu\n", lm_mem_stats.allocs, lm_mem_stats.frees, lm_mem_stats.failed);
+
+    // largest free block against all free space: 0% means one free run
+    printf("fragmentation:    %.1f%% (free %.1f KB, largest %.1f KB)\n",
+        walk->free ? (1.0 - (double)walk->free_max / walk->free) * 100.0 : 0.0,
+        walk->free / 1024.0, walk->free_max / 1024.0);
+
+    printf("size classes:\n");
+    for(int i = 0; i < LM_MEM_CLASSES; i++) {
+        if(lm_mem_stats.classes[i] == 0) {
+            continue;
+        }
+        if(i == LM_MEM_CLASSES - 1) {
+            printf("    > %-10zu  %zu\n", (size_t)16 << (i - 1), lm_mem_stats.classes[i]);
+        }
+        else {
+            printf("    <= %-9zu  %zu\n", (size_t)16 << i, lm_mem_stats.classes[i]);
+        }
+    }
+
+    qsort(walk->sites, walk->site_count, sizeof(lm_mem_site_t), lm_mem_site_cmp);
+
+    printf("still allocated:\n");
+    for(int i = 0; i < walk->site_count && i < LM_MEM_SHOW_SITES; i++) {
+        lm_mem_site_t *site = &walk->sites[i];
+        if(site->file) {
+            printf("    %s:%-6d  %8zu blocks  %10.1f KB\n", site->file, site->line, site->blocks, site->bytes / 1024.0);
+        }
+        else {
+            printf("    <= %-9zu  %8zu blocks  %10.1f KB\n", (size_t)16 << site->line, site->blocks, site->bytes / 1024.0);
+        }
+    }
+    if(walk->site_count > LM_MEM_SHOW_SITES) {
+        printf("    ... %d more\n", walk->site_count - LM_MEM_SHOW_SITES);
+    }
+
+    free(walk);
 }
 
 
 void lm_mem_destroy(void)
 {
+    if(tlsf_pool == NULL) {
+        return;
+    }
+
+    if(lm_mem_stats.enable) {
+        lm_mem_report();
+    }
+
     tlsf_destroy(tlsf_pool);
-    free(lm_mem_pool);
+    tlsf_pool = NULL;
+
+    while(lm_mem_chunk_count > 0) {
+        lm_mem_chunk_count--;
+        lm_mem_unmap(lm_mem_chunks[lm_mem_chunk_count].mem, lm_mem_chunks[lm_mem_chunk_count].size);
+    }
+    lm_mem_total = 0;
 }
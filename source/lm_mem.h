@@ -24,12 +24,20 @@
 #ifndef __LM_MEM_H__
 #define __LM_MEM_H__
 
+#include <stdbool.h>
 #include "heap_tlsf.h"
 
+// the pool grows on demand, size_mb caps it (0: no limit)
 int lm_mem_init(int size_mb);
-void* lm_malloc(size_t size);
+void* lm_mem_alloc(size_t size, const char *file, int line);
 void lm_free(void *p);
 void lm_mem_destroy(void);
 
+// print usage, size classes, fragmentation and the blocks still allocated in lm_mem_destroy
+void lm_mem_set_stats(bool enable);
+
+// debug builds keep the call site with each block for the --mem-stats leak report
+#define lm_malloc(size)    lm_mem_alloc(size, __FILE__, __LINE__)
+
 #endif //! __LM_MEM_H__
 
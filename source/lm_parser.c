@@ -21,6 +21,8 @@
  * SOFTWARE.
  */
 
+#define _GNU_SOURCE
+
 #include <string.h>
 #include <stdlib.h>
 #include "lm_string.h"
@@ -29,6 +31,8 @@
 #include "lm_macro.h"
 #include "lm_parser.h"
 #include "lm_log.h"
+#include "lm_time.h"
+#include "lm_trace.h"
 #include <dirent.h>
 #include <ctype.h>
 
@@ -52,6 +56,13 @@ static char lm_parser_list_name[][20] = {
     {VAR_LD_FLAG},
     {VAR_LIB_NAME},
     {VAR_LIB_PATH},
+    {VAR_PCH_SOURCE},
+    {VAR_UNITY},
+    {VAR_UNITY_EXCLUDE},
+    {VAR_LIBRARY},
+    {VAR_LIBRARY_MEMBER},
+    {VAR_TARGETS},
+    {VAR_TARGET_MEMBER},
 };
 
 
@@ -69,6 +80,13 @@ static struct lm_parser_list {
     lm_array_t ldflag_list;
     lm_array_t lib_list;
     lm_array_t libpath_list;
+    lm_array_t pch_list;
+    lm_array_t unity_list;
+    lm_array_t unity_exclude_list;
+    lm_array_t library_list;
+    lm_array_t library_member_list;
+    lm_array_t target_list;
+    lm_array_t target_member_list;
 
 }lm_parser_list;
 
@@ -76,8 +94,34 @@ static struct lm_parser_list {
 static lm_macro_head_t config_head;
 static lm_macro_head_t macro_head;
 static const char *config_file = NULL;
+static lm_parser_input_fn input_hook = NULL;
+
+static struct lm_parser_scope {
+    char library[MAX_MACRO_NAME];
+    char target[MAX_MACRO_NAME];
+}lm_parser_scope;
+
 static char error_msg[MAX_PER_LINE_LENGTH] = {0};
 
+/*
+ * A parsed lm.cfg file as its logical lines, continuation lines already
+ * joined, or the .c names a wildcard directory listing found. Kept sources
+ * are looked up by path instead of touching the file system again.
+ */
+typedef struct lm_parser_source {
+    char *path;
+    bool is_dir;
+    bool kept;
+    char **line;
+    int *line_no;
+    int count;
+    int size;
+    struct lm_parser_source *next;
+}lm_parser_source_t;
+
+static lm_parser_source_t *source_head = NULL;
+static bool source_keep = false;
+
 
 static char *lm_parser_alloc(void)
 {
@@ -93,6 +137,154 @@ static char *lm_parser_alloc(void)
 }
 
 
+static int lm_parser_file_line_preprocess(FILE *file, char *read_line)
+{
+    int count = 0;
+
+    if (read_line[strlen(read_line) - 1] == '\n' || read_line[strlen(read_line) - 1] == '\r') {
+        read_line[strlen(read_line) - 1] = '\0';
+    }
+
+    if(read_line[strlen(read_line) - 1] == '\\') {
+        read_line[strlen(read_line) - 1] = '\0';
+
+        char *read_line_tmp = lm_parser_alloc();
+
+        while(fgets(read_line_tmp, MAX_PER_LINE_LENGTH, file)) {
+            if (read_line_tmp[strlen(read_line_tmp) - 1] == '\n' || read_line_tmp[strlen(read_line_tmp) - 1] == '\r') {
+                read_line_tmp[strlen(read_line_tmp) - 1] = '\0';
+            }
+
+            count ++;
+            char *pure = lm_str_delete_head_tail_space(read_line_tmp);
+            
+            read_line[strlen(read_line) - 1] = '\0';
+            strcat(read_line, pure);
+            
+            lm_free(pure);
+            if(read_line_tmp[strlen(read_line_tmp) - 1] != '\\') {
+                break;
+            }
+        }
+
+        lm_free(read_line_tmp);
+    }
+
+    return count;
+}
+
+
+static void lm_parser_source_add(lm_parser_source_t *source, const char *line, int line_no)
+{
+    if(source->count == source->size) {
+        source->size = source->size ? source->size * 2 : 64;
+        source->line = realloc(source->line, source->size * sizeof(char*));
+        source->line_no = realloc(source->line_no, source->size * sizeof(int));
+        if(source->line == NULL || source->line_no == NULL) {
+            LM_LOG_ERROR("out of memory");
+            exit(1);
+        }
+    }
+
+    source->line[source->count] = strdup(line);
+    if(source->line[source->count] == NULL) {
+        LM_LOG_ERROR("out of memory");
+        exit(1);
+    }
+    source->line_no[source->count++] = line_no;
+}
+
+
+static void lm_parser_source_free(lm_parser_source_t *source)
+{
+    for(int i = 0; i < source->count; i++) {
+        free(source->line[i]);
+    }
+
+    free(source->line);
+    free(source->line_no);
+    free(source->path);
+    free(source);
+}
+
+
+static lm_parser_source_t *lm_parser_source_read(const char *path, bool is_dir)
+{
+    lm_parser_source_t *source = calloc(1, sizeof(lm_parser_source_t));
+    if(source == NULL || (source->path = strdup(path)) == NULL) {
+        LM_LOG_ERROR("out of memory");
+        exit(1);
+    }
+    source->is_dir = is_dir;
+
+    if(is_dir) {
+        DIR *dir = opendir(path);
+        if(dir == NULL) {
+            lm_parser_source_free(source);
+            return NULL;
+        }
+
+        struct dirent *entry;
+        while((entry = readdir(dir)) != NULL) {
+            size_t len = strlen(entry->d_name);
+            if(len >= 2 && strcmp(entry->d_name + len - 2, ".c") == 0) {
+                lm_parser_source_add(source, entry->d_name, 0);
+            }
+        }
+
+        closedir(dir);
+        return source;
+    }
+
+    FILE *file = fopen(path, "r"); // read only
+    if(file == NULL) {
+        lm_parser_source_free(source);
+        return NULL;
+    }
+
+    char *read_line = lm_parser_alloc();
+    int line_count = 0;
+
+    while(fgets(read_line, MAX_PER_LINE_LENGTH, file)) {
+        line_count++;
+        line_count += lm_parser_file_line_preprocess(file, read_line);
+        lm_parser_source_add(source, read_line, line_count);
+    }
+
+    lm_free(read_line);
+    fclose(file);
+    return source;
+}
+
+
+// NULL when the file or directory can not be read, failures are never kept
+static lm_parser_source_t *lm_parser_source_get(const char *path, bool is_dir)
+{
+    for(lm_parser_source_t *source = source_head; source; source = source->next) {
+        if(source->is_dir == is_dir && strcmp(source->path, path) == 0) {
+            return source;
+        }
+    }
+
+    lm_parser_source_t *source = lm_parser_source_read(path, is_dir);
+    if(source && source_keep) {
+        source->kept = true;
+        source->next = source_head;
+        source_head = source;
+    }
+
+    return source;
+}
+
+
+static void lm_parser_source_put(lm_parser_source_t *source)
+{
+    if(source && !source->kept) {
+        lm_parser_source_free(source);
+    }
+}
+
+
 static void lm_parser_skip_space(char **p)
 {
     while(**p) {
@@ -112,14 +304,20 @@ void lm_parser_init(void)
 
     for(int i = 0; i < len; i++) {
         lm_list_init(&list->head);
+        list->count = 0;
         list ++;
     }
 
+    // counts are reset too, so the parser can run again on a new memory pool
     lm_list_init(&config_head.node);
+    config_head.count = 0;
     lm_macro_list_cache_init(&config_head);
 
     lm_list_init(&macro_head.node);
+    macro_head.count = 0;
     lm_macro_list_cache_init(&macro_head);
+
+    memset(&lm_parser_scope, 0, sizeof(lm_parser_scope));
 }
 
 
@@ -209,7 +407,7 @@ static int lm_parser_config_file_key_string(char *readline)
 }
 
 
-int lm_parser_config_file(const char *path)
+static int lm_parser_config_file_read(const char *path)
 {
     if(path == NULL) {
         return 0; //no defconfig file
@@ -217,6 +415,10 @@ int lm_parser_config_file(const char *path)
 
     config_file = path;
 
+    if(input_hook) {
+        input_hook(path, false);
+    }
+
     lm_macro_t *macro = NULL;
     char *read_line = lm_parser_alloc();
 
@@ -233,6 +435,7 @@ int lm_parser_config_file(const char *path)
     while (fgets(read_line, MAX_PER_LINE_LENGTH, file_p)) {
 
         line_count++;
+        lm_time_count(LM_TIME_LINES);
 
         if (read_line[strlen(read_line) - 1] == '\n' 
            || read_line[strlen(read_line) - 1] == '\r') {
@@ -288,6 +491,17 @@ int lm_parser_config_file(const char *path)
 }
 
 
+int lm_parser_config_file(const char *path)
+{
+    LM_TRACE_SCOPE("lm_parser_config_file", path);
+    int timer = lm_time_begin("read config", path);
+    int ret = lm_parser_config_file_read(path);
+    lm_time_end(timer);
+
+    return ret;
+}
+
+
 static int lm_parser_macro_express_value(const char *expression, int *index);
 
 // 解析因子
@@ -583,10 +797,8 @@ static int lm_parser_get_keystring_depend_value(char* keystring)
 }
 
 
-static void lm_parser_src_add_wildcard(const char *wildcard, const char *path, lm_array_t *array)
+static int lm_parser_src_list_dir(const char *wildcard, const char *path, lm_array_t *array)
 {
-    DIR *dir;
-    struct dirent *entry;
     char file_name[MAX_FILE_PATH] = {0};
     char wildcard_path[MAX_FILE_PATH] = {0};
     char abs_path[MAX_FILE_PATH] = {0};
@@ -606,29 +818,43 @@ static void lm_parser_src_add_wildcard(const char *wildcard, const char *path, l
         strcpy(abs_path, path);
     }
 
-    dir = opendir(abs_path);
-    if (dir == NULL) {
-        LM_LOG_ERROR("%s: No such directory", abs_path);
-        lm_mem_destroy();
-        LM_LOG_ERROR("parser failed, exiting");
+    if(input_hook) {
+        input_hook(abs_path, true);
     }
 
-    while ((entry = readdir(dir)) != NULL) {
-        size_t len = strlen(entry->d_name);
-
-        if (len >= 2 && strcmp(entry->d_name + len - 2, ".c") == 0) {
-            if(strcmp(abs_path, ".") == 0) {
-                sprintf(file_name, "%s", entry->d_name);
-            }
-            else {
-                sprintf(file_name, "%s/%s", abs_path, entry->d_name);
-            }
+    lm_parser_source_t *listing = lm_parser_source_get(abs_path, true);
+    if (listing == NULL) {
+        LM_LOG_ERROR("%s: No such directory", abs_path);
+        return LM_ERR;
+    }
 
-            lm_array_add(array, file_name);
+    for(int i = 0; i < listing->count; i++) {
+        if(strcmp(abs_path, ".") == 0) {
+            sprintf(file_name, "%s", listing->line[i]);
         }
+        else {
+            sprintf(file_name, "%s/%s", abs_path, listing->line[i]);
+        }
+
+        lm_array_add(array, file_name);
     }
 
-    closedir(dir);
+    lm_parser_source_put(listing);
+    return LM_OK;
+}
+
+
+static int lm_parser_src_add_wildcard(const char *wildcard, const char *path, lm_array_t *array)
+{
+    char pattern[MAX_FILE_PATH];
+    snprintf(pattern, sizeof(pattern), "%s%s%s", strcmp(path, ".") == 0 ? "" : path, strcmp(path, ".") == 0 ? "" : "/", wildcard);
+
+    LM_TRACE_SCOPE("lm_parser_src_add_wildcard", pattern);
+    int timer = lm_time_begin("wildcard", pattern);
+    int ret = lm_parser_src_list_dir(wildcard, path, array);
+    lm_time_end(timer);
+
+    return ret;
 }
 
 
@@ -725,8 +951,11 @@ static lm_parser_err_e lm_parser_prompt_src_add_list(const char *path, char *rea
 
                 if(pick && array) {
                     if((strcmp(pick, "*.c") == 0)|| strcmp(pick + strlen(pick) - 3, "*.c") == 0) {
-                        lm_parser_src_add_wildcard(pick, path, array);
+                        int ret = lm_parser_src_add_wildcard(pick, path, array);
                         lm_free(pick);
+                        if(ret != LM_OK) {
+                            return LM_PARSER_SYNTAX;
+                        }
                     }
                     else {
                         if(strcmp(path, ".") == 0)
@@ -749,13 +978,11 @@ static lm_parser_err_e lm_parser_prompt_src_add_list(const char *path, char *rea
 }
 
 
+// flag lines joined from continuation lines run up to MAX_PER_LINE_LENGTH, the array keeps its own copy
 static void lm_parser_add_list_raw(lm_array_t *list, char *flag)
 {
-    char str[MAX_FILE_PATH];
-
     if(list) {
-        sprintf(str, "%s", flag);
-        lm_array_add(list, str);
+        lm_array_add(list, flag);
     }
 }
 
@@ -1068,6 +1295,89 @@ static char *lm_parser_prompt_process_var(char *read_line)
 }
 
 
+/*
+ * "LIBRARY name" and "TARGET name" open a block that lasts until an empty
+ * line or the end of the file, and covers the lm.cfg files it includes.
+ * SRC and ASM in a LIBRARY block are archived into lib<name>.a; SRC, ASM,
+ * LDS and LDFLAG in a TARGET block only go into the <name> executable.
+ */
+static lm_parser_err_e lm_parser_prompt_is_block(char *read_line, const char *keyword, lm_array_t *names, char *name)
+{
+    char *p = read_line;
+    int key_len = strlen(keyword);
+
+    if(strncmp(p, keyword, key_len) != 0 || (p[key_len] != ' ' && p[key_len] != '\0')) {
+        return LM_PARSER_NOT_MATCH;
+    }
+
+    if(lm_str_num_of_substr_split(p) != 2) {
+        return LM_PARSER_SYNTAX;
+    }
+
+    p += key_len;
+    lm_parser_skip_space(&p);
+
+    int len = 0;
+    while(p[len] && p[len] != ' ') {
+        if(!isalnum((unsigned char)p[len]) && p[len] != '_' && p[len] != '-') {
+            return LM_PARSER_SYNTAX;
+        }
+        len ++;
+    }
+
+    if(len == 0 || len >= MAX_MACRO_NAME) {
+        return LM_PARSER_SYNTAX;
+    }
+
+    memcpy(name, p, len);
+    name[len] = '\0';
+
+    lm_list_node_t *node = NULL;
+    lm_list_for_each(node, &names->head) {
+        lm_array_node_t *array_node = container_of(node, lm_array_node_t, node);
+        if(strcmp(array_node->string, name) == 0) {
+            return LM_PARSER_OK;
+        }
+    }
+
+    lm_array_add(names, name);
+    return LM_PARSER_OK;
+}
+
+
+/*
+ * Record every entry added to list after the first skip ones as
+ * <name>:<entry> in members, and drop them from list when move is set.
+ */
+static void lm_parser_block_tag(lm_array_t *list, int skip, lm_array_t *members, const char *name, bool move)
+{
+    char *str = lm_parser_alloc();
+    lm_list_node_t *node = lm_list_next_node(&list->head);
+    int index = 0;
+
+    while(node != &list->head) {
+        lm_list_node_t *next = lm_list_next_node(node);
+        lm_array_node_t *array_node = container_of(node, lm_array_node_t, node);
+
+        if(index++ >= skip) {
+            snprintf(str, MAX_PER_LINE_LENGTH, "%s:%s", name, array_node->string);
+            lm_array_add(members, str);
+
+            if(move) {
+                lm_list_del_node(node);
+                list->count --;
+                lm_free(array_node->string);
+                lm_free(array_node);
+            }
+        }
+
+        node = next;
+    }
+
+    lm_free(str);
+}
+
+
 static char *lm_parser_prompt_is_include(char *read_line)
 {
     char macro_depend[MAX_MACRO_NAME];
@@ -1347,6 +1657,8 @@ static lm_parser_err_e lm_parser_macro_set_value(lm_macro_t *macro)
         return LM_PARSER_OK;
     }
 
+    LM_TRACE_SCOPE("lm_parser_macro_set_value", macro->name);
+
     int value = lm_parser_get_macro_depend_value(macro);
     if(value == 0) {
         lm_macro_value_set(macro, "n");
@@ -1474,6 +1786,22 @@ static lm_parser_err_e lm_parser_lm_file_key_string(const char *base_path, char
         return prompt_err;
     }
 
+    prompt_err = lm_parser_key_string_add_list(&lm_parser_list.pch_list, base_path, NULL, false, "PCH", read_line);
+    if(prompt_err != LM_PARSER_NOT_MATCH) {
+        return prompt_err;
+    }
+
+    // the batch size is stored as <dir>/<size>, so it applies to the lm.cfg directory
+    prompt_err = lm_parser_key_string_add_list(&lm_parser_list.unity_list, base_path, NULL, false, "UNITY", read_line);
+    if(prompt_err != LM_PARSER_NOT_MATCH) {
+        return prompt_err;
+    }
+
+    prompt_err = lm_parser_key_string_add_list(&lm_parser_list.unity_exclude_list, base_path, NULL, false, "UNITY_EXCLUDE", read_line);
+    if(prompt_err != LM_PARSER_NOT_MATCH) {
+        return prompt_err;
+    }
+
     return LM_PARSER_NOT_MATCH;
 }
 
@@ -1533,49 +1861,12 @@ static void lm_parser_macro_choice_helper(const char *file, int lines, lm_macro_
 }
 
 
-static int lm_parser_file_line_preprocess(FILE *file, char *read_line)
-{
-    int count = 0;
-
-    if (read_line[strlen(read_line) - 1] == '\n' || read_line[strlen(read_line) - 1] == '\r') {
-        read_line[strlen(read_line) - 1] = '\0';
-    }
-
-    if(read_line[strlen(read_line) - 1] == '\\') {
-        read_line[strlen(read_line) - 1] = '\0';
-
-        char *read_line_tmp = lm_parser_alloc();
-
-        while(fgets(read_line_tmp, MAX_PER_LINE_LENGTH, file)) {
-            if (read_line_tmp[strlen(read_line_tmp) - 1] == '\n' || read_line_tmp[strlen(read_line_tmp) - 1] == '\r') {
-                read_line_tmp[strlen(read_line_tmp) - 1] = '\0';
-            }
-
-            count ++;
-            char *pure = lm_str_delete_head_tail_space(read_line_tmp);
-            
-            read_line[strlen(read_line) - 1] = '\0';
-            strcat(read_line, pure);
-            
-            lm_free(pure);
-            if(read_line_tmp[strlen(read_line_tmp) - 1] != '\\') {
-                break;
-            }
-        }
-
-        lm_free(read_line_tmp);
-    }
-
-    return count;
-}
-
-
-int lm_parser_lm_file(const char *base_path, const char *path)
+static int lm_parser_lm_file_read(const char *base_path, const char *path)
 {
     char *read_line = lm_parser_alloc();
     int line_count = 0;
     lm_macro_t *macro = NULL;
-    FILE *file_p = NULL;
+    lm_parser_source_t *source = NULL;
 
     char *full_path = lm_parser_alloc();
     if(base_path == NULL || (strcmp(base_path, ".") == 0)) {
@@ -1585,8 +1876,12 @@ int lm_parser_lm_file(const char *base_path, const char *path)
         sprintf(full_path, "%s/%s", base_path, path);
     }
 
-    file_p = fopen(full_path, "r"); // read only
-    if (file_p == NULL) {
+    if(input_hook) {
+        input_hook(full_path, false);
+    }
+
+    source = lm_parser_source_get(full_path, false);
+    if (source == NULL) {
         LM_LOG_ERROR("file: %s, No such file", full_path);
         return LM_ERR;
     }
@@ -1602,16 +1897,23 @@ int lm_parser_lm_file(const char *base_path, const char *path)
         strcpy(new_base_path, ".");
     }
 
-    while (fgets(read_line, MAX_PER_LINE_LENGTH, file_p)) {
+    // LIBRARY and TARGET blocks opened by the including file also cover this one
+    struct lm_parser_scope scope_outer = lm_parser_scope;
 
-        line_count++;
+    for (int index = 0; index < source->count; index++) {
 
-        line_count += lm_parser_file_line_preprocess(file_p, read_line);
+        // the matchers below may edit the line, a kept source must stay intact
+        strcpy(read_line, source->line[index]);
+        line_count = source->line_no[index];
+        lm_time_count(LM_TIME_LINES);
 
         if (lm_parser_is_skip_line(read_line)) {
             if(macro && macro->choice.count == 0) {
                 goto macro_err;
             }
+            if(lm_str_is_all_space(read_line)) {
+                lm_parser_scope = scope_outer;
+            }
             macro = NULL;
             continue;
         }
@@ -1626,18 +1928,14 @@ int lm_parser_lm_file(const char *base_path, const char *path)
         }
 
         if(sub_file != NULL) {
-            uint64_t file_pos = ftell(file_p);
-            fclose(file_p);
+            struct lm_parser_scope scope_saved = lm_parser_scope;
 
             int sub_ret = lm_parser_lm_file(new_base_path, sub_file);
             if(sub_ret != LM_OK) {
                 goto exit;
             }
             macro = NULL;
-
-            file_p = fopen(full_path, "r");
-            fseek(file_p, file_pos, SEEK_SET);
-
+            lm_parser_scope = scope_saved;
             continue;
         }
 
@@ -1651,7 +1949,9 @@ int lm_parser_lm_file(const char *base_path, const char *path)
                 goto macro_err;
             }
 
+            double resolve_start = lm_time_now();
             lm_parser_err_e val_ret = lm_parser_macro_set_value(macro);
+            lm_time_resolve(resolve_start);
             if(val_ret == LM_PARSER_INVALID_VALUE) {
                 lm_parser_macro_choice_helper(full_path, line_count, macro);
                 goto exit;
@@ -1667,8 +1967,44 @@ int lm_parser_lm_file(const char *base_path, const char *path)
             continue;
         }
 
+        lm_parser_err_e block_ret = lm_parser_prompt_is_block(read_line, "LIBRARY", &lm_parser_list.library_list, lm_parser_scope.library);
+        if(block_ret == LM_PARSER_NOT_MATCH) {
+            block_ret = lm_parser_prompt_is_block(read_line, "TARGET", &lm_parser_list.target_list, lm_parser_scope.target);
+        }
+
+        if(block_ret == LM_PARSER_OK) {
+            macro = NULL;
+            continue;
+        }
+        else if(block_ret == LM_PARSER_SYNTAX) {
+            goto syntax_err;
+        }
+
+        int src_count = lm_parser_list.src_list.count;
+        int asm_count = lm_parser_list.asm_list.count;
+        int lds_count = lm_parser_list.lds_list.count;
+        int ldflag_count = lm_parser_list.ldflag_list.count;
+
         lm_parser_err_e key_ret = lm_parser_lm_file_key_string(new_base_path, read_line);
         if(key_ret == LM_PARSER_OK) {
+            if(lm_parser_scope.library[0] != '\0') {
+                lm_parser_block_tag(&lm_parser_list.src_list, src_count, &lm_parser_list.library_member_list, lm_parser_scope.library, false);
+                lm_parser_block_tag(&lm_parser_list.asm_list, asm_count, &lm_parser_list.library_member_list, lm_parser_scope.library, false);
+            }
+
+            // target sources are still compiled with everything else, link inputs only belong to the target
+            if(lm_parser_scope.target[0] != '\0') {
+                char *scope = lm_parser_alloc();
+                sprintf(scope, "%s:SRC", lm_parser_scope.target);
+                lm_parser_block_tag(&lm_parser_list.src_list, src_count, &lm_parser_list.target_member_list, scope, false);
+                sprintf(scope, "%s:ASM", lm_parser_scope.target);
+                lm_parser_block_tag(&lm_parser_list.asm_list, asm_count, &lm_parser_list.target_member_list, scope, false);
+                sprintf(scope, "%s:LDS", lm_parser_scope.target);
+                lm_parser_block_tag(&lm_parser_list.lds_list, lds_count, &lm_parser_list.target_member_list, scope, true);
+                sprintf(scope, "%s:LDFLAG", lm_parser_scope.target);
+                lm_parser_block_tag(&lm_parser_list.ldflag_list, ldflag_count, &lm_parser_list.target_member_list, scope, true);
+                lm_free(scope);
+            }
             macro = NULL;
             continue;
         }
@@ -1691,7 +2027,9 @@ int lm_parser_lm_file(const char *base_path, const char *path)
         goto exit;
     }
 
-    fclose(file_p); // close file
+    lm_parser_scope = scope_outer;
+
+    lm_parser_source_put(source);
     lm_free(read_line);
     lm_free(full_path);
     lm_free(new_base_path);
@@ -1699,23 +2037,43 @@ int lm_parser_lm_file(const char *base_path, const char *path)
 
 syntax_err:
     LM_LOG_ERROR("file: %s:%d, invalid syntax", full_path, line_count);
-    fclose(file_p); // close file
+    lm_parser_source_put(source);
     lm_free(read_line);
     return LM_ERR;
 
 macro_err:
     LM_LOG_ERROR("file: %s:%d, missing 'choice' attribute", full_path, line_count);
-    fclose(file_p); // close file
+    lm_parser_source_put(source);
     lm_free(read_line);
     return LM_ERR;
 
 exit:
-    fclose(file_p); // close file
+    lm_parser_source_put(source);
     lm_free(read_line);
     return LM_ERR;
 }
 
 
+int lm_parser_lm_file(const char *base_path, const char *path)
+{
+    char full_path[MAX_FILE_PATH];
+
+    if(base_path == NULL || strcmp(base_path, ".") == 0) {
+        snprintf(full_path, sizeof(full_path), "%s", path);
+    }
+    else {
+        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, path);
+    }
+
+    LM_TRACE_SCOPE("lm_parser_lm_file", full_path);
+    int timer = lm_time_begin("parse", full_path);
+    int ret = lm_parser_lm_file_read(base_path, path);
+    lm_time_end(timer);
+
+    return ret;
+}
+
+
 void lm_parser_print_macro_list(void)
 {
     lm_macro_print_all(stdout, &macro_head);
@@ -1786,3 +2144,38 @@ char* lm_parser_get_parser_list_name(int index)
 {
     return lm_parser_list_name[index];
 }
+
+
+void lm_parser_set_input_hook(lm_parser_input_fn hook)
+{
+    input_hook = hook;
+}
+
+
+void lm_parser_keep_sources(bool keep)
+{
+    source_keep = keep;
+
+    if(!keep) {
+        while(source_head) {
+            lm_parser_source_t *next = source_head->next;
+            lm_parser_source_free(source_head);
+            source_head = next;
+        }
+    }
+}
+
+
+lm_array_t* lm_parser_get_list(const char *name)
+{
+    int len = sizeof(lm_parser_list_name) / sizeof(lm_parser_list_name[0]);
+    lm_array_t *list = (lm_array_t*)&lm_parser_list;
+
+    for(int i = 0; i < len; i++) {
+        if(strcmp(lm_parser_list_name[i], name) == 0) {
+            return list + i;
+        }
+    }
+
+    return NULL;
+}
@@ -41,6 +41,13 @@
 #define    VAR_LD_FLAG              "LD_FLAG"
 #define    VAR_LIB_NAME             "LIB_NAME"
 #define    VAR_LIB_PATH             "LIB_PATH"
+#define    VAR_PCH_SOURCE           "PCH_SOURCE"
+#define    VAR_UNITY                "UNITY"
+#define    VAR_UNITY_EXCLUDE        "UNITY_EXCLUDE"
+#define    VAR_LIBRARY              "LIBRARY"
+#define    VAR_LIBRARY_MEMBER       "LIBRARY_MEMBER"
+#define    VAR_TARGETS              "TARGETS"
+#define    VAR_TARGET_MEMBER        "TARGET_MEMBER"
 
 
 typedef enum lm_parser_err {
@@ -54,6 +61,10 @@ typedef enum lm_parser_err {
 }lm_parser_err_e;
 
 
+/* told about every file the parser reads, and every directory a wildcard lists */
+typedef void (*lm_parser_input_fn)(const char *path, bool is_dir);
+
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -74,6 +85,14 @@ lm_macro_head_t* lm_parser_get_config_head(void);
 int lm_parser_get_parser_list_count(void);
 struct lm_parser_list* lm_parser_get_parser_list_head(void);
 char* lm_parser_get_parser_list_name(int index);
+lm_array_t* lm_parser_get_list(const char *name);
+void lm_parser_set_input_hook(lm_parser_input_fn hook);
+
+/*
+ * Keep the lm.cfg files and wildcard listings read from now on in memory,
+ * later parses reuse them instead of the file system. false drops them.
+ */
+void lm_parser_keep_sources(bool keep);
 
 
 
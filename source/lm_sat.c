@@ -0,0 +1,596 @@
+/* source/lm_sat.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lm_sat.h"
+#include "lm_error.h"
+
+
+#define    LM_SAT_RESTART_BASE      100
+#define    LM_SAT_DECAY             0.95
+
+
+typedef struct lm_sat_vec {
+    int *data;
+    int count;
+    int size;
+}lm_sat_vec_t;
+
+
+static struct lm_sat {
+    int vars;
+    int size;                   // capacity of the per variable arrays
+
+    signed char *value;         // -1 unassigned, else 0 or 1
+    char *phase;
+    char *model;
+    char *seen;
+    int *level;
+    int *reason;                // clause offset, -1 for decisions and level 0 facts
+    double *activity;
+    double var_inc;
+
+    int *heap;                  // unassigned candidates, highest activity first
+    int *heap_index;
+    int heap_count;
+
+    lm_sat_vec_t *watches;      // per literal, the clauses to visit when it turns true
+    lm_sat_vec_t clauses;       // length followed by the literals, watched literals first
+    lm_sat_vec_t trail;
+    lm_sat_vec_t trail_lim;
+    lm_sat_vec_t learnt;
+    int qhead;
+    bool ok;
+}sat;
+
+
+static int lm_sat_push(lm_sat_vec_t *vec, int value)
+{
+    if(vec->count == vec->size) {
+        int size = vec->size ? vec->size * 2 : 16;
+        int *data = realloc(vec->data, size * sizeof(int));
+        if(data == NULL) {
+            return LM_ERR;
+        }
+        vec->data = data;
+        vec->size = size;
+    }
+
+    vec->data[vec->count++] = value;
+    return LM_OK;
+}
+
+
+static int lm_sat_lit_value(int lit)
+{
+    int value = sat.value[LM_SAT_VAR(lit)];
+    return value < 0 ? -1 : value ^ (lit & 1);
+}
+
+
+static bool lm_sat_heap_less(int a, int b)
+{
+    return sat.activity[a] > sat.activity[b];
+}
+
+
+static void lm_sat_heap_up(int pos)
+{
+    int var = sat.heap[pos];
+
+    while(pos > 0 && lm_sat_heap_less(var, sat.heap[(pos - 1) / 2])) {
+        sat.heap[pos] = sat.heap[(pos - 1) / 2];
+        sat.heap_index[sat.heap[pos]] = pos;
+        pos = (pos - 1) / 2;
+    }
+
+    sat.heap[pos] = var;
+    sat.heap_index[var] = pos;
+}
+
+
+static void lm_sat_heap_down(int pos)
+{
+    int var = sat.heap[pos];
+
+    for(;;) {
+        int child = pos * 2 + 1;
+        if(child >= sat.heap_count) {
+            break;
+        }
+        if(child + 1 < sat.heap_count && lm_sat_heap_less(sat.heap[child + 1], sat.heap[child])) {
+            child++;
+        }
+        if(!lm_sat_heap_less(sat.heap[child], var)) {
+            break;
+        }
+        sat.heap[pos] = sat.heap[child];
+        sat.heap_index[sat.heap[pos]] = pos;
+        pos = child;
+    }
+
+    sat.heap[pos] = var;
+    sat.heap_index[var] = pos;
+}
+
+
+static void lm_sat_heap_insert(int var)
+{
+    if(sat.heap_index[var] >= 0) {
+        return;
+    }
+
+    sat.heap[sat.heap_count] = var;
+    sat.heap_index[var] = sat.heap_count;
+    lm_sat_heap_up(sat.heap_count++);
+}
+
+
+static int lm_sat_heap_pop(void)
+{
+    int var = sat.heap[0];
+
+    sat.heap_index[var] = -1;
+    if(--sat.heap_count > 0) {
+        sat.heap[0] = sat.heap[sat.heap_count];
+        lm_sat_heap_down(0);
+    }
+
+    return var;
+}
+
+
+static void lm_sat_bump(int var)
+{
+    sat.activity[var] += sat.var_inc;
+
+    if(sat.activity[var] > 1e100) {
+        for(int i = 0; i < sat.vars; i++) {
+            sat.activity[i] *= 1e-100;
+        }
+        sat.var_inc *= 1e-100;
+    }
+
+    if(sat.heap_index[var] >= 0) {
+        lm_sat_heap_up(sat.heap_index[var]);
+    }
+}
+
+
+int lm_sat_init(void)
+{
+    lm_sat_free();
+
+    sat.var_inc = 1;
+    sat.ok = true;
+    return LM_OK;
+}
+
+
+void lm_sat_free(void)
+{
+    for(int i = 0; i < sat.size * 2; i++) {
+        free(sat.watches[i].data);
+    }
+
+    free(sat.value);
+    free(sat.phase);
+    free(sat.model);
+    free(sat.seen);
+    free(sat.level);
+    free(sat.reason);
+    free(sat.activity);
+    free(sat.heap);
+    free(sat.heap_index);
+    free(sat.watches);
+    free(sat.clauses.data);
+    free(sat.trail.data);
+    free(sat.trail_lim.data);
+    free(sat.learnt.data);
+    memset(&sat, 0, sizeof(sat));
+}
+
+
+#define LM_SAT_GROW(array, size) do {                                       \
+        void *grow = realloc((array), (size) * sizeof(*(array)));           \
+        if(grow == NULL) {                                                  \
+            return -1;                                                      \
+        }                                                                   \
+        (array) = grow;                                                     \
+    } while(0)
+
+
+int lm_sat_new_var(void)
+{
+    if(sat.vars == sat.size) {
+        int size = sat.size ? sat.size * 2 : 256;
+
+        LM_SAT_GROW(sat.value, size);
+        LM_SAT_GROW(sat.phase, size);
+        LM_SAT_GROW(sat.model, size);
+        LM_SAT_GROW(sat.seen, size);
+        LM_SAT_GROW(sat.level, size);
+        LM_SAT_GROW(sat.reason, size);
+        LM_SAT_GROW(sat.activity, size);
+        LM_SAT_GROW(sat.heap, size);
+        LM_SAT_GROW(sat.heap_index, size);
+        LM_SAT_GROW(sat.watches, size * 2);
+
+        memset(&sat.watches[sat.size * 2], 0, (size - sat.size) * 2 * sizeof(lm_sat_vec_t));
+        sat.size = size;
+    }
+
+    int var = sat.vars++;
+
+    sat.value[var] = -1;
+    sat.phase[var] = 0;
+    sat.model[var] = 0;
+    sat.seen[var] = 0;
+    sat.level[var] = 0;
+    sat.reason[var] = -1;
+    sat.activity[var] = 0;
+    sat.heap_index[var] = -1;
+    lm_sat_heap_insert(var);
+
+    return var;
+}
+
+
+void lm_sat_set_phase(int var, bool value)
+{
+    sat.phase[var] = value;
+}
+
+
+bool lm_sat_value(int var)
+{
+    return sat.model[var];
+}
+
+
+static void lm_sat_enqueue(int lit, int reason)
+{
+    int var = LM_SAT_VAR(lit);
+
+    sat.value[var] = !(lit & 1);
+    sat.level[var] = sat.trail_lim.count;
+    sat.reason[var] = reason;
+    lm_sat_push(&sat.trail, lit);
+}
+
+
+// returns the offset of a falsified clause, or -1
+static int lm_sat_propagate(void)
+{
+    while(sat.qhead < sat.trail.count) {
+        int p = sat.trail.data[sat.qhead++];
+        int false_lit = LM_SAT_NEG(p);
+        lm_sat_vec_t *ws = &sat.watches[p];
+        int i = 0;
+        int j = 0;
+
+        while(i < ws->count) {
+            int cr = ws->data[i++];
+            int len = sat.clauses.data[cr];
+            int *c = &sat.clauses.data[cr + 1];
+
+            if(c[0] == false_lit) {
+                c[0] = c[1];
+                c[1] = false_lit;
+            }
+
+            if(lm_sat_lit_value(c[0]) == 1) {
+                ws->data[j++] = cr;
+                continue;
+            }
+
+            bool moved = false;
+            for(int k = 2; k < len; k++) {
+                if(lm_sat_lit_value(c[k]) != 0) {
+                    c[1] = c[k];
+                    c[k] = false_lit;
+                    lm_sat_push(&sat.watches[LM_SAT_NEG(c[1])], cr);
+                    moved = true;
+                    break;
+                }
+            }
+            if(moved) {
+                continue;
+            }
+
+            ws->data[j++] = cr;
+
+            if(lm_sat_lit_value(c[0]) == 0) {
+                while(i < ws->count) {
+                    ws->data[j++] = ws->data[i++];
+                }
+                ws->count = j;
+                sat.qhead = sat.trail.count;
+                return cr;
+            }
+
+            lm_sat_enqueue(c[0], cr);
+        }
+
+        ws->count = j;
+    }
+
+    return -1;
+}
+
+
+static void lm_sat_cancel(int level)
+{
+    if(sat.trail_lim.count <= level) {
+        return;
+    }
+
+    for(int i = sat.trail.count - 1; i >= sat.trail_lim.data[level]; i--) {
+        int var = LM_SAT_VAR(sat.trail.data[i]);
+
+        sat.phase[var] = sat.value[var];
+        sat.value[var] = -1;
+        sat.reason[var] = -1;
+        lm_sat_heap_insert(var);
+    }
+
+    sat.trail.count = sat.trail_lim.data[level];
+    sat.trail_lim.count = level;
+    sat.qhead = sat.trail.count;
+}
+
+
+// first UIP clause into sat.learnt, returns the level to go back to
+static int lm_sat_analyze(int confl)
+{
+    int level = sat.trail_lim.count;
+    int index = sat.trail.count - 1;
+    int paths = 0;
+    int p = -1;
+
+    sat.learnt.count = 0;
+    lm_sat_push(&sat.learnt, 0);
+
+    do {
+        int len = sat.clauses.data[confl];
+        int *c = &sat.clauses.data[confl + 1];
+
+        // the first literal of a reason clause is the one it implied
+        for(int j = p < 0 ? 0 : 1; j < len; j++) {
+            int var = LM_SAT_VAR(c[j]);
+
+            if(sat.seen[var] || sat.level[var] == 0) {
+                continue;
+            }
+
+            lm_sat_bump(var);
+            sat.seen[var] = 1;
+            if(sat.level[var] >= level) {
+                paths++;
+            }
+            else {
+                lm_sat_push(&sat.learnt, c[j]);
+            }
+        }
+
+        while(!sat.seen[LM_SAT_VAR(sat.trail.data[index])]) {
+            index--;
+        }
+
+        p = sat.trail.data[index--];
+        confl = sat.reason[LM_SAT_VAR(p)];
+        sat.seen[LM_SAT_VAR(p)] = 0;
+        paths--;
+    } while(paths > 0);
+
+    sat.learnt.data[0] = LM_SAT_NEG(p);
+
+    int back = 0;
+    for(int i = 1; i < sat.learnt.count; i++) {
+        int var = LM_SAT_VAR(sat.learnt.data[i]);
+
+        sat.seen[var] = 0;
+        if(sat.level[var] > back) {
+            back = sat.level[var];
+            int tmp = sat.learnt.data[1];
+            sat.learnt.data[1] = sat.learnt.data[i];
+            sat.learnt.data[i] = tmp;
+        }
+    }
+
+    return back;
+}
+
+
+static int lm_sat_store(const int *lits, int len)
+{
+    int cr = sat.clauses.count;
+
+    if(lm_sat_push(&sat.clauses, len) != LM_OK) {
+        return -1;
+    }
+    for(int i = 0; i < len; i++) {
+        if(lm_sat_push(&sat.clauses, lits[i]) != LM_OK) {
+            return -1;
+        }
+    }
+
+    if(lm_sat_push(&sat.watches[LM_SAT_NEG(lits[0])], cr) != LM_OK
+        || lm_sat_push(&sat.watches[LM_SAT_NEG(lits[1])], cr) != LM_OK) {
+        return -1;
+    }
+
+    return cr;
+}
+
+
+int lm_sat_add_clause(const int *lits, int len)
+{
+    int kept[len + 1];
+    int count = 0;
+
+    if(!sat.ok) {
+        return LM_ERR;
+    }
+
+    // clauses are added at level 0, drop false literals and satisfied clauses
+    for(int i = 0; i < len; i++) {
+        int value = lm_sat_lit_value(lits[i]);
+        bool skip = value == 0;
+
+        if(value == 1) {
+            return LM_OK;
+        }
+
+        for(int j = 0; j < count && !skip; j++) {
+            if(kept[j] == LM_SAT_NEG(lits[i])) {
+                return LM_OK;
+            }
+            skip = kept[j] == lits[i];
+        }
+
+        if(!skip) {
+            kept[count++] = lits[i];
+        }
+    }
+
+    if(count == 0) {
+        sat.ok = false;
+        return LM_OK;
+    }
+
+    if(count == 1) {
+        lm_sat_enqueue(kept[0], -1);
+        sat.ok = lm_sat_propagate() < 0;
+        return LM_OK;
+    }
+
+    return lm_sat_store(kept, count) < 0 ? LM_ERR : LM_OK;
+}
+
+
+static int lm_sat_luby(int x)
+{
+    int size = 1;
+    int seq = 0;
+
+    while(size < x + 1) {
+        seq++;
+        size = 2 * size + 1;
+    }
+
+    while(size - 1 != x) {
+        size = (size - 1) >> 1;
+        seq--;
+        x = x % size;
+    }
+
+    return 1 << seq;
+}
+
+
+int lm_sat_solve(const int *assumptions, int count)
+{
+    int restarts = 0;
+    int conflicts = 0;
+    int limit = LM_SAT_RESTART_BASE * lm_sat_luby(0);
+
+    if(!sat.ok) {
+        return LM_SAT_UNSAT;
+    }
+
+    for(;;) {
+        int confl = lm_sat_propagate();
+
+        if(confl >= 0) {
+            conflicts++;
+
+            if(sat.trail_lim.count == 0) {
+                sat.ok = false;
+                return LM_SAT_UNSAT;
+            }
+
+            int back = lm_sat_analyze(confl);
+            lm_sat_cancel(back);
+
+            if(sat.learnt.count == 1) {
+                lm_sat_enqueue(sat.learnt.data[0], -1);
+            }
+            else {
+                int cr = lm_sat_store(sat.learnt.data, sat.learnt.count);
+                if(cr < 0) {
+                    lm_sat_cancel(0);
+                    return LM_SAT_UNSAT;
+                }
+                lm_sat_enqueue(sat.learnt.data[0], cr);
+            }
+
+            sat.var_inc /= LM_SAT_DECAY;
+            continue;
+        }
+
+        if(conflicts >= limit) {
+            conflicts = 0;
+            limit = LM_SAT_RESTART_BASE * lm_sat_luby(++restarts);
+            lm_sat_cancel(0);
+            continue;
+        }
+
+        int lit = -1;
+
+        // every assumption takes a decision level of its own
+        while(sat.trail_lim.count < count) {
+            int a = assumptions[sat.trail_lim.count];
+            int value = lm_sat_lit_value(a);
+
+            if(value == 0) {
+                lm_sat_cancel(0);
+                return LM_SAT_UNSAT;
+            }
+            if(value < 0) {
+                lit = a;
+                break;
+            }
+            lm_sat_push(&sat.trail_lim, sat.trail.count);
+        }
+
+        while(lit < 0 && sat.heap_count > 0) {
+            int var = lm_sat_heap_pop();
+            if(sat.value[var] < 0) {
+                lit = LM_SAT_LIT(var, !sat.phase[var]);
+            }
+        }
+
+        if(lit < 0) {
+            for(int i = 0; i < sat.vars; i++) {
+                sat.model[i] = sat.value[i];
+            }
+            lm_sat_cancel(0);
+            return LM_SAT_SAT;
+        }
+
+        lm_sat_push(&sat.trail_lim, sat.trail.count);
+        lm_sat_enqueue(lit, -1);
+    }
+}
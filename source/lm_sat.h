@@ -0,0 +1,73 @@
+/* source/lm_sat.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_SAT_H__
+#define __LM_SAT_H__
+
+#include <stdbool.h>
+
+
+/* a literal is a variable index times two, plus one when negated */
+#define    LM_SAT_LIT(var, neg)     ((var) * 2 + ((neg) ? 1 : 0))
+#define    LM_SAT_NEG(lit)          ((lit) ^ 1)
+#define    LM_SAT_VAR(lit)          ((lit) >> 1)
+
+#define    LM_SAT_UNSAT             0
+#define    LM_SAT_SAT               1
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Conflict driven clause learning solver: two watched literals, first UIP
+ * learning, activity ordered decisions, saved phases and Luby restarts.
+ * There is a single solver instance; clauses are added between solves.
+ */
+int lm_sat_init(void);
+void lm_sat_free(void);
+
+int lm_sat_new_var(void);
+int lm_sat_add_clause(const int *lits, int len);
+
+
+/**
+ * Solve with the assumption literals forced true. Learnt clauses are kept
+ * for the next call. After LM_SAT_SAT, lm_sat_value reads the model.
+ */
+int lm_sat_solve(const int *assumptions, int count);
+bool lm_sat_value(int var);
+
+
+/* value tried first when the solver decides var */
+void lm_sat_set_phase(int var, bool value);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_SAT_H__
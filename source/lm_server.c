@@ -0,0 +1,753 @@
+/* source/lm_server.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lm_server.h"
+#include "lm_parser.h"
+#include "lm_watch.h"
+#include "lm_mem.h"
+#include "lm_error.h"
+#include "lm_log.h"
+
+
+#if ( __linux__)
+
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+
+#define    LM_SERVER_MAX_VALUE      4096
+#define    LM_SERVER_MAX_ERRORS     8
+
+
+typedef struct lm_server_client {
+    int fd;             // read side
+    int out;            // write side, the same socket or the saved stdout
+    char *buf;
+    int len;
+}lm_server_client_t;
+
+
+typedef struct lm_server_pair {
+    char *name;
+    char *value;
+}lm_server_pair_t;
+
+
+static struct lm_server {
+    const char *lmcfg;
+    const char *projcfg;
+    int mem_size;
+    int watch_fd;
+    bool pool;          // the memory pool is initialized
+    bool loaded;        // the pool holds a good parse of projcfg
+    char tmp_config[64];
+
+    char *log;          // log lines of the last parse
+    size_t log_len;
+}server;
+
+
+/*
+ * Parse into a fresh pool with the log captured, the errors go back to the
+ * client instead of the terminal.
+ */
+static int lm_server_parse(const char *config)
+{
+    free(server.log);
+    server.log = NULL;
+    server.log_len = 0;
+
+    FILE *log = open_memstream(&server.log, &server.log_len);
+    lm_log_set_output(log);
+
+    if(server.pool) {
+        lm_mem_destroy();
+    }
+    server.pool = lm_mem_init(server.mem_size) == 0;
+    lm_parser_init();
+
+    int ret = server.pool ? lm_parser_config_file(config) : LM_ERR;
+    if(ret == LM_OK) {
+        ret = lm_parser_lm_file(NULL, server.lmcfg);
+    }
+
+    lm_log_set_output(NULL);
+    if(log) {
+        fclose(log);
+    }
+
+    return ret;
+}
+
+
+static int lm_server_load(void)
+{
+    if(!server.loaded) {
+        server.loaded = lm_server_parse(server.projcfg) == LM_OK;
+        lm_watch_sync(server.watch_fd);
+    }
+
+    return server.loaded ? LM_OK : LM_ERR;
+}
+
+
+static void lm_server_put_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+
+    for(const unsigned char *p = (const unsigned char*)str; *p; p++) {
+        if(*p == '"' || *p == '\\') {
+            fprintf(out, "\\%c", *p);
+        }
+        else if(*p < 0x20) {
+            fprintf(out, "\\u%04x", *p);
+        }
+        else {
+            fputc(*p, out);
+        }
+    }
+
+    fputc('"', out);
+}
+
+
+// the ERROR lines of the last parse as a json array, without the color codes
+static void lm_server_put_errors(FILE *out)
+{
+    int count = 0;
+
+    fputc('[', out);
+
+    for(char *line = server.log; line && *line && count < LM_SERVER_MAX_ERRORS;) {
+        char *end = strchr(line, '\n');
+        size_t len = end ? (size_t)(end - line) : strlen(line);
+        char *text = strstr(line, "[ERROR]");
+
+        if(text != NULL && text < line + len) {
+            char msg[LM_SERVER_MAX_VALUE];
+            text += strlen("[ERROR]");
+            text += strspn(text, " ");
+            if(strncmp(text, "\x1b[0m", 4) == 0) {
+                text += 4;
+            }
+            text += strspn(text, " ");
+            snprintf(msg, sizeof(msg), "%.*s", (int)(line + len - text), text);
+
+            // name the project config, not the edited copy of it
+            size_t tmp_len = strlen(server.tmp_config);
+            if(strncmp(msg, server.tmp_config, tmp_len) == 0) {
+                char rest[LM_SERVER_MAX_VALUE];
+                snprintf(rest, sizeof(rest), "%s", msg + tmp_len);
+                snprintf(msg, sizeof(msg), "%s%s", server.projcfg, rest);
+            }
+
+            fputs(count++ ? "," : "", out);
+            lm_server_put_string(out, msg);
+        }
+
+        line = end ? end + 1 : line + len;
+    }
+
+    fputc(']', out);
+}
+
+
+// value of "key" in a flat json object, string values only
+static bool lm_server_get(const char *json, const char *key, char *value, int size)
+{
+    char pattern[LM_SERVER_MAX_VALUE];
+    const char *p = json;
+
+    snprintf(pattern, sizeof(pattern), "\"%s\"", key);
+
+    while((p = strstr(p, pattern)) != NULL) {
+        const char *q = p + strlen(pattern);
+        q += strspn(q, " \t");
+        if(*q != ':') {
+            p = q;
+            continue;
+        }
+
+        q++;
+        q += strspn(q, " \t");
+        if(*q != '"') {
+            return false;
+        }
+
+        int len = 0;
+        for(q++; *q && *q != '"' && len < size - 1; q++) {
+            if(*q == '\\' && q[1]) {
+                q++;
+            }
+            value[len++] = *q;
+        }
+        value[len] = '\0';
+
+        return *q == '"';
+    }
+
+    return false;
+}
+
+
+static bool lm_server_is_enabled(const char *value)
+{
+    return value != NULL && strcmp(value, "n") != 0 && strcmp(value, " ") != 0;
+}
+
+
+static void lm_server_value(FILE *out, const char *name)
+{
+    lm_macro_t *macro = lm_macro_search_by_name(lm_parser_get_macro_head(), (char*)name);
+
+    if(macro == NULL) {
+        fprintf(out, "{\"ok\":false,\"error\":");
+        lm_server_put_string(out, "macro is not declared");
+        fputc('}', out);
+        return;
+    }
+
+    fprintf(out, "{\"ok\":true,\"macro\":");
+    lm_server_put_string(out, name);
+    fprintf(out, ",\"value\":");
+    lm_server_put_string(out, macro->value ? macro->value : "");
+    fprintf(out, ",\"enabled\":%s}", lm_server_is_enabled(macro->value) ? "true" : "false");
+}
+
+
+static const char *lm_server_strip(const char *path)
+{
+    while(strncmp(path, "./", 2) == 0) {
+        path += 2;
+    }
+
+    return path;
+}
+
+
+static bool lm_server_in_list(const char *list_name, const char *file)
+{
+    lm_array_t *list = lm_parser_get_list(list_name);
+    lm_list_node_t *node;
+
+    lm_list_for_each(node, &list->head) {
+        if(strcmp(lm_server_strip(container_of(node, lm_array_node_t, node)->string), file) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// owners of file in a LIBRARY_MEMBER ("lib:src") or TARGET_MEMBER ("target:SRC:src") list
+static void lm_server_put_owners(FILE *out, const char *list_name, const char *key, const char *file)
+{
+    lm_array_t *list = lm_parser_get_list(list_name);
+    lm_list_node_t *node;
+    int count = 0;
+
+    fputc('[', out);
+
+    lm_list_for_each(node, &list->head) {
+        const char *entry = container_of(node, lm_array_node_t, node)->string;
+        const char *colon = strchr(entry, ':');
+        if(colon == NULL) {
+            continue;
+        }
+
+        const char *value = colon + 1;
+        if(key) {
+            size_t key_len = strlen(key);
+            if(strncmp(value, key, key_len) != 0 || value[key_len] != ':') {
+                continue;
+            }
+            value += key_len + 1;
+        }
+
+        if(strcmp(lm_server_strip(value), file) == 0) {
+            char owner[LM_SERVER_MAX_VALUE];
+            snprintf(owner, sizeof(owner), "%.*s", (int)(colon - entry), entry);
+            fputs(count++ ? "," : "", out);
+            lm_server_put_string(out, owner);
+        }
+    }
+
+    fputc(']', out);
+}
+
+
+static void lm_server_put_list(FILE *out, const char *list_name, int *count)
+{
+    lm_array_t *list = lm_parser_get_list(list_name);
+    lm_list_node_t *node;
+
+    lm_list_for_each(node, &list->head) {
+        const char *string = container_of(node, lm_array_node_t, node)->string;
+
+        // one argument per element, an entry may hold several flags
+        for(string += strspn(string, " \t"); *string; string += strspn(string, " \t")) {
+            char flag[LM_SERVER_MAX_VALUE];
+            int len = strcspn(string, " \t");
+
+            snprintf(flag, sizeof(flag), "%.*s", len, string);
+            fputs((*count)++ ? "," : "", out);
+            lm_server_put_string(out, flag);
+            string += len;
+        }
+    }
+}
+
+
+static void lm_server_source(FILE *out, const char *path, bool flags)
+{
+    const char *file = lm_server_strip(path);
+    const char *ext = strrchr(file, '.');
+    bool is_asm = ext && (strcmp(ext, ".s") == 0 || strcmp(ext, ".S") == 0 || strcmp(ext, ".asm") == 0);
+    bool compiled = lm_server_in_list(is_asm ? VAR_ASM_SOURCE : VAR_C_SOURCE, file);
+
+    fprintf(out, "{\"ok\":true,\"file\":");
+    lm_server_put_string(out, path);
+    fprintf(out, ",\"compiled\":%s", compiled ? "true" : "false");
+
+    if(!flags) {
+        fprintf(out, ",\"libraries\":");
+        lm_server_put_owners(out, VAR_LIBRARY_MEMBER, NULL, file);
+        fprintf(out, ",\"targets\":");
+        lm_server_put_owners(out, VAR_TARGET_MEMBER, is_asm ? "ASM" : "SRC", file);
+        fputc('}', out);
+        return;
+    }
+
+    // same order as CFLAGS and ASFLAGS in the generated Makefile
+    int count = 0;
+    fprintf(out, ",\"flags\":[");
+    lm_server_put_list(out, VAR_MC_FLAG, &count);
+    lm_server_put_list(out, VAR_C_PATH, &count);
+    lm_server_put_list(out, VAR_C_DEFINE, &count);
+    if(is_asm) {
+        lm_server_put_list(out, VAR_AS_FLAG, &count);
+    }
+    else {
+        lm_server_put_list(out, VAR_C_FLAG, &count);
+        lm_server_put_list(out, VAR_CPP_FLAG, &count);
+    }
+    fprintf(out, "]}");
+}
+
+
+// current .config with one line replaced, or appended when the macro is not in it
+static int lm_server_edit(const char *name, const char *value)
+{
+    char line[LM_SERVER_MAX_LINE];
+    char key[LM_SERVER_MAX_LINE];
+    bool replaced = false;
+
+    FILE *dst = fopen(server.tmp_config, "w");
+    if(dst == NULL) {
+        return LM_ERR;
+    }
+
+    FILE *src = fopen(server.projcfg, "r");
+    while(src && fgets(line, sizeof(line), src)) {
+        char *eq = strchr(line, '=');
+        int len = 0;
+
+        for(char *p = line; eq && p < eq; p++) {
+            if(*p != ' ' && *p != '\t') {
+                key[len++] = *p;
+            }
+        }
+        key[len] = '\0';
+
+        if(line[0] != '#' && eq && strcmp(key, name) == 0) {
+            if(!replaced) {
+                fprintf(dst, "%s=%s\n", name, value);
+            }
+            replaced = true;
+            continue;
+        }
+
+        fputs(line, dst);
+        if(line[strlen(line) - 1] != '\n') {
+            fputc('\n', dst);
+        }
+    }
+
+    if(!replaced) {
+        fprintf(dst, "%s=%s\n", name, value);
+    }
+
+    if(src) {
+        fclose(src);
+    }
+    fclose(dst);
+    return LM_OK;
+}
+
+
+static lm_server_pair_t *lm_server_snapshot(int *count)
+{
+    lm_macro_head_t *head = lm_parser_get_macro_head();
+    lm_server_pair_t *pairs = calloc(head->count + 1, sizeof(lm_server_pair_t));
+    lm_list_node_t *node;
+
+    *count = 0;
+    if(pairs == NULL) {
+        return NULL;
+    }
+
+    lm_list_for_each(node, &head->node) {
+        lm_macro_t *macro = container_of(node, lm_macro_t, node);
+        pairs[*count].name = strdup(macro->name);
+        pairs[*count].value = strdup(macro->value ? macro->value : "");
+        (*count)++;
+    }
+
+    return pairs;
+}
+
+
+static void lm_server_validate(FILE *out, const char *request)
+{
+    char config[LM_SERVER_MAX_VALUE];
+    char name[LM_SERVER_MAX_VALUE];
+    char value[LM_SERVER_MAX_VALUE];
+    lm_server_pair_t *before = NULL;
+    int before_count = 0;
+
+    if(lm_server_load() == LM_OK) {
+        before = lm_server_snapshot(&before_count);
+    }
+
+    if(lm_server_get(request, "config", config, sizeof(config))) {
+        // the named file is parsed as it is
+    }
+    else if(lm_server_get(request, "macro", name, sizeof(name)) && lm_server_get(request, "value", value, sizeof(value))) {
+        if(lm_server_edit(name, value) != LM_OK) {
+            fprintf(out, "{\"ok\":false,\"error\":\"can not write %s\"}", server.tmp_config);
+            goto exit;
+        }
+        snprintf(config, sizeof(config), "%s", server.tmp_config);
+    }
+    else {
+        fprintf(out, "{\"ok\":false,\"error\":\"validate needs config, or macro and value\"}");
+        goto exit;
+    }
+
+    // the pool now holds the edited parse, the next query parses projcfg again
+    int ret = lm_server_parse(config);
+    server.loaded = false;
+
+    fprintf(out, "{\"ok\":true,\"valid\":%s,\"errors\":", ret == LM_OK ? "true" : "false");
+    lm_server_put_errors(out);
+    fprintf(out, ",\"changes\":{");
+
+    if(ret == LM_OK) {
+        lm_macro_head_t *head = lm_parser_get_macro_head();
+        lm_list_node_t *node;
+        int index = 0;
+        int count = 0;
+
+        lm_list_for_each(node, &head->node) {
+            lm_macro_t *macro = container_of(node, lm_macro_t, node);
+            const char *now = macro->value ? macro->value : "";
+            const char *old = NULL;
+
+            // both parses declare the macros in the same order unless lm.cfg itself changed
+            if(index < before_count && strcmp(before[index].name, macro->name) == 0) {
+                old = before[index].value;
+            }
+            for(int i = 0; old == NULL && i < before_count; i++) {
+                if(strcmp(before[i].name, macro->name) == 0) {
+                    old = before[i].value;
+                }
+            }
+            index++;
+
+            if(old == NULL || strcmp(old, now) != 0) {
+                fputs(count++ ? "," : "", out);
+                lm_server_put_string(out, macro->name);
+                fputc(':', out);
+                lm_server_put_string(out, now);
+            }
+        }
+    }
+    fprintf(out, "}}");
+
+exit:
+    for(int i = 0; i < before_count; i++) {
+        free(before[i].name);
+        free(before[i].value);
+    }
+    free(before);
+    remove(server.tmp_config);
+}
+
+
+static void lm_server_handle(const char *request, FILE *out)
+{
+    char op[LM_SERVER_MAX_VALUE];
+    char arg[LM_SERVER_MAX_VALUE];
+
+    if(!lm_server_get(request, "op", op, sizeof(op))) {
+        fprintf(out, "{\"ok\":false,\"error\":\"missing op\"}");
+        return;
+    }
+
+    if(strcmp(op, "validate") == 0) {
+        lm_server_validate(out, request);
+        return;
+    }
+
+    bool is_value = strcmp(op, "value") == 0;
+    bool is_source = strcmp(op, "source") == 0;
+    bool is_flags = strcmp(op, "flags") == 0;
+
+    if(!is_value && !is_source && !is_flags) {
+        fprintf(out, "{\"ok\":false,\"error\":\"unknown op\"}");
+        return;
+    }
+
+    if(!lm_server_get(request, is_value ? "macro" : "file", arg, sizeof(arg))) {
+        fprintf(out, "{\"ok\":false,\"error\":\"missing %s\"}", is_value ? "macro" : "file");
+        return;
+    }
+
+    if(lm_server_load() != LM_OK) {
+        fprintf(out, "{\"ok\":false,\"error\":\"config does not resolve\",\"errors\":");
+        lm_server_put_errors(out);
+        fputc('}', out);
+        return;
+    }
+
+    if(is_value) {
+        lm_server_value(out, arg);
+    }
+    else {
+        lm_server_source(out, arg, is_flags);
+    }
+}
+
+
+static void lm_server_write(int fd, const char *buf, size_t len)
+{
+    while(len > 0) {
+        ssize_t n = write(fd, buf, len);
+        if(n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+
+// answer every complete line in the client buffer, returns false once the client is gone
+static bool lm_server_serve(lm_server_client_t *client)
+{
+    ssize_t n = read(client->fd, client->buf + client->len, LM_SERVER_MAX_LINE - client->len);
+    if(n <= 0) {
+        return false;
+    }
+    client->len += n;
+
+    char *start = client->buf;
+    char *end;
+
+    while((end = memchr(start, '\n', client->buf + client->len - start)) != NULL) {
+        char *reply = NULL;
+        size_t reply_len = 0;
+
+        *end = '\0';
+        FILE *out = open_memstream(&reply, &reply_len);
+        if(out == NULL) {
+            return false;
+        }
+
+        lm_server_handle(start, out);
+        fputc('\n', out);
+        fclose(out);
+
+        lm_server_write(client->out, reply, reply_len);
+        free(reply);
+        start = end + 1;
+    }
+
+    client->len -= start - client->buf;
+    memmove(client->buf, start, client->len);
+
+    if(client->len == LM_SERVER_MAX_LINE) {
+        const char *error = "{\"ok\":false,\"error\":\"request too long\"}\n";
+        lm_server_write(client->out, error, strlen(error));
+        client->len = 0;
+    }
+
+    return true;
+}
+
+
+static int lm_server_listen(const char *path)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if(strlen(path) >= sizeof(addr.sun_path)) {
+        LM_LOG_ERROR("socket path %s is too long", path);
+        return -1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    unlink(path);
+
+    if(fd < 0 || bind(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(fd, 16) != 0) {
+        LM_LOG_ERROR("can not listen on %s", path);
+        if(fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+
+    return fd;
+}
+
+
+int lm_server(const char *path, const char *lmcfg, const char *projcfg, int mem_size)
+{
+    lm_server_client_t clients[LM_SERVER_MAX_CLIENTS];
+    struct pollfd pfd[LM_SERVER_MAX_CLIENTS + 2];
+    bool use_stdio = strcmp(path, "-") == 0;
+    int listen_fd = -1;
+    int count = 0;
+
+    server.lmcfg = lmcfg;
+    server.projcfg = projcfg;
+    server.mem_size = mem_size;
+    snprintf(server.tmp_config, sizeof(server.tmp_config), "/tmp/lm_server_%d.config", (int)getpid());
+
+    server.watch_fd = lm_watch_open();
+    if(server.watch_fd < 0) {
+        return LM_ERR;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if(use_stdio) {
+        // replies own stdout, anything else printed goes to stderr
+        clients[0].fd = STDIN_FILENO;
+        clients[0].out = dup(STDOUT_FILENO);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        clients[0].buf = malloc(LM_SERVER_MAX_LINE);
+        clients[0].len = 0;
+        count = 1;
+    }
+    else {
+        listen_fd = lm_server_listen(path);
+        if(listen_fd < 0) {
+            return LM_ERR;
+        }
+    }
+
+    lm_server_load();
+
+    for(;;) {
+        int n = 0;
+
+        pfd[n++] = (struct pollfd){ .fd = server.watch_fd, .events = POLLIN };
+        if(listen_fd >= 0) {
+            pfd[n++] = (struct pollfd){ .fd = listen_fd, .events = POLLIN };
+        }
+        for(int i = 0; i < count; i++) {
+            pfd[n++] = (struct pollfd){ .fd = clients[i].fd, .events = POLLIN };
+        }
+
+        if(poll(pfd, n, -1) < 0) {
+            continue;
+        }
+
+        // parse again lazily, several saves in a row cost one parse
+        if(pfd[0].revents && lm_watch_read(server.watch_fd, 0, NULL) != NULL) {
+            server.loaded = false;
+        }
+
+        // clients accepted below have no pollfd in this round, serve them from the next poll
+        int polled = count;
+
+        if(listen_fd >= 0 && pfd[1].revents) {
+            int fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if(fd >= 0 && count < LM_SERVER_MAX_CLIENTS && (clients[count].buf = malloc(LM_SERVER_MAX_LINE)) != NULL) {
+                clients[count].fd = fd;
+                clients[count].out = fd;
+                clients[count].len = 0;
+                count++;
+            }
+            else if(fd >= 0) {
+                close(fd);
+            }
+        }
+
+        int first = listen_fd >= 0 ? 2 : 1;
+        for(int i = polled - 1; i >= 0; i--) {
+            if(pfd[first + i].revents == 0 || lm_server_serve(&clients[i])) {
+                continue;
+            }
+
+            if(use_stdio) {
+                free(clients[i].buf);
+                if(server.pool) {
+                    lm_mem_destroy();
+                }
+                return LM_OK;
+            }
+
+            close(clients[i].fd);
+            free(clients[i].buf);
+            clients[i] = clients[--count];
+        }
+    }
+}
+
+
+#else
+
+int lm_server(const char *path, const char *lmcfg, const char *projcfg, int mem_size)
+{
+    (void)path;
+    (void)lmcfg;
+    (void)projcfg;
+    (void)mem_size;
+
+    LM_LOG_ERROR("--serve is only supported on linux");
+    return LM_ERR;
+}
+
+#endif
@@ -0,0 +1,57 @@
+/* source/lm_server.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_SERVER_H__
+#define __LM_SERVER_H__
+
+
+#define    LM_SERVER_MAX_LINE       65536
+#define    LM_SERVER_MAX_CLIENTS    64
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Answer one JSON request per line on a unix socket at path, or on
+ * stdin/stdout when path is "-". The parse of lmcfg with projcfg is kept
+ * in memory and done again on the first request after one of its inputs
+ * changes. Requests, each answered by one line:
+ *   {"op":"value","macro":"CONFIG_X"}       resolved value of a macro
+ *   {"op":"source","file":"src/a.c"}        is the file compiled, and where
+ *   {"op":"flags","file":"src/a.c"}         compiler flags used for the file
+ *   {"op":"validate","macro":"CONFIG_X","value":"y"}
+ *   {"op":"validate","config":"other.config"}
+ *                                           would the edit resolve, what changes
+ */
+int lm_server(const char *path, const char *lmcfg, const char *projcfg, int mem_size);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_SERVER_H__
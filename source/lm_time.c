@@ -0,0 +1,207 @@
+/* source/lm_time.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "lm_time.h"
+
+
+#define    LM_TIME_MAX_DEPTH        64
+
+
+typedef struct lm_time_entry {
+    const char *phase;
+    char *detail;
+    int depth;
+    double start;
+    double total;
+    double child;           // time of the phases nested inside
+}lm_time_entry_t;
+
+
+static struct lm_time {
+    bool enable;
+    lm_time_entry_t *entries;
+    int count;
+    int size;
+    int stack[LM_TIME_MAX_DEPTH];
+    int depth;
+    double resolve;
+    long resolve_count;
+    long counters[LM_TIME_COUNTER_MAX];
+}lm_time;
+
+
+void lm_time_enable(bool enable)
+{
+    lm_time.enable = enable;
+}
+
+
+double lm_time_now(void)
+{
+    if(!lm_time.enable) {
+        return 0;
+    }
+
+#if ( __linux__)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1000000.0;
+#else
+    return clock() * 1000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+
+int lm_time_begin(const char *phase, const char *detail)
+{
+    if(!lm_time.enable || lm_time.depth == LM_TIME_MAX_DEPTH) {
+        return -1;
+    }
+
+    if(lm_time.count == lm_time.size) {
+        int size = lm_time.size ? lm_time.size * 2 : 64;
+        lm_time_entry_t *grow = realloc(lm_time.entries, size * sizeof(lm_time_entry_t));
+        if(grow == NULL) {
+            return -1;
+        }
+        lm_time.entries = grow;
+        lm_time.size = size;
+    }
+
+    int index = lm_time.count++;
+    lm_time_entry_t *entry = &lm_time.entries[index];
+
+    entry->phase = phase;
+    entry->detail = strdup(detail ? detail : "");
+    entry->depth = lm_time.depth;
+    entry->total = 0;
+    entry->child = 0;
+    entry->start = lm_time_now();
+
+    lm_time.stack[lm_time.depth++] = index;
+    return index;
+}
+
+
+void lm_time_end(int index)
+{
+    if(index < 0 || lm_time.depth == 0) {
+        return;
+    }
+
+    lm_time_entry_t *entry = &lm_time.entries[index];
+    entry->total = lm_time_now() - entry->start;
+
+    lm_time.depth--;
+    if(lm_time.depth > 0) {
+        lm_time.entries[lm_time.stack[lm_time.depth - 1]].child += entry->total;
+    }
+}
+
+
+void lm_time_resolve(double start)
+{
+    if(lm_time.enable) {
+        lm_time.resolve += lm_time_now() - start;
+        lm_time.resolve_count++;
+    }
+}
+
+
+void lm_time_count(lm_time_counter_e counter)
+{
+    lm_time.counters[counter]++;
+}
+
+
+static double lm_time_self(const lm_time_entry_t *entry)
+{
+    return entry->total - entry->child;
+}
+
+
+static int lm_time_cmp(const void *a, const void *b)
+{
+    double sa = lm_time_self(*(const lm_time_entry_t* const*)a);
+    double sb = lm_time_self(*(const lm_time_entry_t* const*)b);
+
+    return (sa < sb) - (sa > sb);
+}
+
+
+void lm_time_report(int macros)
+{
+    lm_time_entry_t **files = malloc((lm_time.count + 1) * sizeof(lm_time_entry_t*));
+    double total = 0;
+    int file_count = 0;
+
+    printf("%-28s %10s %10s  %s\n", "phase", "self ms", "total ms", "input");
+
+    for(int i = 0; i < lm_time.count; i++) {
+        lm_time_entry_t *entry = &lm_time.entries[i];
+
+        printf("%*s%-*s %10.3f %10.3f  %s\n", entry->depth * 2, "", 28 - entry->depth * 2, entry->phase,
+            lm_time_self(entry), entry->total, entry->detail);
+
+        if(entry->depth == 0) {
+            total += entry->total;
+        }
+        if(files && (strcmp(entry->phase, "parse") == 0 || strcmp(entry->phase, "read config") == 0)) {
+            files[file_count++] = entry;
+        }
+    }
+
+    // part of the parse times above, not added to the total again
+    printf("%-28s %10.3f %10s  %ld calls\n", "resolve macros", lm_time.resolve, "", lm_time.resolve_count);
+    printf("%-28s %10s %10.3f\n", "total", "", total);
+
+    long lookups = lm_time.counters[LM_TIME_LOOKUPS];
+    long hits = lm_time.counters[LM_TIME_CACHE_HITS];
+    printf("\nlines %ld, macros %d, lookups %ld, cache hits %ld (%.1f%%)\n",
+        lm_time.counters[LM_TIME_LINES], macros, lookups, hits, lookups ? hits * 100.0 / lookups : 0.0);
+
+    if(files && file_count > 0) {
+        qsort(files, file_count, sizeof(lm_time_entry_t*), lm_time_cmp);
+
+        printf("\nslowest files:\n");
+        for(int i = 0; i < file_count && i < LM_TIME_TOP_FILES; i++) {
+            printf("%10.3f ms  %s\n", lm_time_self(files[i]), files[i]->detail);
+        }
+    }
+
+    free(files);
+    for(int i = 0; i < lm_time.count; i++) {
+        free(lm_time.entries[i].detail);
+    }
+
+    bool enable = lm_time.enable;
+    free(lm_time.entries);
+    memset(&lm_time, 0, sizeof(lm_time));
+    lm_time.enable = enable;
+}
@@ -0,0 +1,78 @@
+/* source/lm_time.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_TIME_H__
+#define __LM_TIME_H__
+
+#include <stdbool.h>
+
+
+#define    LM_TIME_TOP_FILES        10
+
+
+typedef enum lm_time_counter {
+    LM_TIME_LINES,
+    LM_TIME_LOOKUPS,
+    LM_TIME_CACHE_HITS,
+    LM_TIME_COUNTER_MAX,
+}lm_time_counter_e;
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * --time-report. Nothing is recorded until lm_time_enable(true); begin and
+ * end then bracket one phase, phases opened inside another are nested under
+ * it and their time is subtracted from its self time. lm_time_begin returns
+ * -1 when disabled, lm_time_end ignores it.
+ */
+void lm_time_enable(bool enable);
+int lm_time_begin(const char *phase, const char *detail);
+void lm_time_end(int index);
+
+
+/**
+ * Macro resolution happens line by line inside the parse, it is summed up
+ * instead of getting an entry per macro. start comes from lm_time_now.
+ */
+double lm_time_now(void);
+void lm_time_resolve(double start);
+void lm_time_count(lm_time_counter_e counter);
+
+
+/**
+ * Print the phases in the order they started, the counters and the
+ * LM_TIME_TOP_FILES slowest files, then forget them for the next run.
+ */
+void lm_time_report(int macros);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_TIME_H__
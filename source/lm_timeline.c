@@ -0,0 +1,393 @@
+/* source/lm_timeline.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "lm_timeline.h"
+#include "lm_error.h"
+#include "lm_log.h"
+
+
+#if ( __linux__)
+
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+
+#define    LM_TIMELINE_MAX_LINE     4096
+
+
+typedef struct lm_timeline_job {
+    long long start;        // us, CLOCK_MONOTONIC so jobs of one build line up
+    long long end;
+    long long cpu;          // user + system of the command and its children
+    long rss;               // KB
+    int status;
+    int lane;
+    char *target;
+}lm_timeline_job_t;
+
+
+static long long lm_timeline_now(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+static long long lm_timeline_us(const struct timeval *tv)
+{
+    return (long long)tv->tv_sec * 1000000 + tv->tv_usec;
+}
+
+
+int lm_timeline_exec(int argc, char *argv[])
+{
+    if(argc < 2) {
+        LM_LOG_ERROR("usage: --time-cmd <target> <command...>");
+        return 1;
+    }
+
+    const char *target = argv[0];
+    long long start = lm_timeline_now();
+    pid_t pid;
+
+    int ret = posix_spawnp(&pid, argv[1], NULL, NULL, argv + 1, environ);
+    if(ret != 0) {
+        LM_LOG_ERROR("failed to run %s: %s", argv[1], strerror(ret));
+        return 127;
+    }
+
+    // wait4 counts the processes the command waited for, cc1 and as under gcc
+    struct rusage usage;
+    int status;
+    while(wait4(pid, &status, 0, &usage) < 0) {
+        if(errno != EINTR) {
+            return 127;
+        }
+    }
+
+    long long end = lm_timeline_now();
+    int code = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + (WIFSIGNALED(status) ? WTERMSIG(status) : 0);
+
+    const char *log = getenv(LM_TIMELINE_ENV);
+    if(log == NULL || log[0] == '\0') {
+        return code;
+    }
+
+    char line[LM_TIMELINE_MAX_LINE];
+    int len = snprintf(line, sizeof(line), "%lld %lld %lld %ld %d %s\n", start, end,
+        lm_timeline_us(&usage.ru_utime) + lm_timeline_us(&usage.ru_stime), usage.ru_maxrss, code, target);
+    if(len >= (int)sizeof(line)) {
+        len = sizeof(line) - 1;
+        line[len - 1] = '\n';
+    }
+
+    // one write per line with O_APPEND, parallel jobs do not interleave
+    int fd = open(log, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd < 0 || write(fd, line, len) != len) {
+        LM_LOG_WARN("can not append to %s", log);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+
+    return code;
+}
+
+
+static bool lm_timeline_has_suffix(const char *str, const char *suffix)
+{
+    size_t len = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return len >= suffix_len && strcmp(str + len - suffix_len, suffix) == 0;
+}
+
+
+static bool lm_timeline_is_object(const lm_timeline_job_t *job)
+{
+    return lm_timeline_has_suffix(job->target, ".o") || lm_timeline_has_suffix(job->target, ".gch");
+}
+
+
+static int lm_timeline_cmp_start(const void *a, const void *b)
+{
+    const lm_timeline_job_t *ja = a;
+    const lm_timeline_job_t *jb = b;
+
+    return (ja->start > jb->start) - (ja->start < jb->start);
+}
+
+
+static int lm_timeline_cmp_duration(const void *a, const void *b)
+{
+    const lm_timeline_job_t *ja = *(const lm_timeline_job_t* const*)a;
+    const lm_timeline_job_t *jb = *(const lm_timeline_job_t* const*)b;
+    long long da = ja->end - ja->start;
+    long long db = jb->end - jb->start;
+
+    return (da < db) - (da > db);
+}
+
+
+static lm_timeline_job_t *lm_timeline_load(const char *log, int *count)
+{
+    char line[LM_TIMELINE_MAX_LINE];
+    lm_timeline_job_t *jobs = NULL;
+    int size = 0;
+
+    *count = 0;
+
+    FILE *file = fopen(log, "r");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not open %s", log);
+        return NULL;
+    }
+
+    while(fgets(line, sizeof(line), file)) {
+        lm_timeline_job_t job = {0};
+        int offset = 0;
+
+        line[strcspn(line, "\n")] = '\0';
+        if(sscanf(line, "%lld %lld %lld %ld %d %n", &job.start, &job.end, &job.cpu, &job.rss, &job.status, &offset) != 5 || offset == 0) {
+            continue;
+        }
+
+        if(*count == size) {
+            size = size ? size * 2 : 256;
+            lm_timeline_job_t *grow = realloc(jobs, size * sizeof(lm_timeline_job_t));
+            if(grow == NULL) {
+                break;
+            }
+            jobs = grow;
+        }
+
+        job.target = strdup(line + offset);
+        jobs[(*count)++] = job;
+    }
+
+    fclose(file);
+    return jobs;
+}
+
+
+// pack the jobs into as few rows as possible, one row per concurrent job slot
+static int lm_timeline_lanes(lm_timeline_job_t *jobs, int count)
+{
+    long long *lane_end = calloc(count + 1, sizeof(long long));
+    int lanes = 0;
+
+    for(int i = 0; lane_end && i < count; i++) {
+        int lane = 0;
+        while(lane < lanes && lane_end[lane] > jobs[i].start) {
+            lane++;
+        }
+        if(lane == lanes) {
+            lanes++;
+        }
+
+        lane_end[lane] = jobs[i].end;
+        jobs[i].lane = lane;
+    }
+
+    free(lane_end);
+    return lanes;
+}
+
+
+static void lm_timeline_put_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+
+    for(const unsigned char *p = (const unsigned char*)str; *p; p++) {
+        if(*p == '"' || *p == '\\') {
+            fprintf(file, "\\%c", *p);
+        }
+        else if(*p >= 0x20) {
+            fputc(*p, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+
+static int lm_timeline_trace(const char *path, lm_timeline_job_t *jobs, int count)
+{
+    FILE *file = fopen(path, "w");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not write %s", path);
+        return LM_ERR;
+    }
+
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for(int i = 0; i < count; i++) {
+        fprintf(file, "%s{\"name\":", i ? ",\n" : "");
+        lm_timeline_put_string(file, jobs[i].target);
+        fprintf(file, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%lld,\"dur\":%lld,\"pid\":1,\"tid\":%d,",
+            lm_timeline_is_object(&jobs[i]) ? "compile" : "link", jobs[i].start - jobs[0].start,
+            jobs[i].end - jobs[i].start, jobs[i].lane + 1);
+        fprintf(file, "\"args\":{\"cpu_ms\":%.1f,\"rss_kb\":%ld,\"status\":%d}}", jobs[i].cpu / 1000.0, jobs[i].rss, jobs[i].status);
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+
+    return LM_OK;
+}
+
+
+int lm_timeline_report(const char *log)
+{
+    int count;
+    lm_timeline_job_t *jobs = lm_timeline_load(log, &count);
+
+    if(jobs == NULL || count == 0) {
+        if(jobs != NULL) {
+            LM_LOG_ERROR("%s has no jobs, build with %s=%s", log, LM_TIMELINE_ENV, log);
+        }
+        free(jobs);
+        return LM_ERR;
+    }
+
+    qsort(jobs, count, sizeof(lm_timeline_job_t), lm_timeline_cmp_start);
+    int lanes = lm_timeline_lanes(jobs, count);
+
+    long long first = jobs[0].start;
+    long long last = 0;
+    long long busy = 0;
+    long long cpu = 0;
+    int objects = 0;
+    int failed = 0;
+
+    for(int i = 0; i < count; i++) {
+        if(jobs[i].end > last) {
+            last = jobs[i].end;
+        }
+        busy += jobs[i].end - jobs[i].start;
+        cpu += jobs[i].cpu;
+        objects += lm_timeline_is_object(&jobs[i]);
+        failed += jobs[i].status != 0;
+    }
+
+    long long wall = last - first;
+
+    printf("jobs:             %d (%d compiles, %d links and archives, %d failed)\n", count, objects, count - objects, failed);
+    printf("wall time:        %.3f s\n", wall / 1e6);
+    printf("job time:         %.3f s\n", busy / 1e6);
+    printf("cpu time:         %.3f s\n", cpu / 1e6);
+    printf("parallelism:      %.2f average, %d at most\n", wall ? (double)busy / wall : 0.0, lanes);
+
+    lm_timeline_job_t **sorted = malloc(count * sizeof(lm_timeline_job_t*));
+    if(sorted) {
+        for(int i = 0; i < count; i++) {
+            sorted[i] = &jobs[i];
+        }
+        qsort(sorted, count, sizeof(lm_timeline_job_t*), lm_timeline_cmp_duration);
+
+        printf("\nslowest:\n");
+        for(int i = 0; i < count && i < LM_TIMELINE_TOP; i++) {
+            printf("%10.3f s  cpu %8.3f s  %7.1f MB  %s\n", (sorted[i]->end - sorted[i]->start) / 1e6,
+                sorted[i]->cpu / 1e6, sorted[i]->rss / 1024.0, sorted[i]->target);
+        }
+        free(sorted);
+    }
+
+    // a link can only start after its last input: that object ends the critical path
+    bool header = false;
+    for(int i = 0; i < count; i++) {
+        if(lm_timeline_is_object(&jobs[i])) {
+            continue;
+        }
+
+        lm_timeline_job_t *gate = NULL;
+        for(int j = 0; j < count; j++) {
+            if(lm_timeline_is_object(&jobs[j]) && jobs[j].end <= jobs[i].start && (gate == NULL || jobs[j].end > gate->end)) {
+                gate = &jobs[j];
+            }
+        }
+
+        if(!header) {
+            printf("\nlinks:\n");
+            header = true;
+        }
+        printf("%10.3f s  %s", (jobs[i].end - jobs[i].start) / 1e6, jobs[i].target);
+        if(gate) {
+            printf(", waited for %s (%.3f s, started at %.3f s)", gate->target, (gate->end - gate->start) / 1e6, (gate->start - first) / 1e6);
+        }
+        printf("\n");
+    }
+
+    char trace[LM_TIMELINE_MAX_LINE];
+    snprintf(trace, sizeof(trace), "%s.json", log);
+    int ret = lm_timeline_trace(trace, jobs, count);
+    if(ret == LM_OK) {
+        printf("\ntrace:            %s\n", trace);
+    }
+
+    for(int i = 0; i < count; i++) {
+        free(jobs[i].target);
+    }
+    free(jobs);
+
+    return ret;
+}
+
+
+#else
+
+
+int lm_timeline_exec(int argc, char *argv[])
+{
+    (void)argc;
+    (void)argv;
+
+    LM_LOG_ERROR("the build timeline is only supported on linux");
+    return 1;
+}
+
+
+int lm_timeline_report(const char *log)
+{
+    (void)log;
+
+    LM_LOG_ERROR("the build timeline is only supported on linux");
+    return LM_ERR;
+}
+
+
+#endif
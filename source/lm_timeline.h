@@ -0,0 +1,59 @@
+/* source/lm_timeline.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_TIMELINE_H__
+#define __LM_TIMELINE_H__
+
+
+#define    LM_TIMELINE_ENV          "LM_TIMELINE"
+#define    LM_TIMELINE_TOP          15
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * argv[0] is the make target, the rest is the recipe command. The command
+ * runs with the caller's stdio; when $LM_TIMELINE names a log file, one
+ * line with its start and end time, cpu time, peak RSS, exit code and the
+ * target is appended to it. Returns the command exit code.
+ */
+int lm_timeline_exec(int argc, char *argv[]);
+
+
+/**
+ * Summarize a timeline log: the slowest targets, cpu against wall time,
+ * achieved parallelism and the object each link waited for last. A Chrome
+ * trace of the build is written to <log>.json.
+ */
+int lm_timeline_report(const char *log);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_TIMELINE_H__
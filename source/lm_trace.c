@@ -0,0 +1,251 @@
+/* source/lm_trace.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "lm_trace.h"
+#include "lm_error.h"
+#include "lm_log.h"
+
+
+#if CONFIG_DEBUG
+
+#if ( __linux__)
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+typedef struct lm_trace_event {
+    const char *name;
+    double start;
+    double dur;
+    char arg[LM_TRACE_ARG_LEN];
+}lm_trace_event_t;
+
+
+// one per thread, never freed: the events are written at exit
+typedef struct lm_trace_buffer {
+    lm_trace_event_t *events;
+    int count;
+    int size;
+    int tid;
+    struct lm_trace_buffer *next;
+}lm_trace_buffer_t;
+
+
+static struct lm_trace {
+    bool enable;
+    const char *path;
+    int pid;
+    double origin;
+    lm_trace_buffer_t *buffers;
+    int threads;
+}lm_trace;
+
+static __thread lm_trace_buffer_t *lm_trace_local;
+
+#if ( __linux__)
+static pthread_mutex_t lm_trace_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static int lm_trace_pid(void)
+{
+#if ( __linux__)
+    return (int)getpid();
+#else
+    return 0;
+#endif
+}
+
+
+static double lm_trace_now(void)
+{
+#if ( __linux__)
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000.0 + now.tv_nsec / 1000.0;
+#else
+    return clock() * 1000000.0 / CLOCKS_PER_SEC;
+#endif
+}
+
+
+static lm_trace_buffer_t *lm_trace_buffer(void)
+{
+    if(lm_trace_local) {
+        return lm_trace_local;
+    }
+
+    lm_trace_buffer_t *buffer = calloc(1, sizeof(lm_trace_buffer_t));
+    if(buffer == NULL) {
+        return NULL;
+    }
+
+#if ( __linux__)
+    pthread_mutex_lock(&lm_trace_lock);
+#endif
+    buffer->tid = ++lm_trace.threads;
+    buffer->next = lm_trace.buffers;
+    lm_trace.buffers = buffer;
+#if ( __linux__)
+    pthread_mutex_unlock(&lm_trace_lock);
+#endif
+
+    lm_trace_local = buffer;
+    return buffer;
+}
+
+
+void lm_trace_scope_begin(lm_trace_scope_t *scope, const char *name, const char *arg)
+{
+    if(!lm_trace.enable) {
+        scope->start = -1;
+        return;
+    }
+
+    scope->name = name;
+    snprintf(scope->arg, sizeof(scope->arg), "%s", arg ? arg : "");
+    scope->start = lm_trace_now();
+}
+
+
+void lm_trace_scope_end(lm_trace_scope_t *scope)
+{
+    if(scope->start < 0) {
+        return;
+    }
+
+    double end = lm_trace_now();
+    lm_trace_buffer_t *buffer = lm_trace_buffer();
+    if(buffer == NULL) {
+        return;
+    }
+
+    if(buffer->count == buffer->size) {
+        int size = buffer->size + LM_TRACE_CHUNK;
+        lm_trace_event_t *grow = realloc(buffer->events, size * sizeof(lm_trace_event_t));
+        if(grow == NULL) {
+            return;
+        }
+        buffer->events = grow;
+        buffer->size = size;
+    }
+
+    lm_trace_event_t *event = &buffer->events[buffer->count++];
+    event->name = scope->name;
+    event->start = scope->start;
+    event->dur = end - scope->start;
+    memcpy(event->arg, scope->arg, sizeof(event->arg));
+}
+
+
+static void lm_trace_put_string(FILE *file, const char *str)
+{
+    fputc('"', file);
+
+    for(const unsigned char *p = (const unsigned char*)str; *p; p++) {
+        if(*p == '"' || *p == '\\') {
+            fprintf(file, "\\%c", *p);
+        }
+        else if(*p < 0x20) {
+            fprintf(file, "\\u%04x", *p);
+        }
+        else {
+            fputc(*p, file);
+        }
+    }
+
+    fputc('"', file);
+}
+
+
+static void lm_trace_flush(void)
+{
+    // forked workers inherit the atexit handler, only the process that asked writes
+    if(!lm_trace.enable || lm_trace.pid != lm_trace_pid()) {
+        return;
+    }
+    lm_trace.enable = false;
+
+    FILE *file = fopen(lm_trace.path, "w");
+    if(file == NULL) {
+        LM_LOG_ERROR("can not write %s", lm_trace.path);
+        return;
+    }
+
+    int count = 0;
+    fprintf(file, "{\"traceEvents\":[\n");
+
+    for(lm_trace_buffer_t *buffer = lm_trace.buffers; buffer; buffer = buffer->next) {
+        for(int i = 0; i < buffer->count; i++) {
+            lm_trace_event_t *event = &buffer->events[i];
+
+            fprintf(file, "%s{\"name\":", count++ ? ",\n" : "");
+            lm_trace_put_string(file, event->name);
+            fprintf(file, ",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                event->start - lm_trace.origin, event->dur, lm_trace.pid, buffer->tid);
+            if(event->arg[0]) {
+                fprintf(file, ",\"args\":{\"input\":");
+                lm_trace_put_string(file, event->arg);
+                fputc('}', file);
+            }
+            fputc('}', file);
+        }
+    }
+
+    fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+}
+
+
+int lm_trace_start(const char *path)
+{
+    lm_trace.path = path;
+    lm_trace.pid = lm_trace_pid();
+    lm_trace.origin = lm_trace_now();
+
+    if(!lm_trace.enable) {
+        atexit(lm_trace_flush);
+    }
+    lm_trace.enable = true;
+
+    return LM_OK;
+}
+
+
+#else
+
+int lm_trace_start(const char *path)
+{
+    (void)path;
+    return LM_ERR;
+}
+
+#endif //!CONFIG_DEBUG
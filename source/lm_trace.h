@@ -0,0 +1,83 @@
+/* source/lm_trace.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_TRACE_H__
+#define __LM_TRACE_H__
+
+#include "config.h"
+
+
+#define    LM_TRACE_ARG_LEN         96
+#define    LM_TRACE_CHUNK           4096    // events per buffer growth
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Record LM_TRACE_SCOPE events from now on and write them to path as
+ * Chrome/Perfetto trace JSON when the process exits. Returns LM_ERR when
+ * tracing is compiled out (CONFIG_DEBUG=n).
+ */
+int lm_trace_start(const char *path);
+
+
+#if CONFIG_DEBUG
+
+typedef struct lm_trace_scope {
+    const char *name;
+    double start;           // < 0: tracing is off
+    char arg[LM_TRACE_ARG_LEN];
+}lm_trace_scope_t;
+
+
+void lm_trace_scope_begin(lm_trace_scope_t *scope, const char *name, const char *arg);
+void lm_trace_scope_end(lm_trace_scope_t *scope);
+
+
+#define LM_TRACE_CAT_(a, b)          a##b
+#define LM_TRACE_CAT(a, b)           LM_TRACE_CAT_(a, b)
+
+/**
+ * One complete event from here to the end of the enclosing block, arg (may
+ * be NULL) is copied at once. Events go to a buffer of the calling thread.
+ */
+#define LM_TRACE_SCOPE(name, arg)                                                               \
+        lm_trace_scope_t LM_TRACE_CAT(lm_trace_scope_, __LINE__) __attribute__((cleanup(lm_trace_scope_end))); \
+        lm_trace_scope_begin(&LM_TRACE_CAT(lm_trace_scope_, __LINE__), name, arg)
+
+#else // no define debug mode macro
+
+#define LM_TRACE_SCOPE(name, arg) do {}while(0)
+
+#endif //!CONFIG_DEBUG
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_TRACE_H__
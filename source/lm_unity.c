@@ -0,0 +1,534 @@
+/* source/lm_unity.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <utime.h>
+#include "lm_unity.h"
+#include "lm_parser.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+#include "lm_gen.h"
+
+#if (_WIN32)
+#include <direct.h>
+#elif ( __linux__)
+#include <unistd.h>
+#endif
+
+
+#define    LM_UNITY_BATCH_LEN       32
+
+
+typedef struct lm_unity_member {
+    char *src;
+    char batch[LM_UNITY_BATCH_LEN];
+    bool isolated;
+    int order;
+}lm_unity_member_t;
+
+
+typedef struct lm_unity_plan {
+    lm_unity_member_t *members;
+    int count;
+    int size;
+}lm_unity_plan_t;
+
+
+static lm_unity_member_t *lm_unity_add(lm_unity_plan_t *plan, const char *src)
+{
+    if(plan->count == plan->size) {
+        plan->size = plan->size ? plan->size * 2 : 64;
+        lm_unity_member_t *grow = realloc(plan->members, plan->size * sizeof(lm_unity_member_t));
+        if(grow == NULL) {
+            return NULL;
+        }
+        plan->members = grow;
+    }
+
+    lm_unity_member_t *member = &plan->members[plan->count++];
+    memset(member, 0, sizeof(*member));
+    member->src = strdup(src);
+    return member;
+}
+
+
+static void lm_unity_free(lm_unity_plan_t *plan)
+{
+    for(int i = 0; i < plan->count; i++) {
+        free(plan->members[i].src);
+    }
+
+    free(plan->members);
+    memset(plan, 0, sizeof(*plan));
+}
+
+
+static const char *lm_unity_ext(const char *src)
+{
+    const char *dot = strrchr(src, '.');
+
+    if(dot && (strcmp(dot, ".c") == 0 || strcmp(dot, ".cpp") == 0)) {
+        return dot;
+    }
+
+    return NULL;
+}
+
+
+static int lm_unity_dir_len(const char *src)
+{
+    const char *slash = strrchr(src, '/');
+
+    return slash ? (int)(slash - src) : 0;
+}
+
+
+/*
+ * A UNITY entry covers the sources of its own directory, an entry whose
+ * directory ends in "**" also the directories below it. The most specific
+ * entry wins, "<dir>/0" turns batching off.
+ */
+static int lm_unity_batch_size(const char *src)
+{
+    lm_array_t *list = lm_parser_get_list(VAR_UNITY);
+    lm_list_node_t *node;
+    int dir_len = lm_unity_dir_len(src);
+    int best = -1;
+    int size = 0;
+
+    lm_list_for_each(node, &list->head) {
+        const char *entry = container_of(node, lm_array_node_t, node)->string;
+        const char *slash = strrchr(entry, '/');
+        int len = slash ? (int)(slash - entry) : 0;
+        bool tree = len >= 2 && strncmp(entry + len - 2, "**", 2) == 0 && (len == 2 || entry[len - 3] == '/');
+
+        if(tree) {
+            len = len == 2 ? 0 : len - 3;
+        }
+
+        bool match = strncmp(src, entry, len) == 0 &&
+                     (len == dir_len || (tree && (len == 0 || (len < dir_len && src[len] == '/'))));
+
+        // the directory itself beats a tree rooted at the same place
+        int rank = len * 2 + !tree;
+        if(match && rank >= best) {
+            best = rank;
+            size = strtol(slash ? slash + 1 : entry, NULL, 10);
+        }
+    }
+
+    return size;
+}
+
+
+static bool lm_unity_is_excluded(const char *src)
+{
+    lm_array_t *list = lm_parser_get_list(VAR_UNITY_EXCLUDE);
+    lm_list_node_t *node;
+
+    lm_list_for_each(node, &list->head) {
+        if(strcmp(container_of(node, lm_array_node_t, node)->string, src) == 0) {
+            return true;
+        }
+    }
+
+    // a batch is linked into every target, so sources of a single TARGET stay apart
+    list = lm_parser_get_list(VAR_TARGET_MEMBER);
+    lm_list_for_each(node, &list->head) {
+        const char *member = strstr(container_of(node, lm_array_node_t, node)->string, ":SRC:");
+        if(member && strcmp(member + 5, src) == 0) {
+            return true;
+        }
+    }
+
+    // and LIBRARY sources stay in their archive, where the linker only pulls what is used
+    list = lm_parser_get_list(VAR_LIBRARY_MEMBER);
+    lm_list_for_each(node, &list->head) {
+        const char *member = strchr(container_of(node, lm_array_node_t, node)->string, ':');
+        if(member && strcmp(member + 1, src) == 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+// batches never mix directories or languages (c and c++ have different flags)
+static int lm_unity_group_cmp(const lm_unity_member_t *a, const lm_unity_member_t *b)
+{
+    int len_a = lm_unity_dir_len(a->src);
+    int len_b = lm_unity_dir_len(b->src);
+
+    int cmp = strncmp(a->src, b->src, len_a < len_b ? len_a : len_b);
+    if(cmp != 0) {
+        return cmp;
+    }
+
+    if(len_a != len_b) {
+        return len_a - len_b;
+    }
+
+    return strcmp(lm_unity_ext(a->src), lm_unity_ext(b->src));
+}
+
+
+static int lm_unity_cmp(const void *a, const void *b)
+{
+    const lm_unity_member_t *ma = a;
+    const lm_unity_member_t *mb = b;
+
+    int cmp = lm_unity_group_cmp(ma, mb);
+    return cmp ? cmp : ma->order - mb->order;
+}
+
+
+static void lm_unity_mkdirs(const char *dir)
+{
+    char path[LM_GEN_MAX_PATH];
+
+    snprintf(path, sizeof(path), "%s", dir);
+    for(char *p = path + 1; *p; p++) {
+        if(*p == '/') {
+            *p = '\0';
+            lm_mkdir(path);
+            *p = '/';
+        }
+    }
+
+    lm_mkdir(path);
+}
+
+
+// how a unity file reaches the project root: "../../" for build/unity
+static void lm_unity_prefix(const char *unity_dir, char *prefix, int size)
+{
+    prefix[0] = '\0';
+
+    if(unity_dir[0] == '/' || strstr(unity_dir, "..")) {
+        if(getcwd(prefix, size - 1) != NULL) {
+            strcat(prefix, "/");
+        }
+        return;
+    }
+
+    const char *p = unity_dir;
+    while(*p) {
+        const char *end = strchr(p, '/');
+        int len = end ? (int)(end - p) : (int)strlen(p);
+
+        if(len && !(len == 1 && p[0] == '.') && (int)strlen(prefix) + 4 < size) {
+            strcat(prefix, "../");
+        }
+
+        p += len;
+        if(*p == '/') {
+            p++;
+        }
+    }
+}
+
+
+static int lm_unity_read(const char *unity_dir, lm_unity_plan_t *plan)
+{
+    char path[LM_GEN_MAX_PATH];
+    char line[LM_GEN_MAX_PATH + LM_UNITY_BATCH_LEN];
+    char batch[LM_UNITY_BATCH_LEN];
+    int isolated;
+    int offset;
+
+    snprintf(path, sizeof(path), "%s/%s", unity_dir, LM_UNITY_LIST);
+    FILE *file = fopen(path, "r");
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    while(fgets(line, sizeof(line), file)) {
+        line[strcspn(line, "\r\n")] = '\0';
+
+        if(sscanf(line, "%31s %d %n", batch, &isolated, &offset) != 2 || line[offset] == '\0') {
+            continue;
+        }
+
+        lm_unity_member_t *member = lm_unity_add(plan, line + offset);
+        if(member == NULL) {
+            break;
+        }
+
+        snprintf(member->batch, sizeof(member->batch), "%s", batch);
+        member->isolated = isolated != 0;
+    }
+
+    fclose(file);
+    return LM_OK;
+}
+
+
+// members of one batch are adjacent: return the end of the batch starting at i
+static int lm_unity_batch_end(lm_unity_plan_t *plan, int i, int *active)
+{
+    int j = i;
+
+    *active = 0;
+    while(j < plan->count && strcmp(plan->members[i].batch, plan->members[j].batch) == 0) {
+        *active += !plan->members[j].isolated;
+        j++;
+    }
+
+    return j;
+}
+
+
+/* write the batch files, unity.lst (the layout) and unity.mk (what make needs) */
+static int lm_unity_write(const char *unity_dir, lm_unity_plan_t *plan, bool touch)
+{
+    char path[LM_GEN_MAX_PATH];
+    char tmp_path[LM_GEN_MAX_PATH];
+    char prefix[LM_GEN_MAX_PATH];
+    lm_unity_member_t *members = plan->members;
+    FILE *file;
+
+    lm_unity_mkdirs(unity_dir);
+    lm_unity_prefix(unity_dir, prefix, sizeof(prefix));
+
+    // a batch left without members is dropped
+    for(int i = 0, j, active; i < plan->count; i = j) {
+        j = lm_unity_batch_end(plan, i, &active);
+
+        snprintf(path, sizeof(path), "%s/%s", unity_dir, members[i].batch);
+        if(active == 0) {
+            remove(path);
+            continue;
+        }
+
+        file = lm_gen_open(path, tmp_path);
+        if(file == NULL) {
+            LM_LOG_ERROR("Failed to generate the %s file\n", path);
+            return LM_ERR;
+        }
+
+        fprintf(file, "/* lite-manager unity file, do not edit */\n");
+        for(int k = i; k < j; k++) {
+            if(!members[k].isolated) {
+                fprintf(file, "#include \"%s%s\"\n", members[k].src[0] == '/' ? "" : prefix, members[k].src);
+            }
+        }
+
+        if(lm_gen_commit(file, path, tmp_path) != LM_OK) {
+            return LM_ERR;
+        }
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", unity_dir, LM_UNITY_LIST);
+    file = lm_gen_open(path, tmp_path);
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    for(int i = 0; i < plan->count; i++) {
+        fprintf(file, "%s %d %s\n", members[i].batch, members[i].isolated, members[i].src);
+    }
+
+    if(lm_gen_commit(file, path, tmp_path) != LM_OK) {
+        return LM_ERR;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", unity_dir, LM_UNITY_MK);
+    file = lm_gen_open(path, tmp_path);
+    if(file == NULL) {
+        return LM_ERR;
+    }
+
+    fprintf(file, "#****************************************************************\n");
+    fprintf(file, "#* lite-manager                                                 *\n");
+    fprintf(file, "#* NOTE: do not edit this file as it is automatically generated *\n");
+    fprintf(file, "#****************************************************************\n\n");
+
+    fprintf(file, "UNITY_SOURCE  :=");
+    for(int i = 0, j, active; i < plan->count; i = j) {
+        j = lm_unity_batch_end(plan, i, &active);
+        if(active) {
+            fprintf(file, " \\\n\t%s/%s", unity_dir, members[i].batch);
+        }
+    }
+    fprintf(file, "\n\n");
+
+    fprintf(file, "UNITY_MEMBERS :=");
+    for(int i = 0; i < plan->count; i++) {
+        if(!members[i].isolated) {
+            fprintf(file, " \\\n\t%s", members[i].src);
+        }
+    }
+    fprintf(file, "\n\n");
+
+    // a batch object is rebuilt when any of its members changes
+    for(int i = 0; i < plan->count; i++) {
+        if(!members[i].isolated) {
+            const char *dot = strrchr(members[i].batch, '.');
+            fprintf(file, "$(BUILD_DIR)/%.*s.o: %s\n", (int)(dot - members[i].batch), members[i].batch, members[i].src);
+        }
+    }
+    fprintf(file, "\n");
+
+    // an edited member is moved out of its batch before make reads this file again
+    fprintf(file, "%s/%s:", unity_dir, LM_UNITY_MK);
+    for(int i = 0; i < plan->count; i++) {
+        if(!members[i].isolated) {
+            fprintf(file, " \\\n\t%s", members[i].src);
+        }
+    }
+    fprintf(file, "\n\t@./lm.exe --unity-refresh %s\n", unity_dir);
+
+    if(lm_gen_commit(file, path, tmp_path) != LM_OK) {
+        return LM_ERR;
+    }
+
+    // make compares the sources against unity.mk, so the refresh must always be newer
+    if(touch) {
+        utime(path, NULL);
+    }
+
+    return LM_OK;
+}
+
+
+// the object an isolated source is compiled to on its own, next to the unity directory
+static bool lm_unity_rebuilt(const char *unity_dir, const char *src)
+{
+    char obj[LM_GEN_MAX_PATH];
+    struct stat src_st;
+    struct stat obj_st;
+
+    const char *slash = strrchr(unity_dir, '/');
+    const char *name = strrchr(src, '/');
+    name = name ? name + 1 : src;
+
+    snprintf(obj, sizeof(obj), "%.*s%.*s.o", slash ? (int)(slash - unity_dir + 1) : 0, unity_dir,
+             (int)(lm_unity_ext(name) - name), name);
+
+    return stat(src, &src_st) == 0 && stat(obj, &obj_st) == 0 && obj_st.st_mtime >= src_st.st_mtime;
+}
+
+
+int lm_unity_generate(const char *unity_dir, bool rejoin)
+{
+    lm_array_t *list = lm_parser_get_list(VAR_C_SOURCE);
+    lm_unity_plan_t previous = {0};
+    lm_unity_plan_t plan = {0};
+    lm_list_node_t *node;
+    int order = 0;
+
+    if(lm_parser_get_list(VAR_UNITY)->count == 0) {
+        lm_rm(unity_dir);
+        return LM_OK;
+    }
+
+    lm_unity_read(unity_dir, &previous);
+
+    lm_list_for_each(node, &list->head) {
+        const char *src = container_of(node, lm_array_node_t, node)->string;
+
+        if(!lm_unity_ext(src) || lm_unity_is_excluded(src) || lm_unity_batch_size(src) < 2) {
+            continue;
+        }
+
+        lm_unity_member_t *member = lm_unity_add(&plan, src);
+        if(member == NULL) {
+            break;
+        }
+        member->order = order++;
+
+        for(int i = 0; i < previous.count; i++) {
+            if(previous.members[i].isolated && strcmp(previous.members[i].src, src) == 0) {
+                member->isolated = !rejoin || !lm_unity_rebuilt(unity_dir, src);
+                break;
+            }
+        }
+    }
+
+    qsort(plan.members, plan.count, sizeof(lm_unity_member_t), lm_unity_cmp);
+
+    // cut every group into batches, a single leftover source is not worth a batch
+    int batch_no = 0;
+    int kept = 0;
+    for(int i = 0, j; i < plan.count; i = j) {
+        int size = lm_unity_batch_size(plan.members[i].src);
+
+        for(j = i + 1; j < plan.count && j - i < size && lm_unity_group_cmp(&plan.members[i], &plan.members[j]) == 0; j++);
+
+        if(j - i < 2) {
+            free(plan.members[i].src);
+            continue;
+        }
+
+        batch_no++;
+        for(int k = i; k < j; k++) {
+            plan.members[kept] = plan.members[k];
+            snprintf(plan.members[kept].batch, LM_UNITY_BATCH_LEN, "unity_%04d%s", batch_no, lm_unity_ext(plan.members[k].src));
+            kept++;
+        }
+    }
+    plan.count = kept;
+
+    int ret = lm_unity_write(unity_dir, &plan, false);
+
+    lm_unity_free(&previous);
+    lm_unity_free(&plan);
+    return ret;
+}
+
+
+int lm_unity_refresh(const char *unity_dir)
+{
+    char path[LM_GEN_MAX_PATH];
+    lm_unity_plan_t plan = {0};
+    struct stat st;
+
+    if(lm_unity_read(unity_dir, &plan) != LM_OK) {
+        LM_LOG_ERROR("no unity build in %s, please run 'make config'", unity_dir);
+        return LM_ERR;
+    }
+
+    snprintf(path, sizeof(path), "%s/%s", unity_dir, LM_UNITY_MK);
+    time_t mk_time = stat(path, &st) == 0 ? st.st_mtime : 0;
+
+    for(int i = 0; i < plan.count; i++) {
+        if(!plan.members[i].isolated && stat(plan.members[i].src, &st) == 0 && st.st_mtime > mk_time) {
+            plan.members[i].isolated = true;
+            printf("UNITY %s is compiled on its own\n", plan.members[i].src);
+        }
+    }
+
+    int ret = lm_unity_write(unity_dir, &plan, true);
+
+    lm_unity_free(&plan);
+    return ret;
+}
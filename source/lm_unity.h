@@ -0,0 +1,61 @@
+/* source/lm_unity.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_UNITY_H__
+#define __LM_UNITY_H__
+
+#include <stdbool.h>
+
+
+#define    LM_UNITY_DIR             "unity"
+#define    LM_UNITY_LIST            "unity.lst"
+#define    LM_UNITY_MK              "unity.mk"
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Group the parsed SRC list into unity batches (same directory and language,
+ * UNITY size, minus UNITY_EXCLUDE) and write unity_NNNN.c/.cpp, unity.lst and
+ * unity.mk into unity_dir. Files isolated by an earlier refresh stay isolated;
+ * with rejoin, only until their own object has been rebuilt since the edit.
+ */
+int lm_unity_generate(const char *unity_dir, bool rejoin);
+
+
+/**
+ * Called by make when a batched source is newer than unity.mk: the edited
+ * sources leave their batch and are compiled on their own from now on.
+ */
+int lm_unity_refresh(const char *unity_dir);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_UNITY_H__
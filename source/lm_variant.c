@@ -0,0 +1,261 @@
+/* source/lm_variant.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "lm_variant.h"
+#include "lm_hash.h"
+#include "lm_parser.h"
+#include "lm_error.h"
+#include "lm_log.h"
+#include "lm_cmd.h"
+
+#if ( __linux__)
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+
+#define    LM_VARIANT_MAX_PATH      1024
+#define    LM_VARIANT_HEADER_STAMP  ".lm_header"
+
+
+typedef struct lm_variant_dir {
+    char name[LM_HASH_HEX_LEN];
+    struct timespec mtime;
+}lm_variant_dir_t;
+
+
+void lm_variant_hash(char *hex)
+{
+    lm_macro_head_t *macro_list = lm_parser_get_macro_head();
+    lm_list_node_t *node = lm_list_next_node(&macro_list->node);
+    lm_hash_t hash;
+
+    lm_hash_init(&hash);
+
+    for(int i = 0; i < macro_list->count; i++) {
+        lm_macro_t *macro = container_of(node, lm_macro_t, node);
+
+        if(macro->value != NULL) {
+            lm_hash_string(&hash, macro->name);
+            lm_hash_string(&hash, macro->value);
+        }
+
+        node = lm_list_next_node(node);
+    }
+
+    int len = lm_parser_get_parser_list_count() / sizeof(lm_array_t);
+    lm_array_t *list = (lm_array_t*)lm_parser_get_parser_list_head();
+
+    for(int i = 0; i < len; i++, list++) {
+        lm_hash_string(&hash, lm_parser_get_parser_list_name(i));
+
+        lm_list_for_each(node, &list->head) {
+            lm_array_node_t *array_node = container_of(node, lm_array_node_t, node);
+            lm_hash_string(&hash, array_node->string);
+        }
+    }
+
+    lm_hash_final(&hash, hex);
+}
+
+
+static bool lm_variant_is_hash(const char *name)
+{
+    return strlen(name) == LM_HASH_HEX_LEN - 1 && strspn(name, "0123456789abcdef") == LM_HASH_HEX_LEN - 1;
+}
+
+
+/*
+ * config.h is shared by every variant, so each switch rewrites it and would
+ * make all objects of the variant we come back to look stale. A copy kept in
+ * the variant remembers the header time, and is restored when contents match.
+ */
+static void lm_variant_header_time(const char *variant_dir, const char *header_file)
+{
+#if ( __linux__)
+    char stamp[LM_VARIANT_MAX_PATH];
+    struct stat st;
+
+    snprintf(stamp, sizeof(stamp), "%s/%s", variant_dir, LM_VARIANT_HEADER_STAMP);
+
+    if(stat(stamp, &st) == 0 && lm_file_is_same(stamp, header_file)) {
+        struct timespec times[2] = { st.st_mtim, st.st_mtim };
+        utimensat(AT_FDCWD, header_file, times, 0);
+        return;
+    }
+
+    if(stat(header_file, &st) != 0 || lm_clone_file(header_file, stamp, false) != 0) {
+        return;
+    }
+
+    struct timespec times[2] = { st.st_mtim, st.st_mtim };
+    utimensat(AT_FDCWD, stamp, times, 0);
+#else
+    (void)variant_dir;
+    (void)header_file;
+#endif
+}
+
+
+static int lm_variant_link(const char *root, const char *hex)
+{
+#if ( __linux__)
+    char link_path[LM_VARIANT_MAX_PATH];
+    char tmp_path[LM_VARIANT_MAX_PATH];
+    char target[LM_VARIANT_MAX_PATH];
+
+    snprintf(link_path, sizeof(link_path), "%s/%s", root, LM_VARIANT_CURRENT);
+
+    ssize_t len = readlink(link_path, target, sizeof(target) - 1);
+    if(len == LM_HASH_HEX_LEN - 1 && strncmp(target, hex, len) == 0) {
+        return LM_OK;
+    }
+
+    // relative target so the build root can be moved; rename replaces the old link atomically
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%d", link_path, (int)getpid());
+    remove(tmp_path);
+    if(symlink(hex, tmp_path) != 0 || rename(tmp_path, link_path) != 0) {
+        remove(tmp_path);
+        LM_LOG_ERROR("can not update %s", link_path);
+        return LM_ERR;
+    }
+#else
+    (void)root;
+    (void)hex;
+#endif
+
+    return LM_OK;
+}
+
+
+static int lm_variant_cmp(const void *a, const void *b)
+{
+    const lm_variant_dir_t *da = a;
+    const lm_variant_dir_t *db = b;
+
+    if(da->mtime.tv_sec != db->mtime.tv_sec) {
+        return da->mtime.tv_sec < db->mtime.tv_sec ? 1 : -1;
+    }
+
+    return (da->mtime.tv_nsec < db->mtime.tv_nsec) - (da->mtime.tv_nsec > db->mtime.tv_nsec);
+}
+
+
+// the active variant counts towards keep and is never removed
+static void lm_variant_prune(const char *root, const char *active, int keep, int age_days)
+{
+    char path[LM_VARIANT_MAX_PATH];
+    lm_variant_dir_t *dirs = NULL;
+    int count = 0;
+    int size = 0;
+    struct dirent *entry;
+    struct stat st;
+
+    DIR *dir = opendir(root);
+    if(dir == NULL) {
+        return;
+    }
+
+    while((entry = readdir(dir)) != NULL) {
+        if(!lm_variant_is_hash(entry->d_name) || strcmp(entry->d_name, active) == 0) {
+            continue;
+        }
+
+        snprintf(path, sizeof(path), "%s/%s", root, entry->d_name);
+        if(stat(path, &st) != 0 || !S_ISDIR(st.st_mode)) {
+            continue;
+        }
+
+        if(count == size) {
+            size = size ? size * 2 : 16;
+            lm_variant_dir_t *grow = realloc(dirs, size * sizeof(*dirs));
+            if(grow == NULL) {
+                break;
+            }
+            dirs = grow;
+        }
+
+        snprintf(dirs[count].name, sizeof(dirs[count].name), "%s", entry->d_name);
+        dirs[count].mtime = st.st_mtim;
+        count++;
+    }
+    closedir(dir);
+
+    qsort(dirs, count, sizeof(*dirs), lm_variant_cmp);
+
+    time_t oldest = time(NULL) - (time_t)age_days * 24 * 3600;
+
+    for(int i = 0; i < count; i++) {
+        bool over_count = keep > 0 && i + 1 >= keep;
+        bool too_old = age_days > 0 && dirs[i].mtime.tv_sec < oldest;
+
+        if(over_count || too_old) {
+            snprintf(path, sizeof(path), "%s/%s", root, dirs[i].name);
+            if(lm_rm(path) != 0) {
+                LM_LOG_WARN("can not remove old variant %s", path);
+            }
+        }
+    }
+
+    free(dirs);
+}
+
+
+int lm_variant_select(const char *root, const char *header_file, int keep, int age_days)
+{
+    char hex[LM_HASH_HEX_LEN];
+    char path[LM_VARIANT_MAX_PATH];
+
+    lm_variant_hash(hex);
+
+    lm_mkdir(root);
+    snprintf(path, sizeof(path), "%s/%s", root, hex);
+    lm_mkdir(path);
+
+    if(access(path, F_OK) != 0) {
+        LM_LOG_ERROR("can not create %s", path);
+        return LM_ERR;
+    }
+
+#if ( __linux__)
+    // the directory mtime is the last time the variant was selected
+    utimensat(AT_FDCWD, path, NULL, 0);
+#endif
+
+    lm_variant_header_time(path, header_file);
+
+    if(lm_variant_link(root, hex) != LM_OK) {
+        return LM_ERR;
+    }
+
+    lm_variant_prune(root, hex, keep, age_days);
+    return LM_OK;
+}
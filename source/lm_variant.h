@@ -0,0 +1,59 @@
+/* source/lm_variant.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_VARIANT_H__
+#define __LM_VARIANT_H__
+
+
+#define    LM_VARIANT_CURRENT       "current"
+#define    LM_VARIANT_KEEP          8
+#define    LM_VARIANT_AGE_DAYS      30
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Hash of every resolved macro value and every parsed list (sources, flags,
+ * paths...), written to hex (LM_HASH_HEX_LEN bytes). Equal hashes mean the
+ * two configurations build the same objects.
+ */
+void lm_variant_hash(char *hex);
+
+
+/**
+ * Make <root>/<hash> the active variant: create it, point <root>/current at
+ * it, give the header back the timestamp it had when this variant was last
+ * active, and prune variants beyond the newest keep or older than age_days.
+ */
+int lm_variant_select(const char *root, const char *header_file, int keep, int age_days);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_VARIANT_H__
@@ -0,0 +1,282 @@
+/* source/lm_watch.c
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include "lm_watch.h"
+#include "lm_parser.h"
+#include "lm_error.h"
+#include "lm_log.h"
+
+
+#if ( __linux__)
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+
+
+#define    LM_WATCH_MAX_PATH        1024
+#define    LM_WATCH_MASK            (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE)
+
+
+typedef struct lm_watch_input {
+    char *path;
+    const char *name;   // file name inside the watched directory, NULL for a wildcard directory
+    bool is_dir;
+    int wd;
+}lm_watch_input_t;
+
+
+static struct lm_watch_list {
+    lm_watch_input_t *inputs;
+    int count;
+    int size;
+}watch_list;
+
+
+static void lm_watch_input(const char *path, bool is_dir)
+{
+    for(int i = 0; i < watch_list.count; i++) {
+        if(watch_list.inputs[i].is_dir == is_dir && strcmp(watch_list.inputs[i].path, path) == 0) {
+            return;
+        }
+    }
+
+    if(watch_list.count == watch_list.size) {
+        int size = watch_list.size ? watch_list.size * 2 : 16;
+        lm_watch_input_t *grow = realloc(watch_list.inputs, size * sizeof(lm_watch_input_t));
+        if(grow == NULL) {
+            return;
+        }
+        watch_list.inputs = grow;
+        watch_list.size = size;
+    }
+
+    lm_watch_input_t *input = &watch_list.inputs[watch_list.count];
+
+    input->path = strdup(path);
+    if(input->path == NULL) {
+        return;
+    }
+
+    const char *slash = strrchr(input->path, '/');
+    input->name = is_dir ? NULL : (slash ? slash + 1 : input->path);
+    input->is_dir = is_dir;
+    input->wd = -1;
+    watch_list.count++;
+}
+
+
+// files are watched through their directory, editors often save by renaming a new file over the old one
+void lm_watch_sync(int fd)
+{
+    char dir[LM_WATCH_MAX_PATH];
+
+    for(int i = 0; i < watch_list.count; i++) {
+        lm_watch_input_t *input = &watch_list.inputs[i];
+
+        if(input->is_dir) {
+            snprintf(dir, sizeof(dir), "%s", input->path);
+        }
+        else if(input->name == input->path) {
+            snprintf(dir, sizeof(dir), ".");
+        }
+        else {
+            snprintf(dir, sizeof(dir), "%.*s", (int)(input->name - input->path - 1), input->path);
+        }
+
+        input->wd = inotify_add_watch(fd, dir[0] ? dir : "/", LM_WATCH_MASK);
+        if(input->wd < 0) {
+            LM_LOG_WARN("can not watch %s", dir);
+        }
+    }
+}
+
+
+static const char *lm_watch_match(const struct inotify_event *event)
+{
+    if(event->len == 0) {
+        return NULL;
+    }
+
+    for(int i = 0; i < watch_list.count; i++) {
+        lm_watch_input_t *input = &watch_list.inputs[i];
+
+        if(input->wd != event->wd) {
+            continue;
+        }
+
+        if(input->is_dir) {
+            size_t len = strlen(event->name);
+            if(len >= 2 && strcmp(event->name + len - 2, ".c") == 0) {
+                return input->path;
+            }
+        }
+        else if(strcmp(input->name, event->name) == 0) {
+            return input->path;
+        }
+    }
+
+    return NULL;
+}
+
+
+// read what is queued, returns the first watched input it touches
+const char *lm_watch_read(int fd, int timeout_ms, bool *events)
+{
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = { .fd = fd, .events = POLLIN };
+    const char *changed = NULL;
+
+    if(events != NULL) {
+        *events = false;
+    }
+
+    if(poll(&pfd, 1, timeout_ms) <= 0) {
+        return NULL;
+    }
+
+    ssize_t len = read(fd, buf, sizeof(buf));
+    if(events != NULL) {
+        *events = len > 0;
+    }
+
+    for(char *p = buf; len > 0 && p < buf + len;) {
+        const struct inotify_event *event = (const struct inotify_event*)p;
+
+        if(changed == NULL) {
+            changed = lm_watch_match(event);
+        }
+        p += sizeof(struct inotify_event) + event->len;
+    }
+
+    return changed;
+}
+
+
+static double lm_watch_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+
+int lm_watch_open(void)
+{
+    int fd = inotify_init1(IN_CLOEXEC);
+    if(fd < 0) {
+        LM_LOG_ERROR("can not start inotify");
+        return -1;
+    }
+
+    lm_parser_set_input_hook(lm_watch_input);
+    return fd;
+}
+
+
+int lm_watch(lm_watch_fn configure)
+{
+    int fd = lm_watch_open();
+    if(fd < 0) {
+        return LM_ERR;
+    }
+
+    for(;;) {
+        struct timespec start;
+
+        // inputs of earlier runs stay watched, a half edited lm.cfg may stop before its includes
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        int ret = configure();
+        double ms = lm_watch_ms(&start);
+
+        lm_watch_sync(fd);
+
+        if(ret == LM_OK) {
+            printf("[watch] configured in %.3f ms, watching %d inputs\n", ms, watch_list.count);
+        }
+        else {
+            printf("[watch] config failed, waiting for the next change\n");
+        }
+        fflush(stdout);
+
+        const char *changed = NULL;
+        while(changed == NULL) {
+            changed = lm_watch_read(fd, -1, NULL);
+        }
+
+        printf("[watch] %s changed\n", changed);
+
+        // let an editor finish saving before reading the files again, any event counts,
+        // config.h or .lm.mk rewritten next to lm.cfg must not end the burst early
+        bool events = true;
+        while(events) {
+            lm_watch_read(fd, LM_WATCH_SETTLE_MS, &events);
+        }
+    }
+
+    return LM_OK;
+}
+
+
+#else
+
+int lm_watch(lm_watch_fn configure)
+{
+    (void)configure;
+
+    LM_LOG_ERROR("--watch is only supported on linux");
+    return LM_ERR;
+}
+
+
+int lm_watch_open(void)
+{
+    return -1;
+}
+
+
+void lm_watch_sync(int fd)
+{
+    (void)fd;
+}
+
+
+const char *lm_watch_read(int fd, int timeout_ms, bool *events)
+{
+    (void)fd;
+    (void)timeout_ms;
+    if(events != NULL) {
+        *events = false;
+    }
+    return NULL;
+}
+
+#endif
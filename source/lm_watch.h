@@ -0,0 +1,68 @@
+/* source/lm_watch.h
+ *
+ * MIT License
+ *
+ * Copyright(c) 2023-present @ li shanwen
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef __LM_WATCH_H__
+#define __LM_WATCH_H__
+
+#include <stdbool.h>
+
+
+#define    LM_WATCH_SETTLE_MS       20
+
+
+typedef int (*lm_watch_fn)(void);
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * Run configure, then run it again every time a file the parser read (every
+ * lm.cfg and the .config) or a directory a wildcard listed changes. Bursts
+ * of events closer than LM_WATCH_SETTLE_MS make one run. Only returns when
+ * watching is not possible.
+ */
+int lm_watch(lm_watch_fn configure);
+
+
+/**
+ * The pieces lm_watch is made of. lm_watch_open returns an inotify fd and
+ * starts recording the parser inputs, lm_watch_sync watches the inputs
+ * recorded so far, and lm_watch_read waits up to timeout_ms (-1 forever)
+ * and returns the first watched input the queued events touch, or NULL.
+ * When events is not NULL it tells a timeout (false) apart from events
+ * that only touched files nobody watches (true, NULL returned).
+ */
+int lm_watch_open(void);
+void lm_watch_sync(int fd);
+const char *lm_watch_read(int fd, int timeout_ms, bool *events);
+
+
+#ifdef __cplusplus
+} /*extern "C"*/
+#endif
+
+
+#endif //!__LM_WATCH_H__
@@ -22,6 +22,8 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "lm_log.h"
 #include "lm_error.h"
 #include "lm_parser.h"
@@ -31,6 +33,19 @@
 #include "config.h"
 #include "lm_gen.h"
 #include "lm_cmd.h"
+#include "lm_build.h"
+#include "lm_cache.h"
+#include "lm_variant.h"
+#include "lm_unity.h"
+#include "lm_hash.h"
+#include "lm_batch.h"
+#include "lm_dep.h"
+#include "lm_watch.h"
+#include "lm_server.h"
+#include "lm_time.h"
+#include "lm_trace.h"
+#include "lm_timeline.h"
+#include "lm_install.h"
 
 
 #define    VERSION           "0.20250709"
@@ -44,8 +59,27 @@ static const char *lmcfg = "lm.cfg";
 static const char *header_file = "config.h";
 static const char *lmmk_file = ".lm.mk";
 static const char *gcc_prefix="";
-static int mem_size = CONFIG_MEM_POOL_SIZE;
+static int mem_size = 0;
 static bool blind = false;
+static int jobs = 0;
+static bool variant = false;
+static int keep_variants = LM_VARIANT_KEEP;
+static int variant_age = LM_VARIANT_AGE_DAYS;
+static const char *batch_config = NULL;
+static const char *outdir = "out";
+static bool enumerate = false;
+static bool randconfig = false;
+static uint64_t seed = 0;
+static int count = 0;
+static const char *can_enable = NULL;
+static const char *enable_path = NULL;
+static const char *forced_by = NULL;
+static bool check_deps = false;
+static bool quick = false;
+static bool watch = false;
+static const char *serve = NULL;
+static const char *install = NULL;
+static bool time_report = false;
 
 
 static void show_flag_usage(char *flag, char *example)
@@ -106,9 +140,22 @@ static void show_key_usage(void)
     printf("    LIBPATH-$(CONFIG_XXX): add library path dependent on CONFIG_XXX\n");
     show_flag_usage("LIBPATH", "path/to/lib/path");
 
+    printf("    UNITY:                 set unity build batch size for this lm.cfg directory, **/N also below it, 0 turns it off\n");
+    printf("    UNITY-$(CONFIG_XXX):   set unity build batch size dependent on CONFIG_XXX\n");
+    show_flag_usage("UNITY", "8  drivers/16");
+
+    printf("    UNITY_EXCLUDE:         keep source files out of unity batches\n");
+    show_flag_usage("UNITY_EXCLUDE", "isr.c");
+
+    printf("    PCH:                   add precompiled header\n");
+    printf("    PCH-$(CONFIG_XXX):     add precompiled header dependent on CONFIG_XXX\n");
+    show_flag_usage("PCH", "common.h  [Note: force-included into every c/c++ source]");
+
     printf("\n");
     printf("    include:               include sub lm.cfg\n");
     printf("    include-$(CONFIG_XXX): include sub lm.cfg dependent on CONFIG_XXX\n");
+    printf("    LIBRARY name:          archive SRC/ASM up to the next empty line (and included lm.cfg) into libname.a\n");
+    printf("    TARGET name:           SRC/ASM/LDS/LDFLAG up to the next empty line only go into the name executable\n");
 }
 
 
@@ -123,16 +170,54 @@ static void show_help(char *app_name)
     printf("    --projcfg                             Input using project config file, default: %s\n", projcfg);
     printf("    --out                                 Output config header file, default: %s\n", header_file);
     printf("    --mk                                  Output config makefile file, default: %s\n", lmmk_file);
-    printf("    --mem                                 Memory size used by lm, default: %dMB\n", mem_size);
+    printf("    --mem                                 Memory limit of lm in MB, default: no limit\n");
+    printf("    --mem-stats                           Display memory usage and the blocks still allocated at exit\n");
     printf("    --blind                               Hide information about configuration macros\n");
+    printf("    --time-report                         Display the time of each phase and input file, and the slowest files\n");
+    printf("    --trace <out.json>                    Write a Chrome/Perfetto trace of the parser and generators at exit (debug builds)\n");
     printf("\n");
     printf("    --gen                                 Generate Makefile: by toplayer lm.cfg, defaule: Makefile\n");
     printf("    --project                             Generate Makefile: project name, default: demo\n");
     printf("    --build                               Generate Makefile: build directory, default: build\n");
     printf("    --prefix                              Generate Makefile: cross compiler prefix\n");
+    printf("    --variant                             Generate Makefile: one build directory per configuration hash\n");
+    printf("    --keep-variants                       Config: number of variant build directories kept, default: %d\n", keep_variants);
+    printf("    --variant-age                         Config: remove variant build directories unused for days, default: %d\n", variant_age);
+    printf("\n");
+    printf("    --unity-refresh                       Move edited sources out of their unity batch (run by make)\n");
+    printf("\n");
+    printf("    --batch-configs <a.config> [b ...]    Resolve many config files against lm.cfg, summarize the failures\n");
+    printf("    --outdir                              Batch: output directory, one <config name>/ per config, default: out\n");
+    printf("    --jobs                                Batch: parallel workers, default: one per cpu\n");
+    printf("    --quick                               Batch: only resolve enables and check values, 256 configs at a time, no outputs\n");
+    printf("\n");
+    printf("    --enumerate                           Count the valid configurations, with --count write the first ones\n");
+    printf("    --randconfig                          Write --count random valid configurations\n");
+    printf("    --seed                                Randconfig: random seed, default: 0\n");
+    printf("    --count                               Enumerate/randconfig: number of .config files written to --outdir\n");
+    printf("    --can-enable <macro>                  Tell whether any valid configuration enables a macro, or why none does\n");
+    printf("    --enable-path <macro>                 List the fewest changes to --projcfg that enable a macro\n");
+    printf("    --forced-by <macro>                   List the macros that enabling a macro turns on or off\n");
+    printf("    --check-deps                          List the macros that can never be enabled\n");
+    printf("\n");
+    printf("    --watch                               Stay running and redo the config step when a lm.cfg, .config or wildcard directory changes\n");
+    printf("    --serve <socket|->                    Answer JSON queries (value, source, flags, validate) on a unix socket or stdin/stdout\n");
     printf("\n");
     printf("    --rm                                  Delete directory or file\n");
-    printf("    --cp                                  Copy file\n");
+    printf("    --rm-async                            Rename a directory aside and delete it in the background\n");
+    printf("    --install <manifest>                  Stage the \"src dest\" lines of a manifest into --outdir, remove what it no longer lists\n");
+    printf("    --cp <src> <dst>                      Copy file, keep its mode and times, leave an identical destination alone\n");
+    printf("\n");
+    printf("    --cache-exec <compile command>        Run a compile command through the object cache in $LM_CACHE_DIR\n");
+    printf("    --cache-stats                         Display the object cache hits, misses and size\n");
+    printf("\n");
+    printf("    --time-cmd <target> <command>         Run a recipe command, log its times to $LM_TIMELINE\n");
+    printf("    --build-report <log>                  Summarize a $LM_TIMELINE log and write <log>.json as a Chrome trace\n");
+    printf("\n");
+    printf("    build [options]                       Configure, compile and link without make\n");
+    printf("        -j, --jobs                        Build: parallel jobs, default: one per cpu or the make jobserver\n");
+    printf("        --project, --build, --prefix      Build: same as the Makefile options above\n");
+    printf("    explain [target] [options]            List the objects the next build recompiles and why, builds nothing\n");
 }
 
 
@@ -146,6 +231,7 @@ static struct option cmd_long_options[] =
     {"out",       required_argument,       NULL, 'f'},
     {"mk",        required_argument,       NULL, 'g'},
     {"mem",       required_argument,       NULL, 'h'},
+    {"mem-stats", no_argument,             NULL, 'I'},
     {"blind",     no_argument,             NULL, 'i'},
 
     {"gen",       required_argument,       NULL, 'j'},
@@ -154,12 +240,265 @@ static struct option cmd_long_options[] =
     {"prefix",    required_argument,       NULL, 'm'},
 
     {"rm",        required_argument,       NULL, 'n'},
+    {"rm-async",  required_argument,       NULL, 'M'},
+    {"install",   required_argument,       NULL, 'N'},
     {"cp",        required_argument,       NULL, 'o'},
+    {"cache-stats", no_argument,           NULL, 'p'},
+
+    {"variant",   no_argument,             NULL, 'q'},
+    {"keep-variants", required_argument,   NULL, 'r'},
+    {"variant-age", required_argument,     NULL, 's'},
+    {"unity-refresh", required_argument,   NULL, 't'},
+
+    {"outdir",    required_argument,       NULL, 'u'},
+    {"batch-configs", required_argument,   NULL, 'v'},
+    {"jobs",      required_argument,       NULL, 'w'},
+
+    {"enumerate", no_argument,             NULL, 'x'},
+    {"randconfig", no_argument,            NULL, 'y'},
+    {"seed",      required_argument,       NULL, 'z'},
+    {"count",     required_argument,       NULL, 'A'},
+    {"can-enable", required_argument,      NULL, 'B'},
+    {"enable-path", required_argument,     NULL, 'C'},
+    {"forced-by", required_argument,       NULL, 'D'},
+    {"check-deps", no_argument,            NULL, 'E'},
+    {"quick",     no_argument,             NULL, 'F'},
+    {"watch",     no_argument,             NULL, 'G'},
+    {"serve",     required_argument,       NULL, 'H'},
+    {"time-report", no_argument,           NULL, 'J'},
+    {"trace",     required_argument,       NULL, 'K'},
+    {"build-report", required_argument,    NULL, 'L'},
+    {NULL,        0,                       NULL,  0},
+};
+
+
+static const char *shortopts = "abcd:e:f:g:h:i:j:k:l:m:n:opqr:s:t:u:v:w:xyz:A:B:C:D:EFGH:IJK:L:M:N:";
+
+
+static struct option build_long_options[] =
+{
+    {"lmcfg",     required_argument,       NULL, 'd'},
+    {"projcfg",   required_argument,       NULL, 'e'},
+    {"out",       required_argument,       NULL, 'f'},
+    {"mk",        required_argument,       NULL, 'g'},
+    {"mem",       required_argument,       NULL, 'h'},
+    {"mem-stats", no_argument,             NULL, 'I'},
+    {"jobs",      required_argument,       NULL, 'j'},
+    {"project",   required_argument,       NULL, 'k'},
+    {"build",     required_argument,       NULL, 'l'},
+    {"prefix",    required_argument,       NULL, 'm'},
+    {"trace",     required_argument,       NULL, 'K'},
     {NULL,        0,                       NULL,  0},
 };
 
 
-static const char *shortopts = "abcd:e:f:g:h:i:j:k:l:m:n:o";
+static void main_build_options(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt_long (argc, argv, "j:", build_long_options, NULL)) != -1) {
+        switch (opt) {
+            case 'd':
+                lmcfg = optarg;
+                break;
+            case 'e':
+                projcfg = optarg;
+                break;
+            case 'f':
+                header_file = optarg;
+                break;
+            case 'g':
+                lmmk_file = optarg;
+                break;
+            case 'h':
+                mem_size = strtol(optarg, NULL, 10);
+                break;
+            case 'I':
+                lm_mem_set_stats(true);
+                break;
+            case 'j':
+                jobs = strtol(optarg, NULL, 10);
+                break;
+            case 'k':
+                pro_name = optarg;
+                break;
+            case 'l':
+                build_dir = optarg;
+                break;
+            case 'm':
+                gcc_prefix = optarg;
+                break;
+            case 'K':
+                if(lm_trace_start(optarg) != LM_OK) {
+                    LM_LOG_WARN("--trace needs a build with CONFIG_DEBUG=y");
+                }
+                break;
+            default:
+                LM_LOG_ERROR("Unknown option: %c\n", optopt);
+                exit(1);
+                break;
+        }
+    }
+}
+
+
+// lm build: configure, then compile and link with the built-in executor
+static int main_build(int argc, char *argv[])
+{
+    int ret;
+
+    main_build_options(argc, argv);
+
+    lm_mem_init(mem_size);
+
+    lm_parser_init();
+
+    ret = lm_parser_config_file(projcfg);
+    if(ret == LM_ERR) {
+        goto error;
+    }
+
+    ret = lm_parser_lm_file(NULL, lmcfg);
+    if(ret == LM_ERR) {
+        goto error;
+    }
+
+    ret = lm_gen_lmmk_file(lmmk_file);
+    if(ret == LM_ERR) {
+        goto error;
+    }
+
+    ret = lm_gen_header_file(header_file);
+    if(ret == LM_ERR) {
+        goto error;
+    }
+
+    // batches are kept between runs, edited members leave them as they do under make
+    char unity_dir[LM_GEN_MAX_PATH];
+    snprintf(unity_dir, sizeof(unity_dir), "%s/%s", build_dir, LM_UNITY_DIR);
+
+    ret = lm_unity_generate(unity_dir, false);
+    if(ret == LM_OK && lm_parser_get_list(VAR_UNITY)->count > 0) {
+        ret = lm_unity_refresh(unity_dir);
+    }
+    if(ret == LM_ERR) {
+        goto error;
+    }
+
+    ret = lm_build_run(pro_name, build_dir, gcc_prefix, header_file, jobs);
+
+    lm_mem_destroy();
+    return ret == LM_OK ? 0 : 1;
+
+error:
+    lm_mem_destroy();
+    LM_LOG_ERROR("parser failed, exiting");
+    return 1;
+}
+
+
+// lm explain [target]: resolve the configuration without writing it, then report what would rebuild
+static int main_explain(int argc, char *argv[])
+{
+    int ret;
+
+    main_build_options(argc, argv);
+
+    lm_mem_init(mem_size);
+
+    lm_parser_init();
+
+    ret = lm_parser_config_file(projcfg);
+    if(ret != LM_ERR) {
+        ret = lm_parser_lm_file(NULL, lmcfg);
+    }
+
+    if(ret == LM_ERR) {
+        lm_mem_destroy();
+        LM_LOG_ERROR("parser failed, exiting");
+        return 1;
+    }
+
+    ret = lm_build_explain(build_dir, lmmk_file, gcc_prefix, header_file, optind < argc ? argv[optind] : NULL);
+
+    lm_mem_destroy();
+    return ret == LM_OK ? 0 : 1;
+}
+
+
+/*
+ * The config step: resolve .config against lm.cfg and write the header,
+ * .lm.mk and unity batches. Each run starts from a fresh memory pool.
+ */
+static int configure(void)
+{
+    lm_mem_init(mem_size);
+
+    lm_parser_init();
+
+    int ret = lm_parser_config_file(projcfg);
+    if(ret == LM_ERR) {
+        goto exit;
+    }
+
+    ret = lm_parser_lm_file(NULL, lmcfg);
+    if(ret == LM_ERR) {
+        goto exit;
+    }
+
+    int timer = lm_time_begin("write", lmmk_file);
+    ret = lm_gen_lmmk_file(lmmk_file);
+    lm_time_end(timer);
+    if(ret == LM_ERR) {
+        goto exit;
+    }
+
+    timer = lm_time_begin("write", header_file);
+    ret = lm_gen_header_file(header_file);
+    lm_time_end(timer);
+    if(ret == LM_ERR) {
+        goto exit;
+    }
+
+    char unity_dir[LM_GEN_MAX_PATH];
+    snprintf(unity_dir, sizeof(unity_dir), "%s/%s", build_dir, LM_UNITY_DIR);
+
+    if(variant) {
+        timer = lm_time_begin("select variant", build_dir);
+        ret = lm_variant_select(build_dir, header_file, keep_variants, variant_age);
+        lm_time_end(timer);
+        if(ret == LM_ERR) {
+            goto exit;
+        }
+
+        char hex[LM_HASH_HEX_LEN];
+        lm_variant_hash(hex);
+        snprintf(unity_dir, sizeof(unity_dir), "%s/%s/%s", build_dir, hex, LM_UNITY_DIR);
+    }
+
+    timer = lm_time_begin("unity batches", unity_dir);
+    ret = lm_unity_generate(unity_dir, true);
+    lm_time_end(timer);
+    if(ret == LM_ERR) {
+        goto exit;
+    }
+
+    // dead macros are only reported, they do not stop the configuration
+    timer = lm_time_begin("check depends", lmcfg);
+    lm_dep_check_cached(lmmk_file);
+    lm_time_end(timer);
+
+    if(!blind) {
+        lm_macro_print_all_value(lm_parser_get_macro_head());
+    }
+
+exit:
+    if(time_report) {
+        lm_time_report(lm_parser_get_macro_head()->count);
+    }
+    lm_mem_destroy();
+    return ret == LM_ERR ? LM_ERR : LM_OK;
+}
 
 
 int main(int argc, char *argv[])
@@ -172,6 +511,23 @@ int main(int argc, char *argv[])
         exit(0);
     }
 
+    if(strcmp(argv[1], "build") == 0) {
+        return main_build(argc - 1, argv + 1);
+    }
+
+    if(strcmp(argv[1], "explain") == 0) {
+        return main_explain(argc - 1, argv + 1);
+    }
+
+    // everything after --cache-exec belongs to the compiler, keep it away from getopt
+    if(strcmp(argv[1], "--cache-exec") == 0) {
+        return lm_cache_exec(argc - 2, argv + 2);
+    }
+
+    if(strcmp(argv[1], "--time-cmd") == 0) {
+        return lm_timeline_exec(argc - 2, argv + 2);
+    }
+
     while ((opt = getopt_long (argc, argv, shortopts, cmd_long_options, NULL)) != -1) {
         switch (opt) {
             case 'a':
@@ -202,6 +558,9 @@ int main(int argc, char *argv[])
             case 'h':
                 mem_size = strtol(optarg, NULL, 10);
                 break;
+            case 'I':
+                lm_mem_set_stats(true);
+                break;
             case 'i':
                 blind = true;
                 break;
@@ -221,10 +580,87 @@ int main(int argc, char *argv[])
                 ret = lm_rm(optarg);
                 exit(ret);
                 break;
+            case 'M':
+                ret = lm_rm_async(optarg);
+                exit(ret);
+                break;
+            case 'N':
+                install = optarg;
+                break;
             case 'o':
                 ret = lm_copy_file(optarg, argv[optind]);
                 exit(ret);
                 break;
+            case 'p':
+                exit(lm_cache_stats());
+                break;
+            case 'q':
+                variant = true;
+                break;
+            case 'r':
+                keep_variants = strtol(optarg, NULL, 10);
+                break;
+            case 's':
+                variant_age = strtol(optarg, NULL, 10);
+                break;
+            case 't':
+                ret = lm_unity_refresh(optarg);
+                exit(ret == LM_OK ? 0 : 1);
+                break;
+            case 'u':
+                outdir = optarg;
+                break;
+            case 'v':
+                batch_config = optarg;
+                break;
+            case 'w':
+                jobs = strtol(optarg, NULL, 10);
+                break;
+            case 'x':
+                enumerate = true;
+                break;
+            case 'y':
+                randconfig = true;
+                break;
+            case 'z':
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'A':
+                count = strtol(optarg, NULL, 10);
+                break;
+            case 'B':
+                can_enable = optarg;
+                break;
+            case 'C':
+                enable_path = optarg;
+                break;
+            case 'D':
+                forced_by = optarg;
+                break;
+            case 'E':
+                check_deps = true;
+                break;
+            case 'F':
+                quick = true;
+                break;
+            case 'G':
+                watch = true;
+                break;
+            case 'H':
+                serve = optarg;
+                break;
+            case 'J':
+                lm_time_enable(true);
+                time_report = true;
+                break;
+            case 'K':
+                if(lm_trace_start(optarg) != LM_OK) {
+                    LM_LOG_WARN("--trace needs a build with CONFIG_DEBUG=y");
+                }
+                break;
+            case 'L':
+                exit(lm_timeline_report(optarg) == LM_OK ? 0 : 1);
+                break;
             case '?':
                 LM_LOG_ERROR("Unknown option: %c\n", optopt);
                 exit(1);
@@ -236,6 +672,91 @@ int main(int argc, char *argv[])
         }
     }
 
+    // after getopt, so --outdir and --jobs may come in any order
+    if(install) {
+        exit(lm_install(install, outdir, jobs) == LM_OK ? 0 : 1);
+    }
+
+    // the first config is the option argument, the others are left over after getopt
+    if(batch_config) {
+        int config_count = argc - optind + 1;
+        char **configs = malloc(config_count * sizeof(char*));
+        if(configs == NULL) {
+            exit(1);
+        }
+
+        configs[0] = (char*)batch_config;
+        for(int i = optind; i < argc; i++) {
+            configs[i - optind + 1] = argv[i];
+        }
+
+        if(quick) {
+            ret = lm_batch_quick(lmcfg, configs, config_count, mem_size);
+        }
+        else {
+            ret = lm_batch_configs(lmcfg, configs, config_count, outdir, mem_size, jobs);
+        }
+        free(configs);
+        exit(ret == LM_OK ? 0 : 1);
+    }
+
+    // the model comes from lm.cfg alone, macro values of the current .config do not matter
+    if(enumerate || randconfig) {
+        lm_mem_init(mem_size);
+        lm_parser_init();
+
+        ret = lm_parser_lm_file(NULL, lmcfg);
+        if(ret == LM_OK) {
+            ret = lm_dep_load();
+        }
+
+        if(ret == LM_OK && enumerate) {
+            ret = count > 0 ? lm_dep_enumerate(outdir, count) : lm_dep_count();
+        }
+        else if(ret == LM_OK) {
+            ret = lm_dep_randconfig(outdir, seed, count > 0 ? count : 1);
+        }
+
+        lm_dep_free();
+        lm_mem_destroy();
+        exit(ret == LM_OK ? 0 : 1);
+    }
+
+    // the current .config is read when there is one, --enable-path starts from it
+    if(can_enable || enable_path || forced_by || check_deps) {
+        lm_mem_init(mem_size);
+        lm_parser_init();
+
+        ret = access(projcfg, F_OK) == 0 ? lm_parser_config_file(projcfg) : LM_OK;
+        if(ret == LM_OK) {
+            ret = lm_parser_lm_file(NULL, lmcfg);
+        }
+        if(ret == LM_OK) {
+            ret = lm_dep_load();
+        }
+
+        if(ret == LM_OK && can_enable) {
+            ret = lm_dep_can_enable(can_enable, false);
+        }
+        if(ret == LM_OK && enable_path) {
+            ret = lm_dep_can_enable(enable_path, true);
+        }
+        if(ret == LM_OK && forced_by) {
+            ret = lm_dep_forced_by(forced_by);
+        }
+        if(ret == LM_OK && check_deps) {
+            ret = lm_dep_check(true);
+        }
+
+        lm_dep_free();
+        lm_mem_destroy();
+        exit(ret == LM_OK ? 0 : 1);
+    }
+
+    if(serve) {
+        exit(lm_server(serve, lmcfg, projcfg, mem_size) == LM_OK ? 0 : 1);
+    }
+
     int pcode = -1;
 
 #if (_WIN32)
@@ -255,50 +776,38 @@ int main(int argc, char *argv[])
     }
 #endif
 
-    lm_mem_init(mem_size);
-
-    lm_parser_init();
+    if(makefile) {
+        lm_mem_init(mem_size);
+        lm_parser_init();
+
+        ret = lm_parser_lm_file(NULL, lmcfg);
+        if(ret == LM_OK) {
+            int timer = lm_time_begin("write", makefile);
+            lm_gen_mkfile_file(makefile, lmmk_file, lmcfg, projcfg, header_file, pro_name, build_dir, gcc_prefix, variant);
+            lm_time_end(timer);
+
+            timer = lm_time_begin("write", projcfg);
+            lm_gen_projcfg_file(projcfg);
+            lm_time_end(timer);
+        }
 
-    if(!makefile) {
-        ret = lm_parser_config_file(projcfg);
-        if(ret == LM_ERR) {
-            goto error;
+        if(time_report) {
+            lm_time_report(lm_parser_get_macro_head()->count);
         }
-    }
 
-    ret = lm_parser_lm_file(NULL, lmcfg);
-    if(ret == LM_ERR) {
-        goto error;
+        lm_mem_destroy();
     }
-
-    if(makefile) {
-        lm_gen_mkfile_file(makefile, lmmk_file, lmcfg, projcfg, header_file, pro_name, build_dir, gcc_prefix);
-        lm_gen_projcfg_file(projcfg);
-        goto exit;
+    else if(watch) {
+        ret = lm_watch(configure);
+    }
+    else {
+        ret = configure();
     }
 
-    if(!makefile) {
-        ret = lm_gen_lmmk_file(lmmk_file);
-        if(ret == LM_ERR) {
-            goto error;
-        }
-
-        ret = lm_gen_header_file(header_file);
-        if(ret == LM_ERR) {
-            goto error;
-        }
-
-        if(!blind) {
-            lm_macro_print_all_value(lm_parser_get_macro_head());
-        }
+    if(ret != LM_OK) {
+        LM_LOG_ERROR("parser failed, exiting");
+        return -1;
     }
 
-exit:
-    lm_mem_destroy();
     return 0;
-
-error:
-    lm_mem_destroy();
-    LM_LOG_ERROR("parser failed, exiting");
-    return -1;
 }